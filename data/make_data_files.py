@@ -74,7 +74,7 @@ def main():
 
     subprocess.check_call(["mkdir", "-p", "./"+mdir])
 
-    flist=['base@@', 'CVM_CM_TAG@@', 'CVM_CM.vo', 'CVM_CM_VP@@', 'CVM_CM_VS@@', 'CVMSM_flags@@', 'CVMSM_tag66@@', 'CVMSM_vp66@@', 'CVMSM_vs66@@', 'interfaces.vo', 'model_top@@', 'moho@@', 'topo_dem@@', 'CVMHB-San-Gabriel-Basin.vo', 'CVMHB-San-Gabriel-Basin_tag61_basin@@', 'CVMHB-San-Gabriel-Basin_vp63_basin@@', 'CVMHB-San-Gabriel-Basin_vs63_basin@@', 'CVMHB-San-Gabriel-Basin.dat']
+    flist=['base@@', 'CVM_CM_TAG@@', 'CVM_CM.vo', 'CVM_CM_VP@@', 'CVM_CM_VS@@', 'CVMSM.vo', 'CVMSM_flags@@', 'CVMSM_tag66@@', 'CVMSM_vp66@@', 'CVMSM_vs66@@', 'interfaces.vo', 'model_top@@', 'moho@@', 'topo_dem@@', 'CVMHB-San-Gabriel-Basin.vo', 'CVMHB-San-Gabriel-Basin_tag61_basin@@', 'CVMHB-San-Gabriel-Basin_vp63_basin@@', 'CVMHB-San-Gabriel-Basin_vs63_basin@@', 'CVMHB-San-Gabriel-Basin.dat']
 
     for f in flist :
         fname = mdir + "/" +f
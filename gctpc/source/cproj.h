@@ -28,7 +28,30 @@
 #define IMOD(A, B)      (A) - (((A) / (B)) * (B)) /* Integer mod function */
 
 
+/* Universal Transverse Mercator state, set up by utmforint_r or
+   utminvint_r and read by utmfor_r or utminv_r
+  -------------------------------------------------------------*/
+struct utm_state {
+  double r_major;		/* major axis 				*/
+  double r_minor;		/* minor axis 				*/
+  double scale_factor;		/* scale factor				*/
+  double lon_center;		/* Center longitude (projection center) */
+  double lat_origin;		/* center latitude			*/
+  double e0,e1,e2,e3;		/* eccentricity constants		*/
+  double e,es,esp;		/* eccentricity constants		*/
+  double ml0;			/* small value m			*/
+  double false_northing;	/* y offset in meters			*/
+  double false_easting;		/* x offset in meters			*/
+  long ind;			/* spherical flag			*/
+};
+
 /* forward delcaration */
+/* gctp.c */
+struct gctp_ctx;
+struct gctp_ctx *gctp_ctx_new();
+void gctp_ctx_free(struct gctp_ctx *ctx);
+long gctp_ctx_errors(struct gctp_ctx *ctx);
+
 /* cproj.c */
 double sign2(double x);
 
@@ -58,9 +81,11 @@ long sphdz(long isph,double *parm,double *r_major,double *r_minor,double *radius
 
 /* inv_init.c */
 void inv_init(long insys,long inzone,double *inparm,long indatum,char *fn27,char *fn83,long *iflg,long (*inv_trans[])());
+void inv_init_r(long insys,long inzone,double *inparm,long indatum,char *fn27,char *fn83,long *iflg,long (*inv_trans[])(),struct utm_state *utm);
 
 /* for_init.c */
 void for_init(long outsys,long outzone,double *outparm,long outdatum,char *fn27,char *fn83,long *iflg,long (*for_trans[])());
+void for_init_r(long outsys,long outzone,double *outparm,long outdatum,char *fn27,char *fn83,long *iflg,long (*for_trans[])(),struct utm_state *utm);
 
 /* cproj.c */
 void sincos(double val,double *sin_val,double *cos_val);
@@ -273,9 +298,13 @@ long tminv(double x,double y,double *lon,double *lat);
 /* utmfor.c */
 long utmforint(double r_maj,double r_min,double scale_fact,long zone);
 long utmfor(double lon,double lat,double *x,double *y);
+long utmforint_r(struct utm_state *st,double r_maj,double r_min,double scale_fact,long zone);
+long utmfor_r(struct utm_state *st,double lon,double lat,double *x,double *y);
 /* utminv.c */
 long utminvint(double r_maj,double r_min,double scale_fact,long zone);
 long utminv(double x,double y,double *lon,double *lat);
+long utminvint_r(struct utm_state *st,double r_maj,double r_min,double scale_fact,long zone);
+long utminv_r(struct utm_state *st,double x,double y,double *lon,double *lat);
 
 /* vandgfor.c */
 long vandgforint(double r,double center_long,double false_east,double false_north); 
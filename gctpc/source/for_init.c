@@ -21,7 +21,7 @@ ALGORITHM REFERENCES
 #include "cproj.h"
 #include "proj.h"
 
-void for_init(outsys,outzone,outparm,outdatum,fn27,fn83,iflg,for_trans)
+void for_init_r(outsys,outzone,outparm,outdatum,fn27,fn83,iflg,for_trans,utm)
 
 long outsys;		/* output system code				*/
 long outzone;		/* output zone number				*/
@@ -31,6 +31,7 @@ char *fn27;		/* NAD 1927 parameter file			*/
 char *fn83;		/* NAD 1983 parameter file			*/
 long *iflg;		/* status flag					*/
 long (*for_trans[])();	/* forward function pointer			*/
+struct utm_state *utm;	/* UTM state, NULL for the utmfor.c file state	*/
 {
 long zone;		/* zone number					*/
 double azimuth;		/* azimuth					*/
@@ -127,7 +128,10 @@ long obleqfor();
          zone = -zone;
       }
     scale_factor = .9996;
-    *iflg = utmforint(r_major,r_minor,scale_factor,zone);
+    if (utm != NULL)
+       *iflg = utmforint_r(utm,r_major,r_minor,scale_factor,zone);
+    else
+       *iflg = utmforint(r_major,r_minor,scale_factor,zone);
     for_trans[outsys] = utmfor;
     }
   else
@@ -576,3 +580,19 @@ long obleqfor();
    
 return;
 }
+
+/* Initialize forward transformations on the file states
+  -----------------------------------------------------*/
+void for_init(outsys,outzone,outparm,outdatum,fn27,fn83,iflg,for_trans)
+
+long outsys;
+long outzone;
+double *outparm;
+long outdatum;
+char *fn27;
+char *fn83;
+long *iflg;
+long (*for_trans[])();
+{
+for_init_r(outsys,outzone,outparm,outdatum,fn27,fn83,iflg,for_trans,NULL);
+}
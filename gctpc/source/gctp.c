@@ -27,21 +27,48 @@ ALGORITHM REFERENCES
 *******************************************************************************/
 #include "cproj.h"
 #include "proj.h"
+#include <stdlib.h>
+#include <pthread.h>
 
 #define TRUE 1
 #define FALSE 0
 
-static long iter = 0;			/* First time flag		*/
-static long inpj[MAXPROJ + 1];		/* input projection array	*/
-static long indat[MAXPROJ + 1];		/* input dataum array		*/
-static long inzn[MAXPROJ + 1];		/* input zone array		*/
-static double pdin[MAXPROJ + 1][15]; 	/* input projection parm array	*/
-static long outpj[MAXPROJ + 1];		/* output projection array	*/
-static long outdat[MAXPROJ + 1];	/* output dataum array		*/
-static long outzn[MAXPROJ + 1];		/* output zone array		*/
-static double pdout[MAXPROJ + 1][15]; 	/* output projection parm array	*/
-static long (*for_trans[MAXPROJ + 1])();/* forward function pointer array*/
-static long (*inv_trans[MAXPROJ + 1])();/* inverse function pointer array*/
+/* Projection state of one conversion context.  The UTM state is kept
+   here as well so contexts converting to or from UTM do not share the
+   utmfor.c/utminv.c file state.  Every other projection keeps its
+   state in its own file, shared by all contexts
+  ------------------------------------------------------------------*/
+struct gctp_ctx {
+   long iter;				/* First time flag		*/
+   long inpj[MAXPROJ + 1];		/* input projection array	*/
+   long indat[MAXPROJ + 1];		/* input dataum array		*/
+   long inzn[MAXPROJ + 1];		/* input zone array		*/
+   double pdin[MAXPROJ + 1][15]; 	/* input projection parm array	*/
+   long outpj[MAXPROJ + 1];		/* output projection array	*/
+   long outdat[MAXPROJ + 1];		/* output dataum array		*/
+   long outzn[MAXPROJ + 1];		/* output zone array		*/
+   double pdout[MAXPROJ + 1][15]; 	/* output projection parm array	*/
+   long (*for_trans[MAXPROJ + 1])();	/* forward function pointer array*/
+   long (*inv_trans[MAXPROJ + 1])();	/* inverse function pointer array*/
+   struct utm_state utmf;		/* forward UTM state		*/
+   struct utm_state utmi;		/* inverse UTM state		*/
+   long quiet;				/* no error or parameter output	*/
+   long nsuppressed;			/* errors not reported, quiet	*/
+};
+
+static struct gctp_ctx gctp_dflt;	/* context of gctp and gctp_batch */
+
+/* Context that last initialized the file state of each inverse and
+   forward projection.  A context whose own parameters match still
+   initializes again when another context did so in between.  Only
+   projections with file state use the tables, GEO has no state and
+   UTM runs on the context, so those conversions touch nothing shared
+  -----------------------------------------------------------------*/
+static struct gctp_ctx *gctp_inown[MAXPROJ + 1];
+static struct gctp_ctx *gctp_outown[MAXPROJ + 1];
+static pthread_mutex_t gctp_own_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define GCTP_SHARED(sys) (((sys) != GEO) && ((sys) != UTM))
 
 			/* Table of unit codes as specified by state
 			   laws as of 2/1/92 for NAD 1983 State Plane
@@ -64,9 +91,166 @@ static long NAD83[134] = {101,102,5010,5300,201,202,203,301,302,401,402,403,
                 4502,4601,4602,4701,4702,4801,4802,4803,4901,4902,4903,4904,
                 5001,5002,5003,5004,5005,5006,5007,5008,5009,5200,0000,5400};
 
-void gctp(incoor,insys,inzone,inparm,inunit,indatum,ipr,efile,jpr,pfile,outcoor,
-     outsys,outzone,outparm,outunit,outdatum,fn27,fn83,iflg)
+/* Allocates a conversion context.  Each context sets up its projections
+   on first use like gctp does.  Contexts converting between geographic
+   and UTM may be used from different threads at the same time, other
+   projections share file state and are for one thread at a time.
+   Returns NULL when out of memory
+  --------------------------------------------------------------------*/
+struct gctp_ctx *gctp_ctx_new()
+{
+return((struct gctp_ctx *)calloc(1, sizeof(struct gctp_ctx)));
+}
+
+/* Releases a conversion context
+  -----------------------------*/
+void gctp_ctx_free(ctx)
+
+struct gctp_ctx *ctx;
+{
+long i;
+
+pthread_mutex_lock(&gctp_own_lock);
+for (i = 0; i < MAXPROJ + 1; i++)
+   {
+   if (gctp_inown[i] == ctx)
+      gctp_inown[i] = NULL;
+   if (gctp_outown[i] == ctx)
+      gctp_outown[i] = NULL;
+   }
+pthread_mutex_unlock(&gctp_own_lock);
+free(ctx);
+}
+
+/* Whether ctx last initialized the file state of projection sys in
+   owner table own
+  ----------------------------------------------------------------*/
+static long gctp_owns(own, sys, ctx)
+
+struct gctp_ctx **own;
+long sys;
+struct gctp_ctx *ctx;
+{
+long owns;
+
+pthread_mutex_lock(&gctp_own_lock);
+owns = (own[sys] == ctx);
+pthread_mutex_unlock(&gctp_own_lock);
+return(owns);
+}
+
+/* Records ctx, NULL after a failed initialization, as the owner of the
+   file state of projection sys in owner table own
+  --------------------------------------------------------------------*/
+static void gctp_setown(own, sys, ctx)
+
+struct gctp_ctx **own;
+long sys;
+struct gctp_ctx *ctx;
+{
+pthread_mutex_lock(&gctp_own_lock);
+own[sys] = ctx;
+pthread_mutex_unlock(&gctp_own_lock);
+}
+
+/* Number of failed conversions of a context, NULL for the default
+   context, while its reporting was quiet
+  ---------------------------------------------------------------*/
+long gctp_ctx_errors(ctx)
+
+struct gctp_ctx *ctx;
+{
+if (ctx == NULL)
+   ctx = &gctp_dflt;
+return(ctx->nsuppressed);
+}
+
+/* Turns report.c output off, once for every quiet context
+  -------------------------------------------------------*/
+static pthread_once_t gctp_quiet_once = PTHREAD_ONCE_INIT;
+
+static void gctp_quiet_init()
+{
+init(-1L, -1L, "", "");
+}
 
+/* Sets up error and parameter reporting for a context.  A context
+   asked for neither terminal nor file output (ipr and jpr other than
+   0, 1 or 2) is quiet: report.c is turned off once per process under
+   pthread_once and quiet conversions never go through init and
+   close_file, failures are counted instead.  Quiet contexts thus
+   write no report.c state and may run on several threads.  Contexts
+   with output set report.c up on every conversion and, like the
+   projections with file state, are for one thread at a time
+  ----------------------------------------------------------------*/
+static long gctp_report(ctx, ipr, jpr, efile, pfile)
+
+struct gctp_ctx *ctx;
+long ipr;
+long jpr;
+char *efile;
+char *pfile;
+{
+ctx->quiet = ((ipr < 0) || (ipr > 2)) && ((jpr < 0) || (jpr > 2));
+if (ctx->quiet)
+   {
+   pthread_once(&gctp_quiet_once, gctp_quiet_init);
+   return(0);
+   }
+return(init(ipr,jpr,efile,pfile));
+}
+
+/* Ends a conversion, counting the failure of a quiet context
+  ----------------------------------------------------------*/
+static void gctp_close(ctx, iflg)
+
+struct gctp_ctx *ctx;
+long iflg;
+{
+if (ctx->quiet)
+   {
+   if (iflg != 0)
+      ctx->nsuppressed++;
+   return;
+   }
+close_file();
+}
+
+/* Inverse and forward transformations of a context, UTM runs on the
+   context state
+  ---------------------------------------------------------------*/
+static long gctp_inv(ctx, sys, x, y, lon, lat)
+
+struct gctp_ctx *ctx;
+long sys;
+double x;
+double y;
+double *lon;
+double *lat;
+{
+if (sys == UTM)
+   return(utminv_r(&ctx->utmi, x, y, lon, lat));
+return(ctx->inv_trans[sys](x, y, lon, lat));
+}
+
+static long gctp_for(ctx, sys, lon, lat, x, y)
+
+struct gctp_ctx *ctx;
+long sys;
+double lon;
+double lat;
+double *x;
+double *y;
+{
+if (sys == UTM)
+   return(utmfor_r(&ctx->utmf, lon, lat, x, y));
+return(ctx->for_trans[sys](lon, lat, x, y));
+}
+
+void gctp_r(ctx,incoor,insys,inzone,inparm,inunit,indatum,ipr,efile,jpr,pfile,
+     outcoor,outsys,outzone,outparm,outunit,outdatum,fn27,fn83,iflg)
+
+struct gctp_ctx *ctx;	/* conversion context				*/
 double *incoor;		/* input coordinates				*/
 long *insys;		/* input projection code			*/
 long *inzone;		/* input zone number				*/
@@ -110,7 +294,7 @@ ininit_flag = FALSE;
 outinit_flag = FALSE;
 *iflg = 0;
 
-*iflg = init(*ipr,*jpr,efile,pfile);
+*iflg = gctp_report(ctx,*ipr,*jpr,efile,pfile);
 if (*iflg != 0)
    return;
 
@@ -119,38 +303,39 @@ if (*iflg != 0)
 only the first 13 projection parameters are currently used.
 If more are added the loop should be increased.
 ---------------------------------------------------------*/
-if (iter == 0)
+if (ctx->iter == 0)
    {
    for (i = 0; i < MAXPROJ + 1; i++)
       {
-      inpj[i] = 0;
-      indat[i] = 0;
-      inzn[i] = 0;
-      outpj[i] = 0;
-      outdat[i] = 0;
-      outzn[i] = 0;
+      ctx->inpj[i] = 0;
+      ctx->indat[i] = 0;
+      ctx->inzn[i] = 0;
+      ctx->outpj[i] = 0;
+      ctx->outdat[i] = 0;
+      ctx->outzn[i] = 0;
       for (j = 0; j < 15; j++)
          {
-         pdin[i][j] = 0.0;
-         pdout[i][j] = 0.0;
+         ctx->pdin[i][j] = 0.0;
+         ctx->pdout[i][j] = 0.0;
          }
       }
    ininit_flag = TRUE;
    outinit_flag = TRUE;
-   iter = 1;
+   ctx->iter = 1;
    }
 else
    {
    if (*insys != GEO)
      {
-     if ((inzn[*insys] != *inzone) || (indat[*insys] != *indatum) || 
-         (inpj[*insys] != *insys) || (*insys == 2))
+     if ((ctx->inzn[*insys] != *inzone) || (ctx->indat[*insys] != *indatum) || 
+         (ctx->inpj[*insys] != *insys) || (*insys == 2) ||
+         (GCTP_SHARED(*insys) && !gctp_owns(gctp_inown, *insys, ctx)))
         {
         ininit_flag = TRUE;
         }
      else
      for (i = 0; i < 13; i++)
-        if (pdin[*insys][i] != inparm[i])
+        if (ctx->pdin[*insys][i] != inparm[i])
           {
           ininit_flag = TRUE;
           break;
@@ -158,14 +343,15 @@ else
      }
    if (*outsys != GEO)
      {
-     if ((outzn[*outsys] != *outzone) || (outdat[*outsys] != *outdatum) || 
-         (outpj[*outsys] != *outsys) || (*outsys == 2))
+     if ((ctx->outzn[*outsys] != *outzone) || (ctx->outdat[*outsys] != *outdatum) || 
+         (ctx->outpj[*outsys] != *outsys) || (*outsys == 2) ||
+         (GCTP_SHARED(*outsys) && !gctp_owns(gctp_outown, *outsys, ctx)))
         {
         outinit_flag = TRUE;
         }
      else
      for (i = 0; i < 13; i++)
-        if (pdout[*outsys][i] != outparm[i])
+        if (ctx->pdout[*outsys][i] != outparm[i])
           {
           outinit_flag = TRUE;
           break;
@@ -179,12 +365,14 @@ if ((*insys < 0) || (*insys > MAXPROJ))
    {
    p_error("Insys is illegal","GCTP-INPUT");
    *iflg = 1;
+   gctp_close(ctx,*iflg);
    return;
    }
 if ((*outsys < 0) || (*outsys > MAXPROJ))
    {
    p_error("Outsys is illegal","GCTP-OUTPUT");
    *iflg = 2;
+   gctp_close(ctx,*iflg);
    return;
    }
 
@@ -209,7 +397,7 @@ if (*insys == SPCS)
    *inunit = unit;
 if (*iflg != 0)
    {
-   close_file();
+   gctp_close(ctx,*iflg);
    return;
    }
  
@@ -220,11 +408,11 @@ y = incoor[1] * factor;
 ----------------------------------*/
 if (ininit_flag)
    {
-   inpj[*insys] = *insys;
-   indat[*insys] = *indatum;
-   inzn[*insys] = *inzone;
+   ctx->inpj[*insys] = *insys;
+   ctx->indat[*insys] = *indatum;
+   ctx->inzn[*insys] = *inzone;
    for (i = 0;i < 15; i++)
-      pdin[*insys][i] = inparm[i];
+      ctx->pdin[*insys][i] = inparm[i];
    if (*insys == 1)
       {
       for( i = 2; i < 15; i++)
@@ -244,13 +432,17 @@ if (ininit_flag)
          dummy[0] = inparm[0];
          dummy[1] = inparm[1];
          }
-      inv_init(*insys,*inzone,dummy,*indatum,fn27,fn83,iflg,inv_trans);
+      inv_init_r(*insys,*inzone,dummy,*indatum,fn27,fn83,iflg,ctx->inv_trans,
+                 &ctx->utmi);
       }
    else
-      inv_init(*insys,*inzone,inparm,*indatum,fn27,fn83,iflg,inv_trans);
+      inv_init_r(*insys,*inzone,inparm,*indatum,fn27,fn83,iflg,ctx->inv_trans,
+                 &ctx->utmi);
+   if (GCTP_SHARED(*insys))
+      gctp_setown(gctp_inown, *insys, (*iflg != 0) ? NULL : ctx);
    if (*iflg != 0)
       {
-      close_file();
+      gctp_close(ctx,*iflg);
       return;
       }
    }
@@ -266,9 +458,9 @@ if (*insys == GEO)
    lat = y;
    }
 else
-if ((*iflg = inv_trans[*insys](x, y, &lon, &lat)) != 0)
+if ((*iflg = gctp_inv(ctx, *insys, x, y, &lon, &lat)) != 0)
    {
-   close_file();
+   gctp_close(ctx,*iflg);
    return;
    }
 
@@ -283,11 +475,11 @@ if ((*iflg = inv_trans[*insys](x, y, &lon, &lat)) != 0)
 ----------------------------------*/
 if (outinit_flag)
    {
-   outpj[*outsys] = *outsys;
-   outdat[*outsys] = *outdatum;
-   outzn[*outsys] = *outzone;
+   ctx->outpj[*outsys] = *outsys;
+   ctx->outdat[*outsys] = *outdatum;
+   ctx->outzn[*outsys] = *outzone;
    for (i = 0;i < 15; i++)
-      pdout[*outsys][i] = outparm[i];
+      ctx->pdout[*outsys][i] = outparm[i];
    if (*outsys == 1)
       {
       for (i = 2; i < 15; i++)
@@ -304,13 +496,17 @@ if (outinit_flag)
 	 dummy[0] = outparm[0];
 	 dummy[1] = outparm[1];
 	 }
-      for_init(*outsys,*outzone,dummy,*outdatum,fn27,fn83,iflg,for_trans);
+      for_init_r(*outsys,*outzone,dummy,*outdatum,fn27,fn83,iflg,ctx->for_trans,
+                 &ctx->utmf);
       }
    else
-      for_init(*outsys,*outzone,outparm,*outdatum,fn27,fn83,iflg,for_trans);
+      for_init_r(*outsys,*outzone,outparm,*outdatum,fn27,fn83,iflg,ctx->for_trans,
+                 &ctx->utmf);
+   if (GCTP_SHARED(*outsys))
+      gctp_setown(gctp_outown, *outsys, (*iflg != 0) ? NULL : ctx);
    if (*iflg != 0)
       {
-      close_file();
+      gctp_close(ctx,*iflg);
       return;
       }
    }
@@ -323,9 +519,9 @@ if (*outsys == GEO)
    outcoor[1] = lat;
    }
 else
-if ((*iflg = for_trans[*outsys](lon, lat, &outcoor[0], &outcoor[1])) != 0)
+if ((*iflg = gctp_for(ctx, *outsys, lon, lat, &outcoor[0], &outcoor[1])) != 0)
    {
-   close_file();
+   gctp_close(ctx,*iflg);
    return;
    }
 
@@ -349,6 +545,187 @@ if (*outsys == SPCS)
 
 outcoor[0] *= factor;
 outcoor[1] *= factor;
-close_file();
+gctp_close(ctx,*iflg);
 return;
 }
+
+/* Converts one coordinate pair on the default context
+  ----------------------------------------------------*/
+void gctp(incoor,insys,inzone,inparm,inunit,indatum,ipr,efile,jpr,pfile,outcoor,
+     outsys,outzone,outparm,outunit,outdatum,fn27,fn83,iflg)
+
+double *incoor;
+long *insys;
+long *inzone;
+double *inparm;
+long *inunit;
+long *indatum;
+long *ipr;
+char *efile;
+long *jpr;
+char *pfile;
+double *outcoor;
+long *outsys;
+long *outzone;
+double *outparm;
+long *outunit;
+long *outdatum;
+char fn27[];
+char fn83[];
+long *iflg;
+{
+gctp_r(&gctp_dflt,incoor,insys,inzone,inparm,inunit,indatum,ipr,efile,jpr,pfile,
+     outcoor,outsys,outzone,outparm,outunit,outdatum,fn27,fn83,iflg);
+}
+
+/*******************************************************************************
+NAME                           GCTP_BATCH 
+
+PURPOSE:	Converts n coordinate pairs with the same parameters as gctp.
+		The first pair goes through gctp, which sets up the
+		projections, the unit factors are looked up once and the
+		remaining pairs go straight to the inverse and forward
+		transformations.  inx/iny and outx/outy may be the same
+		arrays.  On an error iflg is set as in gctp and the output
+		pairs from the failing one on are not valid.
+*******************************************************************************/
+void gctp_batch_r(ctx,n,inx,iny,insys,inzone,inparm,inunit,indatum,ipr,efile,
+     jpr,pfile,outx,outy,outsys,outzone,outparm,outunit,outdatum,fn27,fn83,iflg)
+
+struct gctp_ctx *ctx;	/* conversion context				*/
+long n;			/* number of coordinate pairs			*/
+double *inx;		/* input x coordinates				*/
+double *iny;		/* input y coordinates				*/
+long *insys;		/* input projection code			*/
+long *inzone;		/* input zone number				*/
+double *inparm;		/* input projection parameter array		*/
+long *inunit;		/* input units					*/
+long *indatum;		/* input datum 					*/
+long *ipr;		/* printout flag for error messages		*/
+char *efile;		/* error file name				*/
+long *jpr;		/* printout flag for projection parameters	*/
+char *pfile;		/* parameter file name				*/
+double *outx;		/* output x coordinates				*/
+double *outy;		/* output y coordinates				*/
+long *outsys;		/* output projection code			*/
+long *outzone;		/* output zone					*/
+double *outparm;	/* output projection array			*/
+long *outunit;		/* output units					*/
+long *outdatum;		/* output datum					*/
+char fn27[];		/* file name of NAD 1927 parameter file		*/
+char fn83[]; 	 	/* file name of NAD 1983 parameter file		*/
+long *iflg;		/* error flag					*/
+{
+double incoor[2];	/* first input pair				*/
+double outcoor[2];	/* first output pair				*/
+double infactor;	/* input unit conversion factor			*/
+double outfactor;	/* output unit conversion factor		*/
+double lon;		/* longitude					*/
+double lat;		/* latitude					*/
+long i;			/* loop counter					*/
+
+*iflg = 0;
+if (n <= 0)
+   return;
+
+/* the first pair initializes the projections
+-------------------------------------------*/
+incoor[0] = inx[0];
+incoor[1] = iny[0];
+gctp_r(ctx,incoor,insys,inzone,inparm,inunit,indatum,ipr,efile,jpr,pfile,
+     outcoor,outsys,outzone,outparm,outunit,outdatum,fn27,fn83,iflg);
+if (*iflg != 0)
+   return;
+outx[0] = outcoor[0];
+outy[0] = outcoor[1];
+if (n == 1)
+   return;
+
+/* gctp has resolved the State Plane units in inunit and outunit
+--------------------------------------------------------------*/
+if (*insys == GEO)
+   *iflg = untfz(*inunit,0,&infactor); 
+else
+   *iflg = untfz(*inunit,2,&infactor); 
+if (*iflg == 0)
+   {
+   if (*outsys == GEO)
+      *iflg = untfz(0,*outunit,&outfactor); 
+   else
+      *iflg = untfz(2,*outunit,&outfactor); 
+   }
+if (*iflg != 0)
+   return;
+
+*iflg = gctp_report(ctx,*ipr,*jpr,efile,pfile);
+if (*iflg != 0)
+   return;
+
+/* unit conversion in one pass, then the transformations
+------------------------------------------------------*/
+for (i = 1; i < n; i++)
+   {
+   outx[i] = inx[i] * infactor;
+   outy[i] = iny[i] * infactor;
+   }
+for (i = 1; i < n; i++)
+   {
+   if (*insys == GEO)
+      {
+      lon = outx[i];
+      lat = outy[i];
+      }
+   else
+   if ((*iflg = gctp_inv(ctx, *insys, outx[i], outy[i], &lon, &lat)) != 0)
+      break;
+   if (*outsys == GEO)
+      {
+      outx[i] = lon;
+      outy[i] = lat;
+      }
+   else
+   if ((*iflg = gctp_for(ctx, *outsys, lon, lat, &outx[i], &outy[i])) != 0)
+      break;
+   }
+n = i;
+for (i = 1; i < n; i++)
+   {
+   outx[i] *= outfactor;
+   outy[i] *= outfactor;
+   }
+gctp_close(ctx,*iflg);
+return;
+}
+
+/* Converts n coordinate pairs on the default context
+  --------------------------------------------------*/
+void gctp_batch(n,inx,iny,insys,inzone,inparm,inunit,indatum,ipr,efile,jpr,
+     pfile,outx,outy,outsys,outzone,outparm,outunit,outdatum,fn27,fn83,iflg)
+
+long n;
+double *inx;
+double *iny;
+long *insys;
+long *inzone;
+double *inparm;
+long *inunit;
+long *indatum;
+long *ipr;
+char *efile;
+long *jpr;
+char *pfile;
+double *outx;
+double *outy;
+long *outsys;
+long *outzone;
+double *outparm;
+long *outunit;
+long *outdatum;
+char fn27[];
+char fn83[];
+long *iflg;
+{
+gctp_batch_r(&gctp_dflt,n,inx,iny,insys,inzone,inparm,inunit,indatum,ipr,efile,
+     jpr,pfile,outx,outy,outsys,outzone,outparm,outunit,outdatum,fn27,fn83,
+     iflg);
+}
@@ -21,7 +21,7 @@ ALGORITHM REFERENCES
 #include "cproj.h"
 #include "proj.h"
 
-void inv_init(insys,inzone,inparm,indatum,fn27,fn83,iflg,inv_trans)
+void inv_init_r(insys,inzone,inparm,indatum,fn27,fn83,iflg,inv_trans,utm)
 
 long insys;		/* input system code				*/
 long inzone;		/* input zone number				*/
@@ -31,6 +31,7 @@ char *fn27;		/* NAD 1927 parameter file			*/
 char *fn83;		/* NAD 1983 parameter file			*/
 long *iflg;		/* status flag					*/
 long (*inv_trans[])();	/* inverse function pointer			*/
+struct utm_state *utm;	/* UTM state, NULL for the utminv.c file state	*/
 {
 long zone;		/* zone number					*/
 double azimuth;		/* azimuth					*/
@@ -129,7 +130,10 @@ long obleqinv();
            zone = -zone;
         }
      scale_factor = .9996;
-     *iflg = utminvint(r_major,r_minor,scale_factor,zone);
+     if (utm != NULL)
+        *iflg = utminvint_r(utm,r_major,r_minor,scale_factor,zone);
+     else
+        *iflg = utminvint(r_major,r_minor,scale_factor,zone);
      inv_trans[insys] = utminv;
      }
   else
@@ -581,3 +585,19 @@ long obleqinv();
 
 return;
 }
+
+/* Initialize inverse transformations on the file states
+  -----------------------------------------------------*/
+void inv_init(insys,inzone,inparm,indatum,fn27,fn83,iflg,inv_trans)
+
+long insys;
+long inzone;
+double *inparm;
+long indatum;
+char *fn27;
+char *fn83;
+long *iflg;
+long (*inv_trans[])();
+{
+inv_init_r(insys,inzone,inparm,indatum,fn27,fn83,iflg,inv_trans,NULL);
+}
@@ -29,24 +29,16 @@ ALGORITHM REFERENCES
 *******************************************************************************/
 #include "cproj.h"
 
-/* Variables common to all subroutines in this code file
-  -----------------------------------------------------*/
-static double r_major;		/* major axis 				*/
-static double r_minor;		/* minor axis 				*/
-static double scale_factor;	/* scale factor				*/
-static double lon_center;	/* Center longitude (projection center) */
-static double lat_origin;	/* center latitude			*/
-static double e0,e1,e2,e3;	/* eccentricity constants		*/
-static double e,es,esp;		/* eccentricity constants		*/
-static double ml0;		/* small value m			*/
-static double false_northing;	/* y offset in meters			*/
-static double false_easting;	/* x offset in meters			*/
-static double ind;		/* spherical flag			*/
+/* State of the legacy entry points, callers of the _r versions keep
+   their own struct utm_state
+  -----------------------------------------------------------------*/
+static struct utm_state utmfor_state;
 
 /* Initialize the Universal Transverse Mercator (UTM) projection
   -------------------------------------------------------------*/
-long utmforint(r_maj,r_min,scale_fact,zone)
+long utmforint_r(st,r_maj,r_min,scale_fact,zone)
 
+struct utm_state *st;		/* projection state			*/
 double r_maj;			/* major axis				*/
 double r_min;			/* minor axis				*/
 double scale_fact;		/* scale factor				*/
@@ -60,34 +52,34 @@ if ((abs(zone) < 1) || (abs(zone) > 60))
    p_error("Illegal zone number","utm-forint");
    return(11);
    }
-r_major = r_maj;
-r_minor = r_min;
-scale_factor = scale_fact;
-lat_origin = 0.0;
-lon_center = ((6 * abs(zone)) - 183) * D2R;
-false_easting = 500000.0;
-false_northing = (zone < 0) ? 10000000.0 : 0.0;
-
-temp = r_minor / r_major;
-es = 1.0 - SQUARE(temp);
-e = sqrt(es);
-e0 = e0fn(es);
-e1 = e1fn(es);
-e2 = e2fn(es);
-e3 = e3fn(es);
-ml0 = r_major * mlfn(e0, e1, e2, e3, lat_origin);
-esp = es / (1.0 - es);
-
-if (es < .00001)
-   ind = 1;
+st->r_major = r_maj;
+st->r_minor = r_min;
+st->scale_factor = scale_fact;
+st->lat_origin = 0.0;
+st->lon_center = ((6 * abs(zone)) - 183) * D2R;
+st->false_easting = 500000.0;
+st->false_northing = (zone < 0) ? 10000000.0 : 0.0;
+
+temp = st->r_minor / st->r_major;
+st->es = 1.0 - SQUARE(temp);
+st->e = sqrt(st->es);
+st->e0 = e0fn(st->es);
+st->e1 = e1fn(st->es);
+st->e2 = e2fn(st->es);
+st->e3 = e3fn(st->es);
+st->ml0 = st->r_major * mlfn(st->e0, st->e1, st->e2, st->e3, st->lat_origin);
+st->esp = st->es / (1.0 - st->es);
+
+if (st->es < .00001)
+   st->ind = 1;
 
 /* Report parameters to the user
   -----------------------------*/
 ptitle("UNIVERSAL TRANSVERSE MERCATOR (UTM)"); 
 genrpt_long(zone,   "Zone:     ");
-radius2(r_major, r_minor);
-genrpt(scale_factor,"Scale Factor at C. Meridian:     ");
-cenlonmer(lon_center);
+radius2(st->r_major, st->r_minor);
+genrpt(st->scale_factor,"Scale Factor at C. Meridian:     ");
+cenlonmer(st->lon_center);
 return(OK);
 }
 
@@ -96,7 +88,8 @@ return(OK);
    Note:  The algorithm for UTM is exactly the same as TM and therefore
 	  if a change is implemented, also make the change to TMFOR.c
   -----------------------------------------------------------------------*/
-long utmfor(lon, lat, x, y)
+long utmfor_r(st, lon, lat, x, y)
+struct utm_state *st;		/* (I) Projection state		*/
 double lon;			/* (I) Longitude 		*/
 double lat;			/* (I) Latitude 		*/
 double *x;			/* (O) X projection coordinate 	*/
@@ -115,12 +108,12 @@ double con, n, ml;	/* cone constant, small m			*/
 
 /* Forward equations
   -----------------*/
-delta_lon = adjust_lon(lon - lon_center);
+delta_lon = adjust_lon(lon - st->lon_center);
 sincos(lat, &sin_phi, &cos_phi);
 
 /* This part was in the fortran code and is for the spherical form 
 ----------------------------------------------------------------*/
-if (ind != 0)
+if (st->ind != 0)
   {
   b = cos_phi * sin(delta_lon);
   if ((fabs(fabs(b) - 1.0)) < .0000000001)
@@ -130,30 +123,51 @@ if (ind != 0)
      }
   else
      {
-     *x = .5 * r_major * scale_factor * log((1.0 + b)/(1.0 - b));
+     *x = .5 * st->r_major * st->scale_factor * log((1.0 + b)/(1.0 - b));
      con = acos(cos_phi * cos(delta_lon)/sqrt(1.0 - b*b));
      if (lat < 0)
         con = - con;
-     *y = r_major * scale_factor * (con - lat_origin); 
+     *y = st->r_major * st->scale_factor * (con - st->lat_origin); 
      return(OK);
      }
   }
 
 al  = cos_phi * delta_lon;
 als = SQUARE(al);
-c   = esp * SQUARE(cos_phi);
+c   = st->esp * SQUARE(cos_phi);
 tq  = tan(lat);
 t   = SQUARE(tq);
-con = 1.0 - es * SQUARE(sin_phi);
-n   = r_major / sqrt(con);
-ml  = r_major * mlfn(e0, e1, e2, e3, lat);
+con = 1.0 - st->es * SQUARE(sin_phi);
+n   = st->r_major / sqrt(con);
+ml  = st->r_major * mlfn(st->e0, st->e1, st->e2, st->e3, lat);
 
-*x  = scale_factor * n * al * (1.0 + als / 6.0 * (1.0 - t + c + als / 20.0 *
-      (5.0 - 18.0 * t + SQUARE(t) + 72.0 * c - 58.0 * esp))) + false_easting;
+*x  = st->scale_factor * n * al * (1.0 + als / 6.0 * (1.0 - t + c + als /
+      20.0 * (5.0 - 18.0 * t + SQUARE(t) + 72.0 * c - 58.0 * st->esp))) +
+      st->false_easting;
 
-*y  = scale_factor * (ml - ml0 + n * tq * (als * (0.5 + als / 24.0 *
+*y  = st->scale_factor * (ml - st->ml0 + n * tq * (als * (0.5 + als / 24.0 *
       (5.0 - t + 9.0 * c + 4.0 * SQUARE(c) + als / 30.0 * (61.0 - 58.0 * t
-      + SQUARE(t) + 600.0 * c - 330.0 * esp))))) + false_northing;
+      + SQUARE(t) + 600.0 * c - 330.0 * st->esp))))) + st->false_northing;
 
 return(OK);
 }
+
+/* Legacy entry points on the file state
+  -------------------------------------*/
+long utmforint(r_maj,r_min,scale_fact,zone)
+double r_maj;
+double r_min;
+double scale_fact;
+long   zone;
+{
+return(utmforint_r(&utmfor_state,r_maj,r_min,scale_fact,zone));
+}
+
+long utmfor(lon, lat, x, y)
+double lon;
+double lat;
+double *x;
+double *y;
+{
+return(utmfor_r(&utmfor_state,lon,lat,x,y));
+}
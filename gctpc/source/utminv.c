@@ -31,25 +31,16 @@ ALGORITHM REFERENCES
 #include "cproj.h"
 
 
-/* Variables common to all subroutines in this code file
-  -----------------------------------------------------*/
-static double r_major;          /* major axis                           */
-static double r_minor;          /* minor axis                           */
-static double scale_factor;     /* scale factor                         */
-static double lon_center;       /* Center longitude (projection center) */
-static double lat_origin;       /* center latitude                      */
-static double e0,e1,e2,e3;      /* eccentricity constants               */
-static double e,es,esp;         /* eccentricity constants               */
-static double ml0;              /* small value m                        */
-static double false_northing;   /* y offset in meters                   */
-static double false_easting; 	/* x offset in meters			*/
-static long ind;		/* sphere flag value			*/
-
+/* State of the legacy entry points, callers of the _r versions keep
+   their own struct utm_state
+  -----------------------------------------------------------------*/
+static struct utm_state utminv_state;
 
 /* Initialize the Universal Transverse Mercator (UTM) projection
   -------------------------------------------------------------*/
-long utminvint(r_maj,r_min,scale_fact,zone)
+long utminvint_r(st,r_maj,r_min,scale_fact,zone)
 
+struct utm_state *st;		/* projection state			*/
 double r_maj;			/* major axis				*/
 double r_min;			/* minor axis				*/
 double scale_fact;		/* scale factor				*/
@@ -63,36 +54,36 @@ if ((abs(zone) < 1) || (abs(zone) > 60))
    p_error("Illegal zone number","utm-invint");
    return(11);
    }
-r_major = r_maj;
-r_minor = r_min;
-scale_factor = scale_fact;
-lat_origin = 0.0;
-lon_center = ((6 * abs(zone)) - 183) * D2R;
-false_easting = 500000.0;
-false_northing = (zone < 0) ? 10000000.0 : 0.0;
-
-temp = r_minor / r_major;
-es = 1.0 - SQUARE(temp);
-e = sqrt(es);
-e0 = e0fn(es);
-e1 = e1fn(es);
-e2 = e2fn(es);
-e3 = e3fn(es);
-ml0 = r_major * mlfn(e0, e1, e2, e3, lat_origin);
-esp = es / (1.0 - es);
-
-if (es < .00001)
-   ind = 1;
+st->r_major = r_maj;
+st->r_minor = r_min;
+st->scale_factor = scale_fact;
+st->lat_origin = 0.0;
+st->lon_center = ((6 * abs(zone)) - 183) * D2R;
+st->false_easting = 500000.0;
+st->false_northing = (zone < 0) ? 10000000.0 : 0.0;
+
+temp = st->r_minor / st->r_major;
+st->es = 1.0 - SQUARE(temp);
+st->e = sqrt(st->es);
+st->e0 = e0fn(st->es);
+st->e1 = e1fn(st->es);
+st->e2 = e2fn(st->es);
+st->e3 = e3fn(st->es);
+st->ml0 = st->r_major * mlfn(st->e0, st->e1, st->e2, st->e3, st->lat_origin);
+st->esp = st->es / (1.0 - st->es);
+
+if (st->es < .00001)
+   st->ind = 1;
 else 
-   ind = 0;
+   st->ind = 0;
 
 /* Report parameters to the user
   -----------------------------*/
 ptitle("UNIVERSAL TRANSVERSE MERCATOR (UTM)"); 
 genrpt_long(zone,   "Zone:     ");
-radius2(r_major, r_minor);
-genrpt(scale_factor,"Scale Factor at C. Meridian:     ");
-cenlonmer(lon_center);
+radius2(st->r_major, st->r_minor);
+genrpt(st->scale_factor,"Scale Factor at C. Meridian:     ");
+cenlonmer(st->lon_center);
 return(OK);
 }
 
@@ -100,7 +91,8 @@ return(OK);
    Note:  The algorithm for UTM is exactly the same as TM and therefore
 	  if a change is implemented, also make the change to TMINV.c
   -----------------------------------------------------------------------*/
-long utminv(x, y, lon, lat)
+long utminv_r(st, x, y, lon, lat)
+struct utm_state *st;	/* (I) Projection state				*/
 double x;		/* (I) X projection coordinate 			*/
 double y;		/* (I) Y projection coordinate 			*/
 double *lon;		/* (O) Longitude 				*/
@@ -118,11 +110,11 @@ double asinz();
 
 /* fortran code for spherical form 
 --------------------------------*/
-if (ind != 0)
+if (st->ind != 0)
    {
-   f = exp(x/(r_major * scale_factor));
+   f = exp(x/(st->r_major * st->scale_factor));
    g = .5 * (f - 1/f);
-   temp = lat_origin + y/(r_major * scale_factor);
+   temp = st->lat_origin + y/(st->r_major * st->scale_factor);
    h = cos(temp);
    con = sqrt((1.0 - h * h)/(1.0 + g * g));
    *lat = asinz(con);
@@ -130,27 +122,28 @@ if (ind != 0)
      *lat = -*lat;
    if ((g == 0) && (h == 0))
      {
-     *lon = lon_center;
+     *lon = st->lon_center;
      return(OK);
      }
    else
      {
-     *lon = adjust_lon(atan2(g,h) + lon_center);
+     *lon = adjust_lon(atan2(g,h) + st->lon_center);
      return(OK);
      }
    }
 
 /* Inverse equations
   -----------------*/
-x = x - false_easting;
-y = y - false_northing;
+x = x - st->false_easting;
+y = y - st->false_northing;
 
-con = (ml0 + y / scale_factor) / r_major;
+con = (st->ml0 + y / st->scale_factor) / st->r_major;
 phi = con;
 for (i=0;;i++)
    {
-   delta_phi=((con + e1 * sin(2.0*phi) - e2 * sin(4.0*phi) + e3 * sin(6.0*phi))
-               / e0) - phi;
+   delta_phi=((con + st->e1 * sin(2.0*phi) - st->e2 * sin(4.0*phi) +
+               st->e3 * sin(6.0*phi))
+               / st->e0) - phi;
 /*
    delta_phi = ((con + e1 * sin(2.0*phi) - e2 * sin(4.0*phi)) / e0) - phi;
 */
@@ -166,26 +159,46 @@ if (fabs(phi) < HALF_PI)
    {
    sincos(phi, &sin_phi, &cos_phi);
    tan_phi = tan(phi);
-   c    = esp * SQUARE(cos_phi);
+   c    = st->esp * SQUARE(cos_phi);
    cs   = SQUARE(c);
    t    = SQUARE(tan_phi);
    ts   = SQUARE(t);
-   con  = 1.0 - es * SQUARE(sin_phi); 
-   n    = r_major / sqrt(con);
-   r    = n * (1.0 - es) / con;
-   d    = x / (n * scale_factor);
+   con  = 1.0 - st->es * SQUARE(sin_phi); 
+   n    = st->r_major / sqrt(con);
+   r    = n * (1.0 - st->es) / con;
+   d    = x / (n * st->scale_factor);
    ds   = SQUARE(d);
    *lat = phi - (n * tan_phi * ds / r) * (0.5 - ds / 24.0 * (5.0 + 3.0 * t + 
-          10.0 * c - 4.0 * cs - 9.0 * esp - ds / 30.0 * (61.0 + 90.0 * t +
-          298.0 * c + 45.0 * ts - 252.0 * esp - 3.0 * cs)));
-   *lon = adjust_lon(lon_center + (d * (1.0 - ds / 6.0 * (1.0 + 2.0 * t +
-          c - ds / 20.0 * (5.0 - 2.0 * c + 28.0 * t - 3.0 * cs + 8.0 * esp +
+          10.0 * c - 4.0 * cs - 9.0 * st->esp - ds / 30.0 * (61.0 + 90.0 * t +
+          298.0 * c + 45.0 * ts - 252.0 * st->esp - 3.0 * cs)));
+   *lon = adjust_lon(st->lon_center + (d * (1.0 - ds / 6.0 * (1.0 + 2.0 * t +
+          c - ds / 20.0 * (5.0 - 2.0 * c + 28.0 * t - 3.0 * cs + 8.0 * st->esp +
           24.0 * ts))) / cos_phi));
    }
 else
    {
    *lat = HALF_PI * sign2(y);
-   *lon = lon_center;
+   *lon = st->lon_center;
    }
 return(OK);
 }
+
+/* Legacy entry points on the file state
+  -------------------------------------*/
+long utminvint(r_maj,r_min,scale_fact,zone)
+double r_maj;
+double r_min;
+double scale_fact;
+long zone;
+{
+return(utminvint_r(&utminv_state,r_maj,r_min,scale_fact,zone));
+}
+
+long utminv(x, y, lon, lat)
+double x;
+double y;
+double *lon;
+double *lat;
+{
+return(utminv_r(&utminv_state,x,y,lon,lat));
+}
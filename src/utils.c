@@ -6,9 +6,17 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
+#include <pthread.h>
 #include "utils.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VX_SWAP_X86 1
+#include <immintrin.h>
+#endif
+
 
 /* Determine system endian */
 int vx_system_endian()
@@ -22,6 +30,150 @@ int vx_system_endian()
 }
 
 
+/* Swap 4-byte cells one at a time */
+static void vx_swap4_scalar(char *buf, size_t ncells)
+{
+  size_t i;
+  uint32_t v;
+
+  for (i = 0; i < ncells; i++) {
+    memcpy(&v, &buf[i*4], 4);
+#if defined(__GNUC__)
+    v = __builtin_bswap32(v);
+#else
+    v = ((v >> 24) & 0xff) | ((v >> 8) & 0xff00) | 
+      ((v << 8) & 0xff0000) | (v << 24);
+#endif
+    memcpy(&buf[i*4], &v, 4);
+  }
+}
+
+
+#ifdef VX_SWAP_X86
+/* Swap 4 cells per shuffle, 16 per iteration */
+__attribute__((target("ssse3")))
+static void vx_swap4_ssse3(char *buf, size_t ncells)
+{
+  size_t i;
+  __m128i a, b, c, d;
+  const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+				    4, 5, 6, 7, 0, 1, 2, 3);
+
+  for (i = 0; i + 16 <= ncells; i += 16) {
+    a = _mm_loadu_si128((__m128i *)&buf[i*4]);
+    b = _mm_loadu_si128((__m128i *)&buf[i*4+16]);
+    c = _mm_loadu_si128((__m128i *)&buf[i*4+32]);
+    d = _mm_loadu_si128((__m128i *)&buf[i*4+48]);
+    _mm_storeu_si128((__m128i *)&buf[i*4], _mm_shuffle_epi8(a, mask));
+    _mm_storeu_si128((__m128i *)&buf[i*4+16], _mm_shuffle_epi8(b, mask));
+    _mm_storeu_si128((__m128i *)&buf[i*4+32], _mm_shuffle_epi8(c, mask));
+    _mm_storeu_si128((__m128i *)&buf[i*4+48], _mm_shuffle_epi8(d, mask));
+  }
+  vx_swap4_scalar(&buf[i*4], ncells - i);
+}
+
+
+/* Swap 8 cells per shuffle, 32 per iteration */
+__attribute__((target("avx2")))
+static void vx_swap4_avx2(char *buf, size_t ncells)
+{
+  size_t i;
+  __m256i a, b, c, d;
+  const __m256i mask = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+				       4, 5, 6, 7, 0, 1, 2, 3,
+				       12, 13, 14, 15, 8, 9, 10, 11,
+				       4, 5, 6, 7, 0, 1, 2, 3);
+
+  for (i = 0; i + 32 <= ncells; i += 32) {
+    a = _mm256_loadu_si256((__m256i *)&buf[i*4]);
+    b = _mm256_loadu_si256((__m256i *)&buf[i*4+32]);
+    c = _mm256_loadu_si256((__m256i *)&buf[i*4+64]);
+    d = _mm256_loadu_si256((__m256i *)&buf[i*4+96]);
+    _mm256_storeu_si256((__m256i *)&buf[i*4], _mm256_shuffle_epi8(a, mask));
+    _mm256_storeu_si256((__m256i *)&buf[i*4+32], 
+			_mm256_shuffle_epi8(b, mask));
+    _mm256_storeu_si256((__m256i *)&buf[i*4+64], 
+			_mm256_shuffle_epi8(c, mask));
+    _mm256_storeu_si256((__m256i *)&buf[i*4+96], 
+			_mm256_shuffle_epi8(d, mask));
+  }
+  vx_swap4_scalar(&buf[i*4], ncells - i);
+}
+#endif
+
+
+/* Best byte swap kernel supported by this cpu */
+vx_swap_kernel_t vx_swap4_select()
+{
+#ifdef VX_SWAP_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return VX_SWAP_AVX2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return VX_SWAP_SSSE3;
+  }
+#endif
+  return VX_SWAP_SCALAR;
+}
+
+
+/* Kernel name for reporting */
+const char *vx_swap4_name(vx_swap_kernel_t kernel)
+{
+  switch (kernel) {
+  case VX_SWAP_SCALAR:
+    return "scalar";
+  case VX_SWAP_SSSE3:
+    return "ssse3";
+  case VX_SWAP_AVX2:
+    return "avx2";
+  default:
+    return "auto";
+  }
+}
+
+
+/* Best kernel of this cpu, found once for every thread */
+static vx_swap_kernel_t vx_swap_best = VX_SWAP_SCALAR;
+static pthread_once_t vx_swap_once = PTHREAD_ONCE_INIT;
+
+static void vx_swap4_init()
+{
+  vx_swap_best = vx_swap4_select();
+}
+
+
+/* Swap the byte order of ncells contiguous 4-byte cells in place.
+   VX_SWAP_AUTO picks the best kernel for this cpu. Returns 1 if the
+   requested kernel is not available */
+int vx_swap4(char *buf, size_t ncells, vx_swap_kernel_t kernel)
+{
+  pthread_once(&vx_swap_once, vx_swap4_init);
+  if (kernel == VX_SWAP_AUTO) {
+    kernel = vx_swap_best;
+  }
+  if (kernel > vx_swap_best) {
+    return(1);
+  }
+
+  switch (kernel) {
+#ifdef VX_SWAP_X86
+  case VX_SWAP_AVX2:
+    vx_swap4_avx2(buf, ncells);
+    break;
+  case VX_SWAP_SSSE3:
+    vx_swap4_ssse3(buf, ncells);
+    break;
+#endif
+  default:
+    vx_swap4_scalar(buf, ncells);
+    break;
+  }
+  return(0);
+}
+
+
 /*
  * vx_minf
  *
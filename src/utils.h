@@ -1,14 +1,32 @@
 #ifndef VX_UTILS_H
 #define VX_UTILS_H
 
+#include <stddef.h>
+
 /* Byte order */
 typedef enum { VX_BYTEORDER_LSB = 0, 
                VX_BYTEORDER_MSB } vx_byteorder_t;
 
 
+/* Byte swap kernels, ordered by preference */
+typedef enum { VX_SWAP_AUTO = 0,
+               VX_SWAP_SCALAR,
+               VX_SWAP_SSSE3,
+               VX_SWAP_AVX2 } vx_swap_kernel_t;
+
+
 /* Determine system endian */
 int vx_system_endian();
 
+/* Best byte swap kernel supported by this cpu */
+vx_swap_kernel_t vx_swap4_select();
+
+/* Byte swap kernel name */
+const char *vx_swap4_name(vx_swap_kernel_t kernel);
+
+/* Swap byte order of contiguous 4-byte cells in place */
+int vx_swap4(char *buf, size_t ncells, vx_swap_kernel_t kernel);
+
 /* Minimum of two values */
 float vx_minf(float v1, float v2);
 
@@ -0,0 +1,345 @@
+/** vx_brick.c - Brick (3D tile) handling of voxet volumes
+
+    Bricked volumes store each bdim^3 block of cells contiguously, so
+    the cells around a point, and a run of cells down a column, share
+    a few cache lines instead of being nx*ny cells apart. Index them
+    with vx_brick_index.
+
+    Lazy volumes keep the property file open and read the bdim^3
+    brick around a cell with pread the first time one of its cells
+    is asked for. Bricks live in a bounded cache with CLOCK eviction.
+**/
+
+#define _DEFAULT_SOURCE  /* Required for pread */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "params.h"
+#include "vx_io.h"
+#include "vx_brick.h"
+#include "utils.h"
+
+/* Lazy volume state */
+struct vx_lazy_t {
+  int fd;
+  int ESIZE;
+  off_t offset;           /* start of cell data in the file */
+  int swap;               /* cells need a byte swap */
+  vx_brick_layout_t bl;
+  int maxbricks;
+  int nresident;
+  int hand;               /* CLOCK hand */
+  int *slot_of;           /* slot+1 of every brick, 0 if not resident */
+  size_t *brick_of;       /* brick held by every slot */
+  unsigned char *ref;     /* CLOCK reference bits */
+  char *data;             /* maxbricks bricks of bcells cells */
+  vx_lazy_stats_t stats;
+  pthread_mutex_t lock;
+};
+
+
+/* Set up the brick geometry for a voxet */
+int vx_brick_setup(vx_brick_layout_t *bl, const int *dims, int bdim)
+{
+  int i;
+
+  if (bdim <= 0) {
+    bdim = VX_BRICK_DIM;
+  }
+  if ((bdim & (bdim - 1)) != 0) {
+    return(1);
+  }
+
+  bl->bdim = bdim;
+  for (bl->bshift = 0; (1 << bl->bshift) < bdim; bl->bshift++);
+  for (i = 0; i < 3; i++) {
+    if (dims[i] <= 0) {
+      return(1);
+    }
+    bl->dims[i] = dims[i];
+    bl->nb[i] = (dims[i] + bdim - 1) >> bl->bshift;
+  }
+  bl->bcells = bdim * bdim * bdim;
+  return(0);
+}
+
+
+/* Copy a linear (i-fastest) volume into brick order. The copy is
+   padded to whole bricks and is freed by the caller */
+char *vx_brick_relayout(const char *buffer, int ESIZE,
+			const vx_brick_layout_t *bl)
+{
+  char *bricked;
+  const char *row;
+  size_t nbricks, rowlen;
+  int i, j, k;
+
+  nbricks = (size_t)bl->nb[0] * bl->nb[1] * bl->nb[2];
+  bricked = calloc(nbricks * bl->bcells, ESIZE);
+  if (bricked == NULL) {
+    return(NULL);
+  }
+
+  /* Rows inside a brick stay contiguous, copy them in slices */
+  for (k = 0; k < bl->dims[2]; k++) {
+    for (j = 0; j < bl->dims[1]; j++) {
+      row = &buffer[((size_t)k * bl->dims[1] + j) * bl->dims[0] * ESIZE];
+      for (i = 0; i < bl->dims[0]; i += bl->bdim) {
+	rowlen = (i + bl->bdim <= bl->dims[0]) ? bl->bdim : bl->dims[0] - i;
+	memcpy(&bricked[vx_brick_index(bl, i, j, k) * ESIZE],
+	       &row[(size_t)i * ESIZE], rowlen * ESIZE);
+      }
+    }
+  }
+
+  return(bricked);
+}
+
+
+/* Open a property volume for lazy brick paging. A valid native cache
+   file is used in place of the big endian original. maxbricks <= 0
+   selects VX_LAZY_MAXBRICKS */
+vx_lazy_t *vx_lazy_open(const char *data_dir, const char *FN, int ESIZE,
+			const int *dims, int bdim, int maxbricks)
+{
+  vx_lazy_t *lv;
+  size_t nbricks;
+  int ncells;
+  char file_path[CMLEN];
+
+  lv = calloc(1, sizeof(vx_lazy_t));
+  if (lv == NULL) {
+    return(NULL);
+  }
+  lv->fd = -1;
+  pthread_mutex_init(&lv->lock, NULL);
+  if (vx_brick_setup(&lv->bl, dims, bdim) != 0) {
+    vx_lazy_close(lv);
+    return(NULL);
+  }
+  ncells = dims[0] * dims[1] * dims[2];
+  nbricks = (size_t)lv->bl.nb[0] * lv->bl.nb[1] * lv->bl.nb[2];
+  lv->ESIZE = ESIZE;
+  lv->maxbricks = (maxbricks > 0) ? maxbricks : VX_LAZY_MAXBRICKS;
+  if ((size_t)lv->maxbricks > nbricks) {
+    lv->maxbricks = (int)nbricks;
+  }
+
+  if (vx_io_checknative(data_dir, FN, ESIZE, ncells, NULL) == 0) {
+    sprintf(file_path, "%s/%s%s", data_dir, FN, VX_IO_NATIVE_SUFFIX);
+    lv->offset = VX_IO_NATIVE_HDRLEN;
+    lv->swap = 0;
+  } else {
+    /* Voxet files are big endian */
+    sprintf(file_path, "%s/%s", data_dir, FN);
+    lv->offset = 0;
+    lv->swap = (vx_system_endian() == VX_BYTEORDER_LSB);
+  }
+  lv->fd = open(file_path, O_RDONLY);
+  if (lv->fd < 0) {
+    vx_lazy_close(lv);
+    return(NULL);
+  }
+
+  lv->slot_of = calloc(nbricks, sizeof(int));
+  lv->brick_of = malloc(lv->maxbricks * sizeof(size_t));
+  lv->ref = calloc(lv->maxbricks, 1);
+  lv->data = malloc((size_t)lv->maxbricks * lv->bl.bcells * ESIZE);
+  if ((lv->slot_of == NULL) || (lv->brick_of == NULL) ||
+      (lv->ref == NULL) || (lv->data == NULL)) {
+    fprintf(stderr, "Failed to allocate brick cache for %s\n", FN);
+    vx_lazy_close(lv);
+    return(NULL);
+  }
+
+  return(lv);
+}
+
+
+/* Read one brick from disk, row by row */
+static int vx_lazy_readbrick(vx_lazy_t *lv, int i0, int j0, int k0,
+			     char *brick)
+{
+  vx_brick_layout_t *bl = &lv->bl;
+  int i1, j1, k1, j, k;
+  size_t rowlen;
+  off_t pos;
+
+  i1 = (i0 + bl->bdim < bl->dims[0]) ? i0 + bl->bdim : bl->dims[0];
+  j1 = (j0 + bl->bdim < bl->dims[1]) ? j0 + bl->bdim : bl->dims[1];
+  k1 = (k0 + bl->bdim < bl->dims[2]) ? k0 + bl->bdim : bl->dims[2];
+  rowlen = (size_t)(i1 - i0) * lv->ESIZE;
+
+  /* Edge bricks are only partly covered */
+  if ((i1 - i0 < bl->bdim) || (j1 - j0 < bl->bdim) ||
+      (k1 - k0 < bl->bdim)) {
+    memset(brick, 0, (size_t)bl->bcells * lv->ESIZE);
+  }
+
+  for (k = k0; k < k1; k++) {
+    for (j = j0; j < j1; j++) {
+      pos = lv->offset + (((off_t)k * bl->dims[1] + j) * bl->dims[0] + i0) *
+	lv->ESIZE;
+      if (pread(lv->fd, &brick[vx_brick_offset(bl, 0, j, k) * lv->ESIZE],
+		rowlen, pos) != (ssize_t)rowlen) {
+	return(1);
+      }
+    }
+  }
+
+  if (lv->swap && (lv->ESIZE == 4)) {
+    vx_swap4(brick, bl->bcells, VX_SWAP_AUTO);
+  }
+  return(0);
+}
+
+
+/* Slot holding brick b, whose first cell is i0,j0,k0, reading it on
+   first use. Called with the lock held, returns -1 on a read error */
+static int vx_lazy_slot(vx_lazy_t *lv, size_t b, int i0, int j0, int k0)
+{
+  vx_brick_layout_t *bl = &lv->bl;
+  int slot;
+
+  slot = lv->slot_of[b] - 1;
+  if (slot >= 0) {
+    lv->stats.hits++;
+    lv->ref[slot] = 1;
+    return(slot);
+  }
+  lv->stats.misses++;
+  if (lv->nresident < lv->maxbricks) {
+    slot = lv->nresident++;
+  } else {
+    /* CLOCK, skip recently used bricks once */
+    while (lv->ref[lv->hand]) {
+      lv->ref[lv->hand] = 0;
+      lv->hand = (lv->hand + 1) % lv->maxbricks;
+    }
+    slot = lv->hand;
+    lv->hand = (lv->hand + 1) % lv->maxbricks;
+    if (lv->slot_of[lv->brick_of[slot]] == slot + 1) {
+      lv->slot_of[lv->brick_of[slot]] = 0;
+    }
+    lv->stats.evictions++;
+  }
+  lv->brick_of[slot] = b;
+  if (vx_lazy_readbrick(lv, i0, j0, k0,
+			&lv->data[(size_t)slot * bl->bcells * lv->ESIZE])
+      != 0) {
+    /* Slot stays unreferenced, first in line for eviction */
+    lv->ref[slot] = 0;
+    return(-1);
+  }
+  lv->slot_of[b] = slot + 1;
+  lv->ref[slot] = 1;
+  return(slot);
+}
+
+
+/* Copy cell i,j,k of a lazy volume into cell, reading its brick on
+   first use. Returns 1 outside the volume or on a read error */
+int vx_lazy_get(vx_lazy_t *lv, int i, int j, int k, void *cell)
+{
+  vx_brick_layout_t *bl = &lv->bl;
+  int slot, m;
+
+  if ((i < 0) || (j < 0) || (k < 0) || (i >= bl->dims[0]) ||
+      (j >= bl->dims[1]) || (k >= bl->dims[2])) {
+    return(1);
+  }
+
+  m = ~(bl->bdim - 1);
+  pthread_mutex_lock(&lv->lock);
+  slot = vx_lazy_slot(lv, vx_brick_number(bl, i, j, k), i & m, j & m, k & m);
+  if (slot < 0) {
+    pthread_mutex_unlock(&lv->lock);
+    return(1);
+  }
+  memcpy(cell, &lv->data[((size_t)slot * bl->bcells +
+			  vx_brick_offset(bl, i, j, k)) * lv->ESIZE],
+	 lv->ESIZE);
+  pthread_mutex_unlock(&lv->lock);
+
+  return(0);
+}
+
+
+/* Fetch n cells of a lazy volume of floats into out by their
+   vx_brick_index, reading bricks on first use. Cells at index -1,
+   and cells of bricks that fail to read, get fill. One lock covers
+   the whole batch. Returns the number of cells that failed to read */
+int vx_lazy_gather(vx_lazy_t *lv, const int *idx, double *out, int n,
+		   float fill)
+{
+  vx_brick_layout_t *bl = &lv->bl;
+  const float *data = (const float *)lv->data;
+  size_t b, prev = (size_t)-1;
+  int p, bs, slot = -1;
+  int failed = 0;
+
+  bs = 3 * bl->bshift;
+  pthread_mutex_lock(&lv->lock);
+  for (p = 0; p < n; p++) {
+    if (idx[p] < 0) {
+      out[p] = fill;
+      continue;
+    }
+    /* Runs of points in one brick look it up once */
+    b = (size_t)idx[p] >> bs;
+    if (b != prev) {
+      slot = vx_lazy_slot(lv, b, (int)(b % bl->nb[0]) << bl->bshift,
+			  (int)((b / bl->nb[0]) % bl->nb[1]) << bl->bshift,
+			  (int)(b / ((size_t)bl->nb[0] * bl->nb[1]))
+			  << bl->bshift);
+      prev = b;
+    }
+    if (slot < 0) {
+      out[p] = fill;
+      failed++;
+      continue;
+    }
+    out[p] = data[(size_t)slot * bl->bcells + (idx[p] & (bl->bcells - 1))];
+  }
+  pthread_mutex_unlock(&lv->lock);
+
+  return(failed);
+}
+
+
+/* Brick geometry of a lazy volume */
+const vx_brick_layout_t *vx_lazy_layout(const vx_lazy_t *lv)
+{
+  return(&lv->bl);
+}
+
+
+/* Brick cache counters of a lazy volume */
+void vx_lazy_stats(vx_lazy_t *lv, vx_lazy_stats_t *stats)
+{
+  pthread_mutex_lock(&lv->lock);
+  memcpy(stats, &lv->stats, sizeof(vx_lazy_stats_t));
+  stats->resident = lv->nresident;
+  pthread_mutex_unlock(&lv->lock);
+}
+
+
+/* Close a lazy volume and free its bricks */
+void vx_lazy_close(vx_lazy_t *lv)
+{
+  if (lv == NULL) {
+    return;
+  }
+  if (lv->fd >= 0) {
+    close(lv->fd);
+  }
+  pthread_mutex_destroy(&lv->lock);
+  free(lv->slot_of);
+  free(lv->brick_of);
+  free(lv->ref);
+  free(lv->data);
+  free(lv);
+}
@@ -0,0 +1,97 @@
+#ifndef VX_BRICK_H
+#define VX_BRICK_H
+
+#include <stddef.h>
+
+/* Default brick edge length in cells */
+#define VX_BRICK_DIM 8
+
+/* Default number of bricks kept by a lazy volume */
+#define VX_LAZY_MAXBRICKS 4096
+
+
+/* Brick geometry of a voxet, bricks are bdim^3 cells with the
+   cells i-fastest inside each brick */
+typedef struct vx_brick_layout_t {
+  int dims[3];     /* voxet cells per axis */
+  int bdim;        /* brick edge, a power of two */
+  int bshift;      /* log2(bdim) */
+  int nb[3];       /* bricks per axis */
+  int bcells;      /* cells per brick */
+} vx_brick_layout_t;
+
+
+/* Brick hit/miss counters of a lazy volume */
+typedef struct vx_lazy_stats_t {
+  long hits;
+  long misses;
+  long evictions;
+  int resident;
+} vx_lazy_stats_t;
+
+
+/* Lazily paged voxet volume */
+typedef struct vx_lazy_t vx_lazy_t;
+
+
+/* Brick number holding cell i,j,k */
+static inline size_t vx_brick_number(const vx_brick_layout_t *bl,
+				     int i, int j, int k)
+{
+  return(((size_t)(k >> bl->bshift) * bl->nb[1] + (j >> bl->bshift)) *
+	 bl->nb[0] + (i >> bl->bshift));
+}
+
+
+/* Cell offset of i,j,k inside its brick */
+static inline int vx_brick_offset(const vx_brick_layout_t *bl,
+				  int i, int j, int k)
+{
+  int m = bl->bdim - 1;
+
+  return((((k & m) << bl->bshift) + (j & m)) << bl->bshift) + (i & m);
+}
+
+
+/* Cell index of i,j,k in a volume stored in brick order */
+static inline size_t vx_brick_index(const vx_brick_layout_t *bl,
+				    int i, int j, int k)
+{
+  return(vx_brick_number(bl, i, j, k) * bl->bcells +
+	 vx_brick_offset(bl, i, j, k));
+}
+
+
+/* Set up the brick geometry for a voxet */
+int vx_brick_setup(vx_brick_layout_t *, const int *, int);
+
+
+/* Copy a linear (i-fastest) volume into brick order */
+char *vx_brick_relayout(const char *, int, const vx_brick_layout_t *);
+
+
+/* Open a property volume for lazy brick paging */
+vx_lazy_t *vx_lazy_open(const char *, const char *, int, const int *,
+			int, int);
+
+
+/* Copy cell i,j,k of a lazy volume, reading its brick on first use */
+int vx_lazy_get(vx_lazy_t *, int, int, int, void *);
+
+
+/* Fetch float cells of a lazy volume by brick order index */
+int vx_lazy_gather(vx_lazy_t *, const int *, double *, int, float);
+
+
+/* Brick geometry of a lazy volume */
+const vx_brick_layout_t *vx_lazy_layout(const vx_lazy_t *);
+
+
+/* Brick cache counters of a lazy volume */
+void vx_lazy_stats(vx_lazy_t *, vx_lazy_stats_t *);
+
+
+/* Close a lazy volume and free its bricks */
+void vx_lazy_close(vx_lazy_t *);
+
+#endif
@@ -3,9 +3,15 @@
 07/2011: PES: Extracted io into separate module from vx_sub.c
 **/
 
+#define _DEFAULT_SOURCE  /* Required for mmap */
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "params.h"
 #include "voxet.h"
 #include "vx_io.h"
@@ -14,9 +20,43 @@
 /* Max number of properties */
 #define VX_MAX_PROP 512
 
- /* Property state */
-char vx_props[VX_MAX_PROP][CMLEN];
-int vx_num_prop = 0;
+/* Header index, keyed on keyword and property number */
+#define VX_IO_HASH 2048
+#define VX_IO_KEYLEN 64
+
+/* Property number of the property name entries */
+#define VX_IO_NAMEKEY -1
+
+typedef struct vx_io_entry_t {
+  char key[VX_IO_KEYLEN];
+  int pnum;
+  char *val;
+} vx_io_entry_t;
+
+/* Parsed voxet header, one per .vo file */
+struct vx_io_header_t {
+  char props[VX_MAX_PROP][CMLEN];
+  int num_prop;
+  vx_io_entry_t entries[2*VX_MAX_PROP];
+  int num_entry;
+  int hash[VX_IO_HASH];
+};
+
+/* Header behind the single-file vx_io_init interface */
+static vx_io_header_t *vx_default = NULL;
+
+/* Max number of mapped volumes */
+#define VX_MAX_MAP 64
+
+/* Mapped volume state */
+typedef struct vx_io_map_t {
+  char *base;
+  size_t len;
+  char *buffer;
+} vx_io_map_t;
+
+static vx_io_map_t vx_maps[VX_MAX_MAP];
+static pthread_mutex_t vx_maps_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 /* Gets a line without knowing where it writes the info, so
@@ -38,164 +78,372 @@ int vx_io_getline(FILE *input, char *p, int len) {
 }
 
 
-/* Initialize voxel prop reader */
-int vx_io_init(char *fn)
+/* FNV-1a hash of a header key and property number */
+static unsigned int vx_io_hash(const char *key, int pnum)
 {
-  FILE *ip;
-  char buf[CMLEN];
+  unsigned int h = 2166136261u;
 
-  if (vx_num_prop > 0) {
-    return(1);
+  while (*key != '\0') {
+    h ^= (unsigned char)*key++;
+    h *= 16777619u;
   }
+  h ^= (unsigned int)pnum;
+  h *= 16777619u;
+  return(h);
+}
+
+
+/* Add a header entry, the first occurrence of a key wins */
+static void vx_io_addentry(vx_io_header_t *hdr, const char *key, 
+			   int pnum, char *val)
+{
+  unsigned int h;
+  vx_io_entry_t *e;
+
+  h = vx_io_hash(key, pnum) & (VX_IO_HASH - 1);
+  while (hdr->hash[h] != 0) {
+    e = &hdr->entries[hdr->hash[h] - 1];
+    if ((e->pnum == pnum) && (strcmp(e->key, key) == 0)) {
+      return;
+    }
+    h = (h + 1) & (VX_IO_HASH - 1);
+  }
+
+  e = &hdr->entries[hdr->num_entry];
+  strcpy(e->key, key);
+  e->pnum = pnum;
+  e->val = val;
+  hdr->hash[h] = ++hdr->num_entry;
+}
+
+
+/* Tokenize a header line into its key, the property number for the
+   PROP* keywords, and the remaining value text. PROPERTY lines are 
+   also indexed by property name */
+static void vx_io_parseline(vx_io_header_t *hdr, char *line)
+{
+  char key[VX_IO_KEYLEN];
+  char name[VX_IO_KEYLEN];
+  int off, noff, pnum;
+  char *val;
+
+  if ((sscanf(line, "%63s%n", key, &off) != 1) || (key[0] == '#')) {
+    return;
+  }
+  val = line + off;
+  pnum = 0;
+  if ((strncmp(key, "PROP", 4) == 0) && 
+      (sscanf(val, "%d%n", &pnum, &noff) == 1)) {
+    if ((strcmp(key, "PROPERTY") == 0) && 
+	(sscanf(val + noff, "%63s", name) == 1)) {
+      vx_io_addentry(hdr, name, VX_IO_NAMEKEY, val);
+    }
+    val += noff;
+  }
+  while ((*val == ' ') || (*val == '\t')) {
+    val++;
+  }
+  vx_io_addentry(hdr, key, pnum, val);
+}
+
+
+/* Find the header entry for a search key, ignoring surrounding blanks */
+static vx_io_entry_t *vx_io_lookup(vx_io_header_t *hdr, 
+				   const char *search, int pnum)
+{
+  char key[VX_IO_KEYLEN];
+  unsigned int h;
+  vx_io_entry_t *e;
+
+  if ((hdr == NULL) || (sscanf(search, "%63s", key) != 1)) {
+    return(NULL);
+  }
+  h = vx_io_hash(key, pnum) & (VX_IO_HASH - 1);
+  while (hdr->hash[h] != 0) {
+    e = &hdr->entries[hdr->hash[h] - 1];
+    if ((e->pnum == pnum) && (strcmp(e->key, key) == 0)) {
+      return(e);
+    }
+    h = (h + 1) & (VX_IO_HASH - 1);
+  }
+  return(NULL);
+}
+
+
+/* Parse a voxet header into a new header object. Headers share no 
+   state, so several files can be parsed at once on separate threads */
+vx_io_header_t *vx_io_open(const char *fn)
+{
+  FILE *ip;
+  vx_io_header_t *hdr;
+  int i;
 
   ip = fopen(fn, "r");
   if (ip == NULL) {
-    return(1);
+    return(NULL);
+  }
+  hdr = malloc(sizeof(vx_io_header_t));
+  if (hdr == NULL) {
+    fclose(ip);
+    return(NULL);
   }
+  hdr->num_prop = 0;
+  hdr->num_entry = 0;
+  memset(hdr->hash, 0, sizeof(hdr->hash));
   
-  while (vx_io_getline(ip, &buf[0], CMLEN) == 0) {
-    strcpy(vx_props[vx_num_prop++], buf); 
-    if (vx_num_prop >= VX_MAX_PROP) {
+  while (vx_io_getline(ip, hdr->props[hdr->num_prop], CMLEN) == 0) {
+    if (++hdr->num_prop >= VX_MAX_PROP) {
       fclose(ip);
-      return(1);
+      free(hdr);
+      return(NULL);
     }
   }
-
   fclose(ip);
-  return(0);
+
+  /* Index the header once, lookups are then O(1) */
+  for (i = 0; i < hdr->num_prop; i++) {
+    vx_io_parseline(hdr, hdr->props[i]);
+  }
+
+  return(hdr);
 }
 
 
-/* Finalize vozel prop reader */
-int vx_io_finalize()
+/* Free a header object */
+void vx_io_close(vx_io_header_t *hdr)
 {
-  vx_num_prop = 0;
-  return(0);
+  free(hdr);
 }
 
+
 //PROPERTY 1 vp63_basin
-int vx_io_getpropkey(char *search) {
-  int i=0;
-  const char *pstr="PROPERTY ";
-  int slen=strlen(pstr);
+int vx_io_header_getpropkey(vx_io_header_t *hdr, const char *search) {
+  int i;
   int pkey=0;
+  char name[VX_IO_KEYLEN];
+  vx_io_entry_t *e;
 
-  while (i < vx_num_prop) {
-    if (strstr(vx_props[i], pstr)) {
-      if(strstr(&vx_props[i][slen], search) &&
-            sscanf(&vx_props[i][slen],"%d", &pkey) ) {
-        return pkey;
-      }
+  e = vx_io_lookup(hdr, search, VX_IO_NAMEKEY);
+  if ((e != NULL) && (sscanf(e->val, "%d", &pkey) == 1)) {
+    return pkey;
+  }
+  if (hdr == NULL) {
+    return(0);
+  }
+
+  /* Partial names still match, but only against the name itself */
+  for (i = 0; i < hdr->num_prop; i++) {
+    if ((sscanf(hdr->props[i], "PROPERTY %d %63s", &pkey, name) == 2) &&
+	strstr(name, search)) {
+      return pkey;
     }
-    i++;
   }
   return(0);
 }
 
-/* Get vector from voxel property file */
-int vx_io_getvec(char *search, float *vec)
+
+/* Get vector from a header object */
+int vx_io_header_getvec(vx_io_header_t *hdr, const char *search, 
+			float *vec)
 {
-  int i;
-  int slen=strlen(search);
-
-  i = 0;
-  while (i < vx_num_prop) {
-    if (strstr(vx_props[i], search) && 
-          (slen+1) < strlen(vx_props[i]) && 
-             vx_props[i][slen]==' ') {
-      sscanf(&vx_props[i][0]+strlen(search)+1,"%f %f %f",
-	     &vec[0], &vec[1], &vec[2]);
-      return(0);
-    }
-    i++;
+  vx_io_entry_t *e = vx_io_lookup(hdr, search, 0);
+
+  if (e == NULL) {
+    return(1);
   }
+  sscanf(e->val, "%f %f %f", &vec[0], &vec[1], &vec[2]);
+  return(0);
+}
 
-  return(1);
+
+/* Get model dimensions from a header object */
+int vx_io_header_getdim(vx_io_header_t *hdr, const char *search, int *vec)
+{
+  vx_io_entry_t *e = vx_io_lookup(hdr, search, 0);
+
+  if (e == NULL) {
+    return(1);
+  }
+  sscanf(e->val, "%d %d %d", &vec[0], &vec[1], &vec[2]);
+  return(0);
 }
 
 
+/* Get property name from a header object */
+int vx_io_header_getpropname(vx_io_header_t *hdr, const char *search, 
+			     int PNumber, char *name)
+{
+  vx_io_entry_t *e = vx_io_lookup(hdr, search, PNumber);
 
-/* Get model dimensions from voxel property file */
-int vx_io_getdim(char *search, int *vec)
+  if ((e == NULL) || (sscanf(e->val, "%s", name) != 1)) {
+    return(1);
+  }
+  return(0);
+}
+
+
+/* Get property size from a header object */
+int vx_io_header_getpropsize(vx_io_header_t *hdr, const char *search, 
+			     int PNumber, int *size)
 {
-  int i;
+  vx_io_entry_t *e = vx_io_lookup(hdr, search, PNumber);
 
-  i = 0;
-  while (i < vx_num_prop) {
-    if (strstr(vx_props[i], search)) {
-      sscanf(&vx_props[i][0]+strlen(search),"%d %d %d",
-	     &vec[0], &vec[1], &vec[2]);
-      return(0);
-    }
-    i++;
+  if (e == NULL) {
+    return(1);
   }
+  sscanf(e->val, "%d", size);
+  return(0);
+}
 
-  return(1);
+
+/* Get property value from a header object */
+int vx_io_header_getpropval(vx_io_header_t *hdr, const char *search, 
+			    int PNumber, float *val)
+{
+  vx_io_entry_t *e = vx_io_lookup(hdr, search, PNumber);
+
+  if (e == NULL) {
+    return(1);
+  }
+  sscanf(e->val, "%f", val);
+  return(0);
 }
 
 
-/* Get property name from voxel property file */
-int vx_io_getpropname(char *search, vx_pnumber_t PNumber, char *name)
+/* Initialize voxel prop reader */
+int vx_io_init(char *fn)
 {
-  int i, erg;
+  if (vx_default != NULL) {
+    return(1);
+  }
 
-  i = 0;
-  while (i < vx_num_prop) {
-    if (strstr(vx_props[i], search)) {
-      sscanf(&vx_props[i][0]+strlen(search)+1,"%d" ,&erg);
-      if (erg == PNumber) {
-	sscanf(&vx_props[i][0]+strlen(search)+1, "%d %s",
-	       &erg, name);
-	return(0);
-      }
-    }
-    i++;
+  vx_default = vx_io_open(fn);
+  if (vx_default == NULL) {
+    return(1);
   }
+  return(0);
+}
 
-  return(1);
+
+/* Finalize vozel prop reader */
+int vx_io_finalize()
+{
+  vx_io_close(vx_default);
+  vx_default = NULL;
+  return(0);
+}
+
+//PROPERTY 1 vp63_basin
+int vx_io_getpropkey(char *search) {
+  return vx_io_header_getpropkey(vx_default, search);
+}
+
+/* Get vector from voxel property file */
+int vx_io_getvec(char *search, float *vec)
+{
+  return vx_io_header_getvec(vx_default, search, vec);
+}
+
+
+
+/* Get model dimensions from voxel property file */
+int vx_io_getdim(char *search, int *vec)
+{
+  return vx_io_header_getdim(vx_default, search, vec);
+}
+
+
+/* Get property name from voxel property file */
+int vx_io_getpropname(char *search, vx_pnumber_t PNumber, char *name)
+{
+  return vx_io_header_getpropname(vx_default, search, PNumber, name);
 }
 
 
 /* Get property size from voxel property file */
 int vx_io_getpropsize(char *search, vx_pnumber_t PNumber, int *size)
 {
-  int i, erg;
+  return vx_io_header_getpropsize(vx_default, search, PNumber, size);
+}
 
-  i = 0;
-  while (i < vx_num_prop) {
-    if (strstr(vx_props[i], search)) {
-      sscanf(&vx_props[i][0]+strlen(search)+1,"%d" ,&erg);
-      if (erg == PNumber) {
-	sscanf(&vx_props[i][0]+strlen(search)+1,"%d %d",
-	       &erg,size);
-	return(0);
-      }
-    }
-    i++;
+
+/* Get property value from voxel property file */
+int vx_io_getpropval(char *search, vx_pnumber_t PNumber, float *val)
+{
+  return vx_io_header_getpropval(vx_default, search, PNumber, val);
+}
+
+
+/* Swap 4-byte cells from big endian to host order in place */
+static void vx_io_swapvolume(char *buffer, int ESIZE, int ncells)
+{
+  int j;
+  union zahl l,*h;
+
+  if (ESIZE == 4) {
+    vx_swap4(buffer, ncells, VX_SWAP_AUTO);
+    return;
   }
 
-  return(1);
+  for (j = 0; j < ncells; j++) {
+    h = (union zahl *)&(buffer[j*ESIZE]);
+    l.c[3]=h->c[0];
+    l.c[2]=h->c[1];
+    l.c[1]=h->c[2];
+    l.c[0]=h->c[3];
+    memcpy(&(buffer[j*ESIZE]), &l, sizeof(union zahl));
+  }
 }
 
 
-/* Get property value from voxel property file */
-int vx_io_getpropval(char *search, vx_pnumber_t PNumber, float *val)
+/* Modification time of a file in nanoseconds, a source rewritten
+   within the same second still invalidates its cache */
+static long long vx_io_mtime(const struct stat *st)
 {
-  int i, erg;
+  return((long long)st->st_mtim.tv_sec * 1000000000LL +
+	 (long long)st->st_mtim.tv_nsec);
+}
 
-  i = 0;
-  while (i < vx_num_prop) {
-    if (strstr(vx_props[i], search)) {
-      sscanf(&vx_props[i][0]+strlen(search)+1,"%d" ,&erg);
-      if (erg == PNumber) {
-	sscanf(&vx_props[i][0]+strlen(search)+1,"%d %f" ,&erg,val);
-	return(0);
-      }
-    }
-    i++;
+
+/* FNV-1a checksum of a native volume payload */
+static unsigned int vx_io_checksum(const char *buffer, size_t len)
+{
+  size_t i;
+  unsigned int h = 2166136261u;
+
+  for (i = 0; i < len; i++) {
+    h ^= (unsigned char)buffer[i];
+    h *= 16777619u;
   }
+  return(h);
+}
 
-  return(1);
+
+/* Read a native cache payload. The cache is validated by its header,
+   size and source size and mtime only, the same as vx_io_mapvolume
+   does; vx_io_verifynative checks the payload offline */
+static int vx_io_loadnative(const char *data_dir, const char *FN,
+			    int ESIZE, int ncells, char *buffer)
+{
+  FILE *ifi;
+  char file_path[CMLEN];
+  int retval;
+
+  if (vx_io_checknative(data_dir, FN, ESIZE, ncells, NULL) != 0) {
+    return(1);
+  }
+  sprintf(file_path, "%s/%s%s", data_dir, FN, VX_IO_NATIVE_SUFFIX);
+  ifi = fopen(file_path, "r");
+  if (ifi == NULL) {
+    return(1);
+  }
+  if (fseek(ifi, VX_IO_NATIVE_HDRLEN, SEEK_SET) != 0) {
+    fclose(ifi);
+    return(1);
+  }
+  retval = fread(buffer, ESIZE, ncells, ifi);
+  fclose(ifi);
+  return((retval == ncells) ? 0 : 1);
 }
 
 
@@ -204,10 +452,14 @@ int vx_io_loadvolume(const char *data_dir, const char *FN,
 		     int ESIZE, int ncells, char *buffer)
 { 
   FILE *ifi;
-  int j, retval;
-  union zahl l,*h;
+  int retval;
   char file_path[CMLEN];
 
+  /* Prefer the host order cache, it needs no swap pass */
+  if (vx_io_loadnative(data_dir, FN, ESIZE, ncells, buffer) == 0) {
+    return(0);
+  }
+
   /* Read in the file */
   sprintf(file_path, "%s/%s", data_dir, FN);
   ifi = fopen(file_path, "r");
@@ -225,18 +477,520 @@ int vx_io_loadvolume(const char *data_dir, const char *FN,
 
   /* Voxet files are big endian */
   if (vx_system_endian() == VX_BYTEORDER_LSB) {
-    /* Swap endian */
-    for (j = 0; j < ncells; j++) {
-      h = (union zahl *)&(buffer[j*ESIZE]);
-      l.c[3]=h->c[0];
-      l.c[2]=h->c[1];
-      l.c[1]=h->c[2];
-      l.c[0]=h->c[3];
-      memcpy(&(buffer[j*ESIZE]), &l, sizeof(union zahl));
+    vx_io_swapvolume(buffer, ESIZE, ncells);
+  }
+
+  return 0;
+}
+
+
+/* Track mapping base of len bytes, its cells starting hdrlen bytes
+   in, so vx_io_unmapvolume can release it from the cell pointer.
+   Unmaps it if every slot is taken */
+static int vx_io_addmap(char *base, size_t len, size_t hdrlen,
+			const char *FN, char **buffer)
+{
+  int slot;
+
+  pthread_mutex_lock(&vx_maps_lock);
+  for (slot = 0; slot < VX_MAX_MAP; slot++) {
+    if (vx_maps[slot].base == NULL) {
+      break;
     }
   }
+  if (slot == VX_MAX_MAP) {
+    pthread_mutex_unlock(&vx_maps_lock);
+    fprintf(stderr, "Too many mapped volumes, unable to map %s\n", FN);
+    munmap(base, len);
+    return(1);
+  }
+  vx_maps[slot].base = base;
+  vx_maps[slot].len = len;
+  vx_maps[slot].buffer = base + hdrlen;
+  *buffer = vx_maps[slot].buffer;
+  pthread_mutex_unlock(&vx_maps_lock);
+  return(0);
+}
 
 
-  return 0;
+/* Map voxel volume from disk into memory read-only. Files already in
+   host byte order are mapped shared, so the pages live once in the 
+   page cache for every process on the node and are only faulted in 
+   when touched. This includes the native cache files written by 
+   vx_io_writenative. Big endian files on little endian hosts get a 
+   private mapping that is swapped in place. Release with 
+   vx_io_unmapvolume */
+int vx_io_mapvolume(const char *data_dir, const char *FN,
+		    int ESIZE, int ncells, char **buffer)
+{
+  int fd, native;
+  size_t len, hdrlen;
+  char *base;
+  struct stat st;
+  char file_path[CMLEN];
+
+  *buffer = NULL;
+  native = (vx_io_checknative(data_dir, FN, ESIZE, ncells, NULL) == 0);
+  if (native) {
+    sprintf(file_path, "%s/%s%s", data_dir, FN, VX_IO_NATIVE_SUFFIX);
+    hdrlen = VX_IO_NATIVE_HDRLEN;
+  } else {
+    sprintf(file_path, "%s/%s", data_dir, FN);
+    hdrlen = 0;
+  }
+  fd = open(file_path, O_RDONLY);
+  if (fd < 0) {
+    return(1);
+  }
+  len = hdrlen + (size_t)ESIZE * ncells;
+  if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < len)) {
+    fprintf(stderr, "Failed to map %d cells of size %d from %s\n", 
+	    ncells, ESIZE, file_path);
+    close(fd);
+    return(1);
+  }
+
+  /* Voxet files are big endian */
+  if ((!native) && (vx_system_endian() == VX_BYTEORDER_LSB)) {
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base != MAP_FAILED) {
+      vx_io_swapvolume(base, ESIZE, ncells);
+      mprotect(base, len, PROT_READ);
+    }
+  } else {
+    base = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "Failed to map %s\n", file_path);
+    return(1);
+  }
+
+  return(vx_io_addmap(base, len, hdrlen, FN, buffer));
+}
+
+
+/* Release a volume mapped with vx_io_mapvolume */
+int vx_io_unmapvolume(char *buffer)
+{
+  int slot;
+
+  pthread_mutex_lock(&vx_maps_lock);
+  for (slot = 0; slot < VX_MAX_MAP; slot++) {
+    if ((vx_maps[slot].base != NULL) && (vx_maps[slot].buffer == buffer)) {
+      munmap(vx_maps[slot].base, vx_maps[slot].len);
+      vx_maps[slot].base = NULL;
+      vx_maps[slot].len = 0;
+      vx_maps[slot].buffer = NULL;
+      pthread_mutex_unlock(&vx_maps_lock);
+      return(0);
+    }
+  }
+  pthread_mutex_unlock(&vx_maps_lock);
+
+  return(1);
+}
+
+
+/* Shared work queue of vx_io_loadvolumes */
+typedef struct vx_io_queue_t {
+  vx_io_load_t *jobs;
+  int njobs;
+  int next;
+  pthread_mutex_t lock;
+} vx_io_queue_t;
+
+
+/* Worker, takes jobs off the queue until it is empty */
+static void *vx_io_loadworker(void *arg)
+{
+  vx_io_queue_t *q = (vx_io_queue_t *)arg;
+  vx_io_load_t *job;
+
+  while (1) {
+    pthread_mutex_lock(&q->lock);
+    job = (q->next < q->njobs) ? &q->jobs[q->next++] : NULL;
+    pthread_mutex_unlock(&q->lock);
+    if (job == NULL) {
+      break;
+    }
+    if (job->map) {
+      job->status = vx_io_mapvolume(job->data_dir, job->FN, job->ESIZE,
+				    job->ncells, &job->buffer);
+    } else {
+      job->status = vx_io_loadvolume(job->data_dir, job->FN, job->ESIZE,
+				     job->ncells, job->buffer);
+    }
+  }
+  return(NULL);
+}
+
+
+/* Load or map several volumes concurrently. With nthreads <= 0 the
+   thread count comes from VX_IO_THREADS in the environment, else one
+   thread per volume up to the number of online cores. Every failed 
+   file is reported and returns a non-zero status in its job. Returns
+   the number of failed jobs */
+int vx_io_loadvolumes(vx_io_load_t *jobs, int njobs, int nthreads)
+{
+  vx_io_queue_t q;
+  pthread_t *threads;
+  char *env;
+  long ncores;
+  int i, started, failed;
+
+  if (nthreads <= 0) {
+    env = getenv("VX_IO_THREADS");
+    if (env != NULL) {
+      nthreads = atoi(env);
+    }
+  }
+  if (nthreads <= 0) {
+    ncores = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (ncores > 0) ? (int)ncores : 1;
+  }
+  if (nthreads > njobs) {
+    nthreads = njobs;
+  }
+
+  for (i = 0; i < njobs; i++) {
+    jobs[i].status = 1;
+  }
+  q.jobs = jobs;
+  q.njobs = njobs;
+  q.next = 0;
+  pthread_mutex_init(&q.lock, NULL);
+
+  threads = malloc(nthreads * sizeof(pthread_t));
+  started = 0;
+  if (threads != NULL) {
+    for (i = 0; i < nthreads; i++) {
+      if (pthread_create(&threads[i], NULL, vx_io_loadworker, &q) != 0) {
+	break;
+      }
+      started++;
+    }
+  }
+  /* Without threads the caller does all the work */
+  if (started == 0) {
+    vx_io_loadworker(&q);
+  }
+  for (i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&q.lock);
+
+  failed = 0;
+  for (i = 0; i < njobs; i++) {
+    if (jobs[i].status != 0) {
+      fprintf(stderr, "Failed to load %d cells of size %d from %s/%s\n",
+	      jobs[i].ncells, jobs[i].ESIZE, jobs[i].data_dir, jobs[i].FN);
+      failed++;
+    }
+  }
+  return(failed);
+}
+
+
+/* Read and validate the header of a native cache file. The cache must 
+   be in host byte order, match the expected cell size and count, and 
+   still describe the original file it was converted from */
+int vx_io_checknative(const char *data_dir, const char *FN,
+		      int ESIZE, int ncells, vx_io_native_t *hdr)
+{
+  FILE *ifi;
+  vx_io_native_t h;
+  struct stat st;
+  char file_path[CMLEN];
+
+  sprintf(file_path, "%s/%s%s", data_dir, FN, VX_IO_NATIVE_SUFFIX);
+  if (stat(file_path, &st) != 0) {
+    return(1);
+  }
+  ifi = fopen(file_path, "r");
+  if (ifi == NULL) {
+    return(1);
+  }
+  if (fread(&h, sizeof(vx_io_native_t), 1, ifi) != 1) {
+    fclose(ifi);
+    return(1);
+  }
+  fclose(ifi);
+
+  if ((memcmp(h.magic, VX_IO_NATIVE_MAGIC, 8) != 0) || 
+      (h.version != VX_IO_NATIVE_VERSION) ||
+      (h.byteorder != vx_system_endian()) ||
+      (h.esize != ESIZE) || (h.ncells != ncells) ||
+      ((size_t)st.st_size != VX_IO_NATIVE_HDRLEN + (size_t)ESIZE * ncells)) {
+    return(1);
+  }
+
+  /* Stale if the original volume changed since conversion */
+  sprintf(file_path, "%s/%s", data_dir, FN);
+  if ((stat(file_path, &st) == 0) && 
+      ((h.srcsize != (long long)st.st_size) || 
+       (h.srcmtime != vx_io_mtime(&st)))) {
+    return(1);
+  }
+
+  if (hdr != NULL) {
+    memcpy(hdr, &h, sizeof(vx_io_native_t));
+  }
+  return(0);
+}
+
+
+/* Open a new file next to file_path under a unique name, returned in
+   tmp_path, to be renamed over file_path once complete. Processes
+   still mapping the old file keep its whole contents */
+static FILE *vx_io_opentmp(const char *file_path, char *tmp_path)
+{
+  FILE *ofi;
+  int fd;
+
+  sprintf(tmp_path, "%s.XXXXXX", file_path);
+  fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to create a file next to %s\n", file_path);
+    return(NULL);
+  }
+  /* Readable by every process sharing the data directory */
+  fchmod(fd, 0644);
+  ofi = fdopen(fd, "w");
+  if (ofi == NULL) {
+    close(fd);
+    unlink(tmp_path);
+  }
+  return(ofi);
 }
 
+
+/* Convert a big endian voxet property file into a host order cache 
+   file FN.native next to it. An existing cache is replaced by a
+   rename, never rewritten in place */
+int vx_io_writenative(const char *data_dir, const char *FN,
+		      int ESIZE, int *dims)
+{
+  FILE *ofi;
+  char *buffer;
+  size_t len;
+  int ncells;
+  vx_io_native_t h;
+  struct stat st;
+  char pad[VX_IO_NATIVE_HDRLEN];
+  char file_path[CMLEN], tmp_path[CMLEN + 8];
+
+  ncells = dims[0] * dims[1] * dims[2];
+  len = (size_t)ESIZE * ncells;
+  sprintf(file_path, "%s/%s", data_dir, FN);
+  if (stat(file_path, &st) != 0) {
+    fprintf(stderr, "Failed to stat %s\n", file_path);
+    return(1);
+  }
+
+  buffer = malloc(len);
+  if (buffer == NULL) {
+    fprintf(stderr, "Failed to allocate %d cells for %s\n", ncells, FN);
+    return(1);
+  }
+
+  /* Read from the original, bypassing any existing cache */
+  ofi = fopen(file_path, "r");
+  if ((ofi == NULL) || (fread(buffer, ESIZE, ncells, ofi) != ncells)) {
+    fprintf(stderr, "Failed to read %d cells of size %d from %s\n", 
+	    ncells, ESIZE, file_path);
+    if (ofi != NULL) {
+      fclose(ofi);
+    }
+    free(buffer);
+    return(1);
+  }
+  fclose(ofi);
+  if (vx_system_endian() == VX_BYTEORDER_LSB) {
+    vx_io_swapvolume(buffer, ESIZE, ncells);
+  }
+
+  memset(&h, 0, sizeof(vx_io_native_t));
+  memcpy(h.magic, VX_IO_NATIVE_MAGIC, 8);
+  h.version = VX_IO_NATIVE_VERSION;
+  h.byteorder = vx_system_endian();
+  h.esize = ESIZE;
+  h.dims[0] = dims[0];
+  h.dims[1] = dims[1];
+  h.dims[2] = dims[2];
+  h.ncells = ncells;
+  h.checksum = vx_io_checksum(buffer, len);
+  h.srcsize = (long long)st.st_size;
+  h.srcmtime = vx_io_mtime(&st);
+  memset(pad, 0, VX_IO_NATIVE_HDRLEN);
+  memcpy(pad, &h, sizeof(vx_io_native_t));
+
+  sprintf(file_path, "%s/%s%s", data_dir, FN, VX_IO_NATIVE_SUFFIX);
+  ofi = vx_io_opentmp(file_path, tmp_path);
+  if (ofi == NULL) {
+    free(buffer);
+    return(1);
+  }
+  if ((fwrite(pad, VX_IO_NATIVE_HDRLEN, 1, ofi) != 1) ||
+      (fwrite(buffer, ESIZE, ncells, ofi) != ncells)) {
+    fprintf(stderr, "Failed to write %s\n", tmp_path);
+    fclose(ofi);
+    unlink(tmp_path);
+    free(buffer);
+    return(1);
+  }
+  free(buffer);
+  if ((fclose(ofi) != 0) || (rename(tmp_path, file_path) != 0)) {
+    fprintf(stderr, "Failed to write %s\n", file_path);
+    unlink(tmp_path);
+    return(1);
+  }
+
+  return(0);
+}
+
+
+/* Verify the payload checksum of a native cache file */
+int vx_io_verifynative(const char *data_dir, const char *FN)
+{
+  FILE *ifi;
+  char *buffer;
+  size_t len;
+  int retval;
+  vx_io_native_t h;
+  char file_path[CMLEN];
+
+  sprintf(file_path, "%s/%s%s", data_dir, FN, VX_IO_NATIVE_SUFFIX);
+  ifi = fopen(file_path, "r");
+  if (ifi == NULL) {
+    return(1);
+  }
+  if (fread(&h, sizeof(vx_io_native_t), 1, ifi) != 1) {
+    fclose(ifi);
+    return(1);
+  }
+  if (vx_io_checknative(data_dir, FN, h.esize, h.ncells, NULL) != 0) {
+    fclose(ifi);
+    return(1);
+  }
+
+  len = (size_t)h.esize * h.ncells;
+  buffer = malloc(len);
+  if (buffer == NULL) {
+    fclose(ifi);
+    return(1);
+  }
+  retval = ((fseek(ifi, VX_IO_NATIVE_HDRLEN, SEEK_SET) != 0) || 
+	    (fread(buffer, h.esize, h.ncells, ifi) != h.ncells) ||
+	    (vx_io_checksum(buffer, len) != h.checksum));
+  fclose(ifi);
+  free(buffer);
+
+  return(retval);
+}
+
+
+/* Write the ncells + 1 codes of a 16-bit volume converted from
+   property file FN into cache file FN.q16 next to it. hdr holds the
+   cell order, cell count and decoding, the rest of the header is
+   filled in here. The file is written under a temporary name and
+   renamed, so processes mapping an older cache keep a whole one */
+int vx_io_writeq16(const char *data_dir, const char *FN,
+		   const vx_io_q16_t *hdr, const uint16_t *code)
+{
+  FILE *ofi;
+  vx_io_q16_t h;
+  struct stat st;
+  char pad[VX_IO_Q16_HDRLEN];
+  char file_path[CMLEN], tmp_path[CMLEN + 8];
+  size_t n = (size_t)hdr->ncells + 1;
+
+  sprintf(file_path, "%s/%s", data_dir, FN);
+  if (stat(file_path, &st) != 0) {
+    fprintf(stderr, "Failed to stat %s\n", file_path);
+    return(1);
+  }
+  memcpy(&h, hdr, sizeof(vx_io_q16_t));
+  memcpy(h.magic, VX_IO_Q16_MAGIC, 8);
+  h.version = VX_IO_Q16_VERSION;
+  h.byteorder = vx_system_endian();
+  h.srcsize = (long long)st.st_size;
+  h.srcmtime = vx_io_mtime(&st);
+  memset(pad, 0, VX_IO_Q16_HDRLEN);
+  memcpy(pad, &h, sizeof(vx_io_q16_t));
+
+  sprintf(file_path, "%s/%s%s", data_dir, FN, VX_IO_Q16_SUFFIX);
+  ofi = vx_io_opentmp(file_path, tmp_path);
+  if (ofi == NULL) {
+    return(1);
+  }
+  if ((fwrite(pad, VX_IO_Q16_HDRLEN, 1, ofi) != 1) ||
+      (fwrite(code, sizeof(uint16_t), n, ofi) != n)) {
+    fprintf(stderr, "Failed to write %s\n", tmp_path);
+    fclose(ofi);
+    unlink(tmp_path);
+    return(1);
+  }
+  if ((fclose(ofi) != 0) || (rename(tmp_path, file_path) != 0)) {
+    fprintf(stderr, "Failed to write %s\n", file_path);
+    unlink(tmp_path);
+    return(1);
+  }
+  return(0);
+}
+
+
+/* Map the codes of 16-bit cache file FN.q16 read-only and shared, so
+   every process on the node holds the volume once. The cache must be
+   in host byte order, match the cell order, cell count and no data
+   value in hdr, and still describe the original file it was converted
+   from. hdr then gets the whole header. Release with
+   vx_io_unmapvolume */
+int vx_io_mapq16(const char *data_dir, const char *FN, vx_io_q16_t *hdr,
+		 uint16_t **code)
+{
+  int fd;
+  size_t len;
+  char *base, *buffer;
+  vx_io_q16_t h;
+  struct stat st, src;
+  char file_path[CMLEN];
+
+  *code = NULL;
+  sprintf(file_path, "%s/%s", data_dir, FN);
+  if (stat(file_path, &src) != 0) {
+    return(1);
+  }
+  sprintf(file_path, "%s/%s%s", data_dir, FN, VX_IO_Q16_SUFFIX);
+  fd = open(file_path, O_RDONLY);
+  if (fd < 0) {
+    return(1);
+  }
+  len = VX_IO_Q16_HDRLEN + ((size_t)hdr->ncells + 1) * sizeof(uint16_t);
+  if ((fstat(fd, &st) != 0) || ((size_t)st.st_size != len) ||
+      (read(fd, &h, sizeof(vx_io_q16_t)) != sizeof(vx_io_q16_t)) ||
+      (memcmp(h.magic, VX_IO_Q16_MAGIC, 8) != 0) ||
+      (h.version != VX_IO_Q16_VERSION) ||
+      (h.byteorder != vx_system_endian()) ||
+      (h.bdim != hdr->bdim) || (h.ncells != hdr->ncells) ||
+      (h.nodata != hdr->nodata) ||
+      (h.srcsize != (long long)src.st_size) ||
+      (h.srcmtime != vx_io_mtime(&src))) {
+    close(fd);
+    return(1);
+  }
+
+  base = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "Failed to map %s\n", file_path);
+    return(1);
+  }
+  if (vx_io_addmap(base, len, VX_IO_Q16_HDRLEN, FN, &buffer) != 0) {
+    return(1);
+  }
+  memcpy(hdr, &h, sizeof(vx_io_q16_t));
+  *code = (uint16_t *)buffer;
+  return(0);
+}
@@ -3,9 +3,73 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 
 typedef enum { VX_PNUMBER_VP = 1, VX_PNUMBER_TAG=2, VX_PNUMBER_VS=3 } vx_pnumber_t;
 
+/* Native (host byte order) cache file, written next to the
+   original property file as FN.native */
+#define VX_IO_NATIVE_MAGIC "VXNATIVE"
+#define VX_IO_NATIVE_SUFFIX ".native"
+#define VX_IO_NATIVE_VERSION 2
+#define VX_IO_NATIVE_HDRLEN 64
+
+typedef struct vx_io_native_t {
+  char magic[8];
+  int version;
+  int byteorder;
+  int esize;
+  int dims[3];
+  int ncells;
+  unsigned int checksum;
+  long long srcsize;
+  long long srcmtime;     /* nanoseconds */
+} vx_io_native_t;
+
+/* 16-bit fixed point cache file of a property volume, written next
+   to the original property file as FN.q16 */
+#define VX_IO_Q16_MAGIC "VXQ16VOL"
+#define VX_IO_Q16_SUFFIX ".q16"
+#define VX_IO_Q16_VERSION 1
+#define VX_IO_Q16_HDRLEN 128
+
+typedef struct vx_io_q16_t {
+  char magic[8];
+  int version;
+  int byteorder;
+  int bdim;               /* brick dimension of the cell order, 0 linear */
+  int ncells;             /* cells, the file holds one padding code more */
+  float nodata;           /* value the no data code decodes to */
+  double scale;           /* value step of a code */
+  double offset;          /* value of code 0 */
+  double maxerr;          /* largest decoding error over the volume */
+  long long srcsize;
+  long long srcmtime;     /* nanoseconds */
+} vx_io_q16_t;
+
+/* Parsed voxet header */
+typedef struct vx_io_header_t vx_io_header_t;
+
+
+/* Parse a voxet header. Headers are independent of each other
+   and of the vx_io_init reader */
+vx_io_header_t *vx_io_open(const char *);
+
+
+/* Free a parsed voxet header */
+void vx_io_close(vx_io_header_t *);
+
+
+/* Getters on a parsed header, same semantics as the vx_io_get* 
+   functions below */
+int vx_io_header_getpropkey(vx_io_header_t *, const char *);
+int vx_io_header_getvec(vx_io_header_t *, const char *, float *);
+int vx_io_header_getdim(vx_io_header_t *, const char *, int *);
+int vx_io_header_getpropname(vx_io_header_t *, const char *, int, char *);
+int vx_io_header_getpropsize(vx_io_header_t *, const char *, int, int *);
+int vx_io_header_getpropval(vx_io_header_t *, const char *, int, float *);
+
+
 /* Initialize voxel prop reader */
 int vx_io_init(char *);
 
@@ -41,4 +105,53 @@ int vx_io_getpropval(char *, vx_pnumber_t, float *);
 int vx_io_loadvolume(const char *, const char *, int, int, char *);
 
 
+/* Map voxel volume from disk into memory read-only. Translate
+   endian if necessary */
+int vx_io_mapvolume(const char *, const char *, int, int, char **);
+
+
+/* Release a volume mapped with vx_io_mapvolume */
+int vx_io_unmapvolume(char *);
+
+
+/* Volume load request for vx_io_loadvolumes */
+typedef struct vx_io_load_t {
+  const char *data_dir;
+  const char *FN;
+  int ESIZE;
+  int ncells;
+  int map;        /* map with vx_io_mapvolume instead of reading */
+  char *buffer;   /* caller allocated when reading, set when mapping */
+  int status;     /* 0 on success */
+} vx_io_load_t;
+
+
+/* Load or map several volumes concurrently, returns the 
+   number of failed loads */
+int vx_io_loadvolumes(vx_io_load_t *, int, int);
+
+
+/* Validate the header of a native cache file */
+int vx_io_checknative(const char *, const char *, int, int, 
+		      vx_io_native_t *);
+
+
+/* Write a native cache file for a property file */
+int vx_io_writenative(const char *, const char *, int, int *);
+
+
+/* Verify the checksum of a native cache file */
+int vx_io_verifynative(const char *, const char *);
+
+
+/* Write a 16-bit cache file for a property file */
+int vx_io_writeq16(const char *, const char *, const vx_io_q16_t *,
+		   const uint16_t *);
+
+
+/* Map a 16-bit cache file read-only and shared. Release with
+   vx_io_unmapvolume */
+int vx_io_mapq16(const char *, const char *, vx_io_q16_t *, uint16_t **);
+
+
 #endif
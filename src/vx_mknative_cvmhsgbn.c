@@ -0,0 +1,171 @@
+/** vx_mknative_cvmhsgbn.c - Convert voxet property files to host
+    byte order cache files
+
+    Every @@ property file listed in the given .vo headers is written
+    as FN.native next to the original. vx_io_loadvolume and
+    vx_io_mapvolume pick the cache up automatically and skip the
+    endian swap. With -q the model volumes are instead written as the
+    FN.q16 16-bit caches vx_model_quantize maps.
+**/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include "params.h"
+#include "vx_io.h"
+#include "vx_model.h"
+
+/* Default voxet headers of the model */
+const char *vx_mknative_vo[] = { "CVM_CM.vo", "CVMSM.vo", "interfaces.vo",
+				 "CVMHB-San-Gabriel-Basin.vo" };
+#define VX_MKNATIVE_NUM_VO 4
+
+
+/* Usage function */
+void usage() {
+  printf("     vx_mknative_cvmhsgbn - (c) SCEC\n");
+  printf("Writes host byte order copies of the CVMHSGBN property files.\n");
+  printf("\tusage: vx_mknative_cvmhsgbn [-c] [-h] [-q [-b bdim]] -m dir "
+	 "[file.vo ...]\n\n");
+  printf("Flags:\n");
+  printf("\t-b brick size the model is queried with, for -q.\n");
+  printf("\t-c verify existing cache files instead of writing them.\n");
+  printf("\t-h usage.\n");
+  printf("\t-m directory holding the model .vo and @@ files.\n");
+  printf("\t-q write the 16-bit vp and vs caches of the model voxets.\n\n");
+  printf("Without .vo arguments CVM_CM.vo, CVMSM.vo, interfaces.vo and\n");
+  printf("CVMHB-San-Gabriel-Basin.vo are converted, with -q the default\n");
+  printf("model voxets.\n\n");
+  exit (0);
+}
+
+
+/* Convert or verify every property of one voxet header */
+int process_vo(const char *data_dir, const char *vo, int verify)
+{
+  char vo_path[CMLEN];
+  char fn[CMLEN];
+  int dims[3];
+  int esize, p;
+  int errors = 0;
+  vx_io_header_t *hdr;
+
+  sprintf(vo_path, "%s/%s", data_dir, vo);
+  hdr = vx_io_open(vo_path);
+  if (hdr == NULL) {
+    fprintf(stderr, "Failed to read voxet header %s\n", vo_path);
+    return(1);
+  }
+  if (vx_io_header_getdim(hdr, "AXIS_N", dims) != 0) {
+    fprintf(stderr, "No AXIS_N in %s\n", vo_path);
+    vx_io_close(hdr);
+    return(1);
+  }
+
+  for (p = 1; vx_io_header_getpropname(hdr, "PROP_FILE", p, fn) == 0; p++) {
+    esize = 4;
+    vx_io_header_getpropsize(hdr, "PROP_ESIZE", p, &esize);
+    if (verify) {
+      if (vx_io_verifynative(data_dir, fn) != 0) {
+	fprintf(stderr, "%s%s: FAILED\n", fn, VX_IO_NATIVE_SUFFIX);
+	errors++;
+      } else {
+	printf("%s%s: OK\n", fn, VX_IO_NATIVE_SUFFIX);
+      }
+    } else {
+      if (vx_io_writenative(data_dir, fn, esize, dims) != 0) {
+	errors++;
+      } else {
+	printf("%s -> %s%s (%d x %d x %d)\n", fn, fn, VX_IO_NATIVE_SUFFIX,
+	       dims[0], dims[1], dims[2]);
+      }
+    }
+  }
+  vx_io_close(hdr);
+
+  return(errors);
+}
+
+
+/* Write the 16-bit caches of the model of nvo voxets vo, NULL for
+   the default model, held in bricks of bdim (0 linear) */
+int process_q16(const char *data_dir, const char **vo, int nvo, int bdim)
+{
+  vx_model_t *m;
+  int rc;
+
+  m = vx_model_open(data_dir, vo, nvo);
+  if (m == NULL) {
+    fprintf(stderr, "Failed to open the model in %s\n", data_dir);
+    return(1);
+  }
+  if ((bdim > 0) && (vx_model_setbricks(m, bdim) != 0)) {
+    fprintf(stderr, "Failed to hold the model in bricks of %d\n", bdim);
+    vx_model_close(m);
+    return(1);
+  }
+  rc = vx_model_writeq16(m);
+  if (rc == 0) {
+    printf("16-bit caches written in %s\n", data_dir);
+  }
+  vx_model_close(m);
+  return(rc);
+}
+
+
+int main (int argc, char *argv[])
+{
+  char *data_dir = NULL;
+  int verify = 0, q16 = 0, bdim = 0;
+  int opt, i;
+  int errors = 0;
+
+  /* Parse options */
+  while ((opt = getopt(argc, argv, "b:chm:q")) != -1) {
+    switch (opt) {
+    case 'b':
+      bdim = atoi(optarg);
+      break;
+    case 'c':
+      verify = 1;
+      break;
+    case 'q':
+      q16 = 1;
+      break;
+    case 'm':
+      data_dir = optarg;
+      break;
+    case 'h':
+    default:
+      usage();
+      break;
+    }
+  }
+  if (data_dir == NULL) {
+    usage();
+  }
+
+  if (q16) {
+    if (optind < argc) {
+      return(process_q16(data_dir, (const char **)&argv[optind],
+			 argc - optind, bdim));
+    }
+    return(process_q16(data_dir, NULL, 0, bdim));
+  }
+
+  if (optind < argc) {
+    for (i = optind; i < argc; i++) {
+      errors += process_vo(data_dir, argv[i], verify);
+    }
+  } else {
+    for (i = 0; i < VX_MKNATIVE_NUM_VO; i++) {
+      errors += process_vo(data_dir, vx_mknative_vo[i], verify);
+    }
+  }
+
+  if (errors > 0) {
+    return(1);
+  }
+  return(0);
+}
@@ -0,0 +1,1237 @@
+/** vx_model.c - Model context handles
+
+    A model context owns everything a query reads: the grids and
+    their mapped volumes. It is not changed after vx_model_open, so
+    any number of threads may query one context at once, each query
+    keeps its transform and index scratch on its own stack. Models
+    opened with vx_model_openlazy page their volumes in bricks through
+    a locked brick cache instead.
+
+    A horizontal cache remembers, for recently queried lon/lat
+    locations, their UTM coordinates and horizontal cell in every
+    voxet. It is written by every query so it belongs to one thread,
+    the model it is used with may still be shared.
+
+    The legacy entry points use the default context set up by
+    vx_model_init, and its cache.
+**/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include "params.h"
+#include "vx_io.h"
+#include "vx_brick.h"
+#include "vx_query.h"
+#include "vx_utm.h"
+#include "vx_surf.h"
+#include "vx_model.h"
+
+/* Model state */
+struct vx_model_t {
+  int ngrids;
+  vx_query_grid_t grids[VX_MODEL_MAXVOXETS];
+  int nmaps;
+  char *maps[2 * VX_MODEL_MAXVOXETS];
+  int ncopies;
+  char *copies[2 * VX_MODEL_MAXVOXETS]; /* brick order volumes */
+  int nq;
+  vx_query_q16_t q[2 * VX_MODEL_MAXVOXETS]; /* mapped from FN.q16 caches */
+  char data_dir[CMLEN];
+  char fn[2 * VX_MODEL_MAXVOXETS][CMLEN]; /* vp and vs property files of
+					     each voxet, vs empty if none */
+  float vsnodata[VX_MODEL_MAXVOXETS]; /* PROP_NO_DATA_VALUE of each vs */
+  vx_utm_grid_t *lookup;
+  vx_surf_t *surf;
+  int zmode;           /* VX_MODEL_ZMODE_ELEV or VX_MODEL_ZMODE_DEPTH */
+  int utmmode;         /* VX_UTM_MODE_EXACT or VX_UTM_MODE_VECTOR */
+  double geo[4];       /* lon/lat box of all voxets, degrees */
+  unsigned long gen;   /* generation, changes whenever cached state
+			  of the model may */
+};
+
+/* One cached location, keyed on the bits of lon and lat */
+typedef struct vx_model_entry_t {
+  uint64_t lon, lat;
+  int valid;
+  double x, y;
+  int col[VX_MODEL_MAXVOXETS];
+  double surf[VX_SURF_NUM]; /* surfaces, when the model has them */
+} vx_model_entry_t;
+
+/* Position of a point in a sorted query */
+typedef struct vx_model_order_t {
+  uint64_t key;
+  int p;
+} vx_model_order_t;
+
+/* Direct mapped horizontal cache */
+struct vx_model_cache_t {
+  unsigned long gen;   /* generation of the model entries are from */
+  int mask;
+  long hits, misses;
+  vx_model_entry_t *entries;
+};
+
+/* Block b of an optional output array */
+#define VX_MODEL_AT(a, b) (((a) != NULL) ? &(a)[b] : NULL)
+
+/* Boundary samples per side when finding the lon/lat box of a voxet */
+#define VX_MODEL_EDGE_SAMPLES 32
+
+/* Points sorted together by vx_model_query_sorted, small enough that
+   their arrays stay in cache, and radix digit of the sort */
+#define VX_MODEL_SORT_WINDOW 16384
+#define VX_MODEL_SORT_BITS 11
+
+/* Margin (degrees) added to a sampled lon/lat box, well above how
+   far a voxet edge bows between samples */
+#define VX_MODEL_GEO_PAD 0.001
+
+/* Default voxets, in priority order */
+static const char *vx_model_vo[] = { "CVMHB-San-Gabriel-Basin.vo",
+				     "CVMSM.vo", "CVM_CM.vo" };
+#define VX_MODEL_NUM_VO 3
+
+/* Last generation handed out, 0 is never used */
+static unsigned long vx_model_gen = 0;
+static pthread_mutex_t vx_model_gen_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Context of the legacy entry points, and its cache */
+static vx_model_t *vx_model_dflt = NULL;
+static vx_model_cache_t *vx_model_dflt_cache = NULL;
+
+
+/* Give model m a new generation, so caches filled from it before,
+   or from another model at the same address, start over */
+static void vx_model_newgen(vx_model_t *m)
+{
+  pthread_mutex_lock(&vx_model_gen_lock);
+  m->gen = ++vx_model_gen;
+  pthread_mutex_unlock(&vx_model_gen_lock);
+}
+
+
+/* Read the axis, vp/vs property files and their no data values of
+   one voxet header. vs without its own no data value takes vp's */
+static int vx_model_readvo(const char *vo_path, struct axis *a,
+			   char *vp_fn, char *vs_fn, float *nodata,
+			   float *vs_nodata)
+{
+  vx_io_header_t *hdr;
+  int esize;
+
+  hdr = vx_io_open(vo_path);
+  if (hdr == NULL) {
+    fprintf(stderr, "Failed to read voxet header %s\n", vo_path);
+    return(1);
+  }
+  memset(a, 0, sizeof(struct axis));
+  if ((vx_io_header_getvec(hdr, "AXIS_O", a->O) != 0) ||
+      (vx_io_header_getvec(hdr, "AXIS_U", a->U) != 0) ||
+      (vx_io_header_getvec(hdr, "AXIS_V", a->V) != 0) ||
+      (vx_io_header_getvec(hdr, "AXIS_W", a->W) != 0) ||
+      (vx_io_header_getdim(hdr, "AXIS_N", a->N) != 0) ||
+      (vx_io_header_getpropname(hdr, "PROP_FILE", VX_PNUMBER_VP, vp_fn)
+       != 0)) {
+    fprintf(stderr, "Incomplete voxet header %s\n", vo_path);
+    vx_io_close(hdr);
+    return(1);
+  }
+  esize = 4;
+  vx_io_header_getpropsize(hdr, "PROP_ESIZE", VX_PNUMBER_VP, &esize);
+  if (esize != 4) {
+    fprintf(stderr, "Unsupported PROP_ESIZE %d in %s\n", esize, vo_path);
+    vx_io_close(hdr);
+    return(1);
+  }
+  if (vx_io_header_getpropname(hdr, "PROP_FILE", VX_PNUMBER_VS, vs_fn) != 0) {
+    vs_fn[0] = '\0';
+  }
+  *nodata = NIL;
+  vx_io_header_getpropval(hdr, "PROP_NO_DATA_VALUE", VX_PNUMBER_VP, nodata);
+  *vs_nodata = *nodata;
+  vx_io_header_getpropval(hdr, "PROP_NO_DATA_VALUE", VX_PNUMBER_VS,
+			  vs_nodata);
+  vx_io_close(hdr);
+  return(0);
+}
+
+
+/* lon/lat box (degrees) lon0, lon1, lat0, lat1 of the cells of grid g,
+   which reach half a step past the outer nodes, from samples along
+   its sides. Returns 1 if a sample does not convert */
+static int vx_model_geobox(const vx_query_grid_t *g, double *box)
+{
+  double x0, y0, x1, y1, x[4], y[4], lon, lat, f;
+  int e, k;
+
+  box[0] = box[2] = 1.0e10;
+  box[1] = box[3] = -1.0e10;
+  x0 = g->O[0] - 0.5 * g->step[0];
+  y0 = g->O[1] - 0.5 * g->step[1];
+  x1 = g->O[0] + g->step[0] * (g->N[0] - 0.5);
+  y1 = g->O[1] + g->step[1] * (g->N[1] - 0.5);
+  /* Sample the four sides of the voxet footprint */
+  for (k = 0; k <= VX_MODEL_EDGE_SAMPLES; k++) {
+    f = (double)k / VX_MODEL_EDGE_SAMPLES;
+    x[0] = x0 + f * (x1 - x0);
+    y[0] = y0;
+    x[1] = x[0];
+    y[1] = y1;
+    x[2] = x0;
+    y[2] = y0 + f * (y1 - y0);
+    x[3] = x1;
+    y[3] = y[2];
+    for (e = 0; e < 4; e++) {
+      if (vx_utm11_inv(x[e], y[e], &lon, &lat) != 0) {
+	return(1);
+      }
+      box[0] = (lon < box[0]) ? lon : box[0];
+      box[1] = (lon > box[1]) ? lon : box[1];
+      box[2] = (lat < box[2]) ? lat : box[2];
+      box[3] = (lat > box[3]) ? lat : box[3];
+    }
+  }
+  return(0);
+}
+
+
+/* Open the voxets of a model in data_dir, in priority order. Their
+   vp and vs volumes are mapped, or with lazy set paged in bricks
+   bdim cells on a side with at most maxbricks bricks held per
+   volume. vo NULL selects the default voxets */
+static vx_model_t *vx_model_load(const char *data_dir, const char **vo,
+				 int nvo, int lazy, int bdim, int maxbricks)
+{
+  vx_model_t *m;
+  vx_query_grid_t *q;
+  struct axis a[VX_MODEL_MAXVOXETS];
+  double box[4];
+  float nodata[VX_MODEL_MAXVOXETS];
+  vx_io_load_t jobs[2 * VX_MODEL_MAXVOXETS];
+  int vpjob[VX_MODEL_MAXVOXETS], vsjob[VX_MODEL_MAXVOXETS];
+  char vo_path[CMLEN];
+  int g, njobs = 0;
+
+  if (vo == NULL) {
+    vo = vx_model_vo;
+    nvo = VX_MODEL_NUM_VO;
+  }
+  if ((nvo <= 0) || (nvo > VX_MODEL_MAXVOXETS)) {
+    return(NULL);
+  }
+  m = calloc(1, sizeof(vx_model_t));
+  if (m == NULL) {
+    return(NULL);
+  }
+  snprintf(m->data_dir, CMLEN, "%s", data_dir);
+
+  for (g = 0; g < nvo; g++) {
+    sprintf(vo_path, "%s/%s", data_dir, vo[g]);
+    if (vx_model_readvo(vo_path, &a[g], m->fn[2*g], m->fn[2*g+1],
+			&nodata[g], &m->vsnodata[g]) != 0) {
+      free(m);
+      return(NULL);
+    }
+    memset(&jobs[njobs], 0, 2 * sizeof(vx_io_load_t));
+    jobs[njobs].data_dir = data_dir;
+    jobs[njobs].FN = m->fn[2*g];
+    jobs[njobs].ESIZE = 4;
+    jobs[njobs].ncells = a[g].N[0] * a[g].N[1] * a[g].N[2];
+    jobs[njobs].map = 1;
+    vpjob[g] = njobs++;
+    vsjob[g] = -1;
+    if (m->fn[2*g+1][0] != '\0') {
+      jobs[njobs] = jobs[njobs-1];
+      jobs[njobs].FN = m->fn[2*g+1];
+      vsjob[g] = njobs++;
+    }
+  }
+
+  if (lazy) {
+    for (g = 0; g < nvo; g++) {
+      q = &m->grids[g];
+      vx_query_setgrid(q, &a[g], NULL, NULL, nodata[g]);
+      m->ngrids = g + 1;
+      q->lazy[0] = vx_lazy_open(data_dir, m->fn[2*g], 4, a[g].N, bdim,
+				maxbricks);
+      if ((q->lazy[0] == NULL) ||
+	  ((vsjob[g] >= 0) &&
+	   ((q->lazy[1] = vx_lazy_open(data_dir, m->fn[2*g+1], 4, a[g].N,
+				       bdim, maxbricks)) == NULL))) {
+	fprintf(stderr, "Failed to open model volumes of %s\n", vo[g]);
+	vx_model_close(m);
+	return(NULL);
+      }
+      q->brick = *vx_lazy_layout(q->lazy[0]);
+    }
+  } else {
+    vx_io_loadvolumes(jobs, njobs, 0);
+    for (g = 0; g < njobs; g++) {
+      if (jobs[g].status == 0) {
+	m->maps[m->nmaps++] = jobs[g].buffer;
+      }
+    }
+    if (m->nmaps != njobs) {
+      fprintf(stderr, "Failed to map %d model volumes\n", njobs - m->nmaps);
+      vx_model_close(m);
+      return(NULL);
+    }
+
+    for (g = 0; g < nvo; g++) {
+      vx_query_setgrid(&m->grids[g], &a[g], (float *)jobs[vpjob[g]].buffer,
+		       (vsjob[g] < 0) ? NULL : (float *)jobs[vsjob[g]].buffer,
+		       nodata[g]);
+    }
+  }
+  m->ngrids = nvo;
+
+  /* Points outside the lon/lat box of every voxet are answered
+     without a transform */
+  m->geo[0] = m->geo[2] = 1.0e10;
+  m->geo[1] = m->geo[3] = -1.0e10;
+  for (g = 0; g < nvo; g++) {
+    if (vx_model_geobox(&m->grids[g], box) != 0) {
+      m->geo[0] = m->geo[2] = -1.0e10;
+      m->geo[1] = m->geo[3] = 1.0e10;
+      break;
+    }
+    m->geo[0] = fmin(m->geo[0], box[0] - VX_MODEL_GEO_PAD);
+    m->geo[1] = fmax(m->geo[1], box[1] + VX_MODEL_GEO_PAD);
+    m->geo[2] = fmin(m->geo[2], box[2] - VX_MODEL_GEO_PAD);
+    m->geo[3] = fmax(m->geo[3], box[3] + VX_MODEL_GEO_PAD);
+  }
+
+  vx_model_newgen(m);
+  return(m);
+}
+
+
+/* Open the voxets of a model in data_dir, in priority order, and map
+   their vp and vs volumes. vo NULL selects the default voxets */
+vx_model_t *vx_model_open(const char *data_dir, const char **vo, int nvo)
+{
+  return(vx_model_load(data_dir, vo, nvo, 0, 0, 0));
+}
+
+
+/* Open the voxets of a model without reading their volumes, bricks
+   of bdim cells on a side (<= 0 for VX_BRICK_DIM) are read as
+   queries first reach them and at most maxbricks (<= 0 for
+   VX_LAZY_MAXBRICKS) are held per volume. Memory then stays bounded
+   for models larger than the node, at the cost of a lock per block
+   of points and volume */
+vx_model_t *vx_model_openlazy(const char *data_dir, const char **vo,
+			      int nvo, int bdim, int maxbricks)
+{
+  return(vx_model_load(data_dir, vo, nvo, 1, bdim, maxbricks));
+}
+
+
+/* Copy the vp and vs volumes of every voxet into brick order, bricks
+   bdim cells on a side (<= 0 for VX_BRICK_DIM). The cells around a
+   point and down a column then share a few cache lines and pages.
+   The copies are private to the process, unlike the shared mappings
+   they replace. Call before vx_model_quantize and before the context
+   is shared between threads. Returns 1, keeping the volumes as they
+   are, when out of memory or when they are not mapped floats */
+int vx_model_setbricks(vx_model_t *m, int bdim)
+{
+  vx_query_grid_t *g;
+  vx_brick_layout_t bl[VX_MODEL_MAXVOXETS];
+  char *copy[2 * VX_MODEL_MAXVOXETS];
+  int k, i, n = 0;
+
+  if ((m->nmaps == 0) || (m->ncopies > 0)) {
+    return(1);
+  }
+  for (k = 0; k < m->ngrids; k++) {
+    g = &m->grids[k];
+    if (vx_brick_setup(&bl[k], g->N, bdim) != 0) {
+      break;
+    }
+    copy[n] = vx_brick_relayout((const char *)g->vp, 4, &bl[k]);
+    if (copy[n] == NULL) {
+      break;
+    }
+    n++;
+    if (g->vs != NULL) {
+      copy[n] = vx_brick_relayout((const char *)g->vs, 4, &bl[k]);
+      if (copy[n] == NULL) {
+	break;
+      }
+      n++;
+    }
+  }
+  if (k < m->ngrids) {
+    for (i = 0; i < n; i++) {
+      free(copy[i]);
+    }
+    return(1);
+  }
+
+  /* Covers are per column block and hold in either order */
+  n = 0;
+  for (k = 0; k < m->ngrids; k++) {
+    g = &m->grids[k];
+    g->brick = bl[k];
+    g->vp = (const float *)copy[n++];
+    if (g->vs != NULL) {
+      g->vs = (const float *)copy[n++];
+    }
+  }
+  for (i = 0; i < m->nmaps; i++) {
+    vx_io_unmapvolume(m->maps[i]);
+  }
+  m->nmaps = 0;
+  memcpy(m->copies, copy, n * sizeof(char *));
+  m->ncopies = n;
+  vx_model_newgen(m);
+  return(0);
+}
+
+
+/* Build a lon/lat to UTM lookup grid with nodes step degrees apart
+   (<= 0 for VX_UTM_GRID_STEP) over the lon/lat box of the first,
+   highest priority, voxet. Queries then interpolate UTM coordinates
+   inside the box and convert exactly outside it. maxerr, if not NULL,
+   gets the error bound in meters. Call before the context is shared
+   between threads */
+int vx_model_setlookup(vx_model_t *m, double step, double *maxerr)
+{
+  double box[4];
+
+  if (step <= 0.0) {
+    step = VX_UTM_GRID_STEP;
+  }
+  if (vx_model_geobox(&m->grids[0], box) != 0) {
+    return(1);
+  }
+
+  vx_utm_grid_free(m->lookup);
+  m->lookup = vx_utm_grid_new(box[0] - step, box[1] + step, box[2] - step,
+			      box[3] + step, step);
+  if (m->lookup == NULL) {
+    return(1);
+  }
+  if (maxerr != NULL) {
+    *maxerr = m->lookup->maxerr;
+  }
+  vx_model_newgen(m);
+  return(0);
+}
+
+
+/* Convert lon/lat of queries to UTM on the exact path
+   (VX_UTM_MODE_EXACT, the default) or the vector path
+   (VX_UTM_MODE_VECTOR) of vx_utm.c, where no lookup grid answers
+   them. Call before the context is shared between threads. Returns 1
+   on an unknown mode */
+int vx_model_setutmmode(vx_model_t *m, int mode)
+{
+  if ((mode != VX_UTM_MODE_EXACT) && (mode != VX_UTM_MODE_VECTOR)) {
+    return(1);
+  }
+  m->utmmode = mode;
+  vx_model_newgen(m);
+  return(0);
+}
+
+
+/* n lon/lat (degrees) to UTM x/y through the lookup grid of model m,
+   or without one on its UTM path */
+static void vx_model_geo2utm(const vx_model_t *m, const double *lon,
+			     const double *lat, double *x, double *y, int n)
+{
+  if (m->lookup != NULL) {
+    vx_utm_grid_fwd(m->lookup, lon, lat, x, y, n);
+  } else {
+    vx_query_geo2utm(m->utmmode, lon, lat, x, y, n);
+  }
+}
+
+
+/* Map the 16-bit form q of property file FN, cells in the brick order
+   of bdim (0 linear), from its FN.q16 cache. Returns 1 when the cache
+   is missing or stale */
+static int vx_model_q16(const vx_model_t *m, const char *FN, int bdim,
+			int ncells, float nodata, vx_query_q16_t *q)
+{
+  vx_io_q16_t h;
+  uint16_t *code;
+
+  memset(&h, 0, sizeof(vx_io_q16_t));
+  h.bdim = bdim;
+  h.ncells = ncells;
+  h.nodata = nodata;
+  if (vx_io_mapq16(m->data_dir, FN, &h, &code) != 0) {
+    return(1);
+  }
+  q->code = code;
+  q->scale = h.scale;
+  q->offset = h.offset;
+  q->nodata = h.nodata;
+  q->maxerr = h.maxerr;
+  return(0);
+}
+
+
+/* Write the FN.q16 cache of float volume vol, cells in the brick
+   order of bdim (0 linear), of property file FN */
+static int vx_model_writeq16vol(const vx_model_t *m, const char *FN,
+				const float *vol, int bdim, int ncells,
+				float nodata)
+{
+  vx_io_q16_t h;
+  vx_query_q16_t t;
+  int rc;
+
+  if (vx_query_quantize(vol, ncells, nodata, &t) != 0) {
+    fprintf(stderr, "Failed to quantize %s\n", FN);
+    return(1);
+  }
+  memset(&h, 0, sizeof(vx_io_q16_t));
+  h.bdim = bdim;
+  h.ncells = ncells;
+  h.nodata = nodata;
+  h.scale = t.scale;
+  h.offset = t.offset;
+  h.maxerr = t.maxerr;
+  rc = vx_io_writeq16(m->data_dir, FN, &h, t.code);
+  vx_query_freeq16(&t);
+  return(rc);
+}
+
+
+/* Write the FN.q16 caches vx_model_quantize maps, of the vp and vs
+   volumes of every voxet in the cell order the model holds them, so
+   call it after vx_model_setbricks when the model uses bricks. This
+   is an offline step, vx_mknative_cvmhsgbn -q runs it once per
+   install. Returns 1 if a cache could not be written, or when the
+   volumes are paged or already quantized */
+int vx_model_writeq16(const vx_model_t *m)
+{
+  const vx_query_grid_t *g;
+  int k, ncells;
+
+  for (k = 0; k < m->ngrids; k++) {
+    g = &m->grids[k];
+    if (g->vp == NULL) {
+      fprintf(stderr, "No float volumes to quantize\n");
+      return(1);
+    }
+    ncells = (int)vx_query_ncells(g);
+    if ((vx_model_writeq16vol(m, m->fn[2*k], g->vp, g->brick.bdim, ncells,
+			      g->nodata) != 0) ||
+	((g->vs != NULL) &&
+	 (vx_model_writeq16vol(m, m->fn[2*k+1], g->vs, g->brick.bdim, ncells,
+			       m->vsnodata[k]) != 0))) {
+      return(1);
+    }
+  }
+  return(0);
+}
+
+
+/* Convert the vp and vs volumes of every voxet to 16-bit fixed point
+   and release the float volumes, halving the memory and bandwidth
+   queries use. The 16-bit volumes are mapped shared from the FN.q16
+   caches vx_model_writeq16 wrote next to the property files, so
+   processes on a node hold them once. Values then come back within
+   maxerr, if not NULL set to the largest decoding error over all
+   volumes. Without this call the model keeps full precision. Call
+   before the context is shared between threads.
+   Returns 1 when the volumes are paged, and 2 when a cache is missing
+   or no longer matches its property file or cell order. The model
+   then keeps full precision */
+int vx_model_quantize(vx_model_t *m, double *maxerr)
+{
+  vx_query_grid_t *g;
+  vx_query_q16_t q[2 * VX_MODEL_MAXVOXETS];
+  double err = 0.0;
+  int k, i, ncells, nq = 0, rc = 0;
+
+  if (m->nq > 0) {
+    for (i = 0; i < m->nq; i++) {
+      err = (m->q[i].maxerr > err) ? m->q[i].maxerr : err;
+    }
+    if (maxerr != NULL) {
+      *maxerr = err;
+    }
+    return(0);
+  }
+  for (k = 0; k < m->ngrids; k++) {
+    g = &m->grids[k];
+    if (g->vp == NULL) {
+      /* Paged volumes stay as they are */
+      rc = 1;
+      break;
+    }
+    ncells = (int)vx_query_ncells(g);
+    if (vx_model_q16(m, m->fn[2*k], g->brick.bdim, ncells, g->nodata,
+		     &q[nq]) != 0) {
+      fprintf(stderr, "No current 16-bit cache %s%s, write it with "
+	      "vx_mknative_cvmhsgbn -q\n", m->fn[2*k], VX_IO_Q16_SUFFIX);
+      rc = 2;
+      break;
+    }
+    err = (q[nq].maxerr > err) ? q[nq].maxerr : err;
+    nq++;
+    if (g->vs == NULL) {
+      continue;
+    }
+    if (vx_model_q16(m, m->fn[2*k+1], g->brick.bdim, ncells,
+		     m->vsnodata[k], &q[nq]) != 0) {
+      fprintf(stderr, "No current 16-bit cache %s%s, write it with "
+	      "vx_mknative_cvmhsgbn -q\n", m->fn[2*k+1], VX_IO_Q16_SUFFIX);
+      rc = 2;
+      break;
+    }
+    err = (q[nq].maxerr > err) ? q[nq].maxerr : err;
+    nq++;
+  }
+  if (k < m->ngrids) {
+    for (i = 0; i < nq; i++) {
+      vx_io_unmapvolume((char *)q[i].code);
+    }
+    return(rc);
+  }
+
+  memcpy(m->q, q, nq * sizeof(vx_query_q16_t));
+  m->nq = nq;
+  nq = 0;
+  for (k = 0; k < m->ngrids; k++) {
+    g = &m->grids[k];
+    g->qvp = &m->q[nq++];
+    if (g->vs != NULL) {
+      g->qvs = &m->q[nq++];
+    }
+    g->vp = NULL;
+    g->vs = NULL;
+  }
+  for (i = 0; i < m->nmaps; i++) {
+    vx_io_unmapvolume(m->maps[i]);
+  }
+  m->nmaps = 0;
+  for (i = 0; i < m->ncopies; i++) {
+    free(m->copies[i]);
+  }
+  m->ncopies = 0;
+  if (maxerr != NULL) {
+    *maxerr = err;
+  }
+  return(0);
+}
+
+
+/* Load the model surfaces from interfaces voxet vo in data_dir, NULL
+   for VX_SURF_VO. Call before the context is shared between threads */
+int vx_model_setsurfaces(vx_model_t *m, const char *data_dir, const char *vo)
+{
+  vx_surf_t *s;
+
+  s = vx_surf_load(data_dir, vo);
+  if (s == NULL) {
+    return(1);
+  }
+  vx_surf_free(m->surf);
+  m->surf = s;
+  vx_model_newgen(m);
+  return(0);
+}
+
+
+/* Surface values at n lon/lat (degrees) locations into out,
+   VX_SURF_NUM per location in the order of vx_surf.h. Returns 1 if
+   the model has no surfaces */
+int vx_model_surface(const vx_model_t *m, const double *lon,
+		     const double *lat, double *out, int n)
+{
+  double x[VX_QUERY_BLOCK], y[VX_QUERY_BLOCK];
+  int b, k;
+
+  if (m->surf == NULL) {
+    return(1);
+  }
+  for (b = 0; b < n; b += VX_QUERY_BLOCK) {
+    k = (n - b < VX_QUERY_BLOCK) ? n - b : VX_QUERY_BLOCK;
+    vx_model_geo2utm(m, &lon[b], &lat[b], x, y, k);
+    vx_surf_query(m->surf, x, y, &out[b * VX_SURF_NUM], k);
+  }
+  return(0);
+}
+
+
+/* Take z of queries as elevation (VX_MODEL_ZMODE_ELEV, the default)
+   or as depth below the model surface (VX_MODEL_ZMODE_DEPTH), which
+   needs surfaces loaded with vx_model_setsurfaces. Call before the
+   context is shared between threads. Returns 1 on an unknown mode or
+   a depth mode without surfaces */
+int vx_model_setzmode(vx_model_t *m, int zmode)
+{
+  if ((zmode != VX_MODEL_ZMODE_ELEV) && (zmode != VX_MODEL_ZMODE_DEPTH)) {
+    return(1);
+  }
+  if ((zmode == VX_MODEL_ZMODE_DEPTH) && (m->surf == NULL)) {
+    return(1);
+  }
+  m->zmode = zmode;
+  return(0);
+}
+
+
+/* Elevation depths are measured from at a location with surface
+   values surf, topo_dem or where it has no data model_top. NaN,
+   which no grid covers, where neither has data */
+static double vx_model_top(const vx_model_t *m, const double *surf)
+{
+  if (surf[VX_SURF_TOPO] != m->surf->nodata) {
+    return(surf[VX_SURF_TOPO]);
+  }
+  if (surf[VX_SURF_TOP] != m->surf->nodata) {
+    return(surf[VX_SURF_TOP]);
+  }
+  return(NAN);
+}
+
+
+/* Elevations of up to VX_QUERY_BLOCK depths z at UTM x, y */
+static void vx_model_depth(const vx_model_t *m, const double *x,
+			   const double *y, const double *z, double *elev,
+			   int k)
+{
+  double surf[VX_QUERY_BLOCK * VX_SURF_NUM];
+  int p;
+
+  vx_surf_query(m->surf, x, y, surf, k);
+  for (p = 0; p < k; p++) {
+    elev[p] = vx_model_top(m, &surf[p * VX_SURF_NUM]) - z[p];
+  }
+}
+
+
+/* Build the column block cover of every voxet, blocks of 1 << shift
+   columns square. Points in blocks without data skip the volume
+   reads of that voxet. Reads every vp volume once, call before the
+   context is shared between threads */
+int vx_model_setcover(vx_model_t *m, int shift)
+{
+  int g;
+
+  vx_model_newgen(m);
+  for (g = 0; g < m->ngrids; g++) {
+    if (vx_query_setcover(&m->grids[g], shift) != 0) {
+      return(1);
+    }
+  }
+  return(0);
+}
+
+
+/* Whether lon/lat (degrees) is inside the box of the model voxets */
+static int vx_model_inbox(const vx_model_t *m, double lon, double lat)
+{
+  return((lon >= m->geo[0]) && (lon <= m->geo[1]) && (lat >= m->geo[2]) &&
+	 (lat <= m->geo[3]));
+}
+
+
+/* Query one block of k points inside the model box */
+static int vx_model_block(const vx_model_t *m, const double *lon,
+			  const double *lat, const double *z, double *vp,
+			  double *vs, double *rho, int *src, int k)
+{
+  double x[VX_QUERY_BLOCK], y[VX_QUERY_BLOCK], elev[VX_QUERY_BLOCK];
+
+  vx_model_geo2utm(m, lon, lat, x, y, k);
+  if (m->zmode == VX_MODEL_ZMODE_DEPTH) {
+    vx_model_depth(m, x, y, z, elev, k);
+    z = elev;
+  }
+  return(vx_query_batch(m->grids, m->ngrids, x, y, z, vp, vs, rho, src, k));
+}
+
+
+/* Query n lon/lat (degrees) and elevation (m) points, depths with
+   VX_MODEL_ZMODE_DEPTH. Outputs are as for vx_query_batch, returns
+   the number of points without data.
+   Any output may be NULL, vs and rho are then not read or computed.
+   Points outside the lon/lat box of the voxets get no data without
+   being converted, the rest of their block is packed and queried */
+int vx_model_query(const vx_model_t *m, const double *lon, const double *lat,
+		   const double *z, double *vp, double *vs, double *rho,
+		   int *src, int n)
+{
+  double plon[VX_QUERY_BLOCK], plat[VX_QUERY_BLOCK], pz[VX_QUERY_BLOCK];
+  double pvp[VX_QUERY_BLOCK], pvs[VX_QUERY_BLOCK], prho[VX_QUERY_BLOCK];
+  int sel[VX_QUERY_BLOCK], psrc[VX_QUERY_BLOCK];
+  double *bvp, *bvs, *brho;
+  int *bsrc;
+  int b, k, p, q, nin;
+  int missing = 0;
+
+  for (b = 0; b < n; b += VX_QUERY_BLOCK) {
+    k = (n - b < VX_QUERY_BLOCK) ? n - b : VX_QUERY_BLOCK;
+    nin = 0;
+    for (p = 0; p < k; p++) {
+      if (vx_model_inbox(m, lon[b+p], lat[b+p])) {
+	sel[nin++] = p;
+      }
+    }
+    if (nin == k) {
+      /* vp and src are needed to pick the voxet of each point */
+      bvp = (vp != NULL) ? &vp[b] : pvp;
+      bsrc = (src != NULL) ? &src[b] : psrc;
+      missing += vx_model_block(m, &lon[b], &lat[b], &z[b], bvp,
+				VX_MODEL_AT(vs, b), VX_MODEL_AT(rho, b), bsrc,
+				k);
+      continue;
+    }
+
+    for (p = 0; p < k; p++) {
+      if (vp != NULL) {
+	vp[b+p] = NIL;
+      }
+      if (vs != NULL) {
+	vs[b+p] = NIL;
+      }
+      if (rho != NULL) {
+	rho[b+p] = NIL;
+      }
+      if (src != NULL) {
+	src[b+p] = -1;
+      }
+    }
+    missing += k - nin;
+    if (nin == 0) {
+      continue;
+    }
+    for (q = 0; q < nin; q++) {
+      plon[q] = lon[b+sel[q]];
+      plat[q] = lat[b+sel[q]];
+      pz[q] = z[b+sel[q]];
+    }
+    bvs = (vs != NULL) ? pvs : NULL;
+    brho = (rho != NULL) ? prho : NULL;
+    missing += vx_model_block(m, plon, plat, pz, pvp, bvs, brho, psrc, nin);
+    for (q = 0; q < nin; q++) {
+      if (vp != NULL) {
+	vp[b+sel[q]] = pvp[q];
+      }
+      if (vs != NULL) {
+	vs[b+sel[q]] = pvs[q];
+      }
+      if (rho != NULL) {
+	rho[b+sel[q]] = prho[q];
+      }
+      if (src != NULL) {
+	src[b+sel[q]] = psrc[q];
+      }
+    }
+  }
+  return(missing);
+}
+
+
+/* Sort n points on their keys, LSD radix sort of VX_MODEL_SORT_BITS
+   digits skipping the high digits no key differs in. tmp holds n
+   points, returns whichever of ord and tmp ends up sorted */
+static vx_model_order_t *vx_model_sort(vx_model_order_t *ord,
+				       vx_model_order_t *tmp, int n)
+{
+  int count[1 << VX_MODEL_SORT_BITS];
+  vx_model_order_t *t;
+  uint64_t diff = 0;
+  int d, i, c, sum, digit;
+
+  for (i = 1; i < n; i++) {
+    diff |= ord[i].key ^ ord[0].key;
+  }
+  for (d = 0; (d < 64) && ((diff >> d) != 0); d += VX_MODEL_SORT_BITS) {
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++) {
+      count[(ord[i].key >> d) & ((1 << VX_MODEL_SORT_BITS) - 1)]++;
+    }
+    sum = 0;
+    for (i = 0; i < (1 << VX_MODEL_SORT_BITS); i++) {
+      c = count[i];
+      count[i] = sum;
+      sum += c;
+    }
+    for (i = 0; i < n; i++) {
+      digit = (ord[i].key >> d) & ((1 << VX_MODEL_SORT_BITS) - 1);
+      tmp[count[digit]++] = ord[i];
+    }
+    t = ord;
+    ord = tmp;
+    tmp = t;
+  }
+  return(ord);
+}
+
+
+/* vx_model_query visiting the points of each VX_MODEL_SORT_WINDOW
+   window in Morton order of their cells in the first voxet, results
+   come back in caller order. Points in scan line or random order then
+   reach neighbouring cells one after another instead of jumping
+   across the volumes. Sorting costs about 50 ns a point, so this only
+   pays when volume reads miss the cache far more often than the
+   window's own arrays do, as for random points over volumes many
+   times the cache. Outputs may be NULL as for vx_model_query, falls
+   back to it when out of memory */
+int vx_model_query_sorted(const vx_model_t *m, const double *lon,
+			  const double *lat, const double *z, double *vp,
+			  double *vs, double *rho, int *src, int n)
+{
+  vx_model_order_t *ord, *tmp, *s;
+  uint64_t *key;
+  double *x, *y, *sx, *sy, *sz, *svp, *svs, *srho, *ze;
+  int *ssrc;
+  int b, k, w, p, q;
+  int missing = 0;
+
+  w = (n < VX_MODEL_SORT_WINDOW) ? n : VX_MODEL_SORT_WINDOW;
+  if (w <= 0) {
+    return(0);
+  }
+  ord = malloc(2 * (size_t)w * sizeof(vx_model_order_t));
+  key = malloc(w * sizeof(uint64_t));
+  x = malloc(9 * (size_t)w * sizeof(double));
+  ssrc = malloc(w * sizeof(int));
+  if ((ord == NULL) || (key == NULL) || (x == NULL) || (ssrc == NULL)) {
+    free(ord);
+    free(key);
+    free(x);
+    free(ssrc);
+    return(vx_model_query(m, lon, lat, z, vp, vs, rho, src, n));
+  }
+  tmp = ord + w;
+  y = x + w;
+  sx = y + w;
+  sy = sx + w;
+  sz = sy + w;
+  svp = sz + w;
+  svs = svp + w;
+  srho = svs + w;
+  ze = srho + w;
+
+  for (b = 0; b < n; b += w) {
+    k = (n - b < w) ? n - b : w;
+    for (p = 0; p < k; p += VX_QUERY_BLOCK) {
+      q = (k - p < VX_QUERY_BLOCK) ? k - p : VX_QUERY_BLOCK;
+      vx_model_geo2utm(m, &lon[b+p], &lat[b+p], &x[p], &y[p], q);
+      if (m->zmode == VX_MODEL_ZMODE_DEPTH) {
+	vx_model_depth(m, &x[p], &y[p], &z[b+p], &ze[p], q);
+      } else {
+	memcpy(&ze[p], &z[b+p], q * sizeof(double));
+      }
+    }
+    vx_query_morton(&m->grids[0], x, y, ze, key, k);
+    for (p = 0; p < k; p++) {
+      ord[p].key = key[p];
+      ord[p].p = p;
+    }
+    s = vx_model_sort(ord, tmp, k);
+    for (q = 0; q < k; q++) {
+      sx[q] = x[s[q].p];
+      sy[q] = y[s[q].p];
+      sz[q] = ze[s[q].p];
+    }
+
+    missing += vx_query_batch(m->grids, m->ngrids, sx, sy, sz, svp,
+			      (vs != NULL) ? svs : NULL,
+			      (rho != NULL) ? srho : NULL, ssrc, k);
+    for (q = 0; q < k; q++) {
+      p = b + s[q].p;
+      if (vp != NULL) {
+	vp[p] = svp[q];
+      }
+      if (vs != NULL) {
+	vs[p] = svs[q];
+      }
+      if (rho != NULL) {
+	rho[p] = srho[q];
+      }
+      if (src != NULL) {
+	src[p] = ssrc[q];
+      }
+    }
+  }
+
+  free(ord);
+  free(key);
+  free(x);
+  free(ssrc);
+  return(missing);
+}
+
+
+/* Query a vertical profile of n elevations (m), depths with
+   VX_MODEL_ZMODE_DEPTH, below one lon/lat (degrees) location. The
+   location and its surfaces are converted once, outputs are as for
+   vx_query_batch.
+   Any output may be NULL as for vx_model_query */
+int vx_model_profile(const vx_model_t *m, double lon, double lat,
+		     const double *z, double *vp, double *vs, double *rho,
+		     int *src, int n)
+{
+  double elev[VX_QUERY_BLOCK], pvp[VX_QUERY_BLOCK], surf[VX_SURF_NUM];
+  int psrc[VX_QUERY_BLOCK];
+  const double *bz;
+  double x = 0.0, y = 0.0, top = 0.0;
+  int b, k, p, ngrids = 0;
+  int missing = 0;
+
+  /* Locations outside the model box query no grids */
+  if (vx_model_inbox(m, lon, lat)) {
+    vx_model_geo2utm(m, &lon, &lat, &x, &y, 1);
+    ngrids = m->ngrids;
+    if (m->zmode == VX_MODEL_ZMODE_DEPTH) {
+      vx_surf_query(m->surf, &x, &y, surf, 1);
+      top = vx_model_top(m, surf);
+    }
+  }
+
+  for (b = 0; b < n; b += VX_QUERY_BLOCK) {
+    k = (n - b < VX_QUERY_BLOCK) ? n - b : VX_QUERY_BLOCK;
+    bz = &z[b];
+    if ((ngrids > 0) && (m->zmode == VX_MODEL_ZMODE_DEPTH)) {
+      for (p = 0; p < k; p++) {
+	elev[p] = top - z[b+p];
+      }
+      bz = elev;
+    }
+    /* vp and src are needed to pick the voxet of each point */
+    missing += vx_query_profile(m->grids, ngrids, x, y, bz,
+				(vp != NULL) ? &vp[b] : pvp,
+				VX_MODEL_AT(vs, b), VX_MODEL_AT(rho, b),
+				(src != NULL) ? &src[b] : psrc, k);
+  }
+  return(missing);
+}
+
+
+/* Create a horizontal cache of at least size locations, rounded up
+   to a power of two, <= 0 for VX_MODEL_CACHE_SIZE */
+vx_model_cache_t *vx_model_cache_new(int size)
+{
+  vx_model_cache_t *c;
+  int n = 1;
+
+  if (size <= 0) {
+    size = VX_MODEL_CACHE_SIZE;
+  }
+  while (n < size) {
+    n *= 2;
+  }
+  c = calloc(1, sizeof(vx_model_cache_t));
+  if (c == NULL) {
+    return(NULL);
+  }
+  c->entries = calloc(n, sizeof(vx_model_entry_t));
+  if (c->entries == NULL) {
+    free(c);
+    return(NULL);
+  }
+  c->mask = n - 1;
+  return(c);
+}
+
+
+/* Hit and miss counts of a cache since it was created */
+void vx_model_cache_stats(const vx_model_cache_t *c, long *hits,
+			  long *misses)
+{
+  *hits = c->hits;
+  *misses = c->misses;
+}
+
+
+/* Free a horizontal cache */
+void vx_model_cache_free(vx_model_cache_t *c)
+{
+  if (c == NULL) {
+    return;
+  }
+  free(c->entries);
+  free(c);
+}
+
+
+/* Cache entry of a location, filled in on a miss */
+static const vx_model_entry_t *vx_model_cache_get(const vx_model_t *m,
+						  vx_model_cache_t *c,
+						  double lon, double lat)
+{
+  vx_model_entry_t *e;
+  uint64_t blon, blat, h;
+  int k;
+
+  memcpy(&blon, &lon, sizeof(uint64_t));
+  memcpy(&blat, &lat, sizeof(uint64_t));
+  h = (blon * 0x9E3779B97F4A7C15ULL) ^ (blat * 0xC2B2AE3D27D4EB4FULL);
+  e = &c->entries[(h ^ (h >> 29)) & c->mask];
+  if (e->valid && (e->lon == blon) && (e->lat == blat)) {
+    c->hits++;
+    return(e);
+  }
+
+  c->misses++;
+  e->lon = blon;
+  e->lat = blat;
+  e->valid = 1;
+  vx_model_geo2utm(m, &lon, &lat, &e->x, &e->y, 1);
+  for (k = 0; k < m->ngrids; k++) {
+    e->col[k] = vx_query_column(&m->grids[k], e->x, e->y);
+  }
+  if (m->surf != NULL) {
+    vx_surf_query(m->surf, &e->x, &e->y, e->surf, 1);
+  }
+  return(e);
+}
+
+
+/* Start cache c over unless its entries are from the current
+   generation of model m */
+static void vx_model_cache_follow(const vx_model_t *m, vx_model_cache_t *c)
+{
+  if (c->gen != m->gen) {
+    memset(c->entries, 0, (c->mask + 1) * sizeof(vx_model_entry_t));
+    c->gen = m->gen;
+  }
+}
+
+
+/* vx_model_query through a horizontal cache. Locations found in the
+   cache skip the coordinate transform, horizontal cell search and,
+   for depths, the surface lookup.
+   Any output may be NULL as for vx_model_query */
+int vx_model_query_cached(const vx_model_t *m, vx_model_cache_t *c,
+			  const double *lon, const double *lat,
+			  const double *z, double *vp, double *vs,
+			  double *rho, int *src, int n)
+{
+  int cols[VX_QUERY_BLOCK * VX_MODEL_MAXVOXETS];
+  double pvp[VX_QUERY_BLOCK], elev[VX_QUERY_BLOCK];
+  int psrc[VX_QUERY_BLOCK];
+  const vx_model_entry_t *e;
+  int b, k, p, g;
+  int missing = 0;
+
+  vx_model_cache_follow(m, c);
+  for (b = 0; b < n; b += VX_QUERY_BLOCK) {
+    k = (n - b < VX_QUERY_BLOCK) ? n - b : VX_QUERY_BLOCK;
+    for (p = 0; p < k; p++) {
+      e = vx_model_cache_get(m, c, lon[b+p], lat[b+p]);
+      for (g = 0; g < m->ngrids; g++) {
+	cols[p * m->ngrids + g] = e->col[g];
+      }
+      elev[p] = (m->zmode == VX_MODEL_ZMODE_DEPTH) ?
+	vx_model_top(m, e->surf) - z[b+p] : z[b+p];
+    }
+    /* vp and src are needed to pick the voxet of each point */
+    missing += vx_query_columns(m->grids, m->ngrids, cols, elev,
+				(vp != NULL) ? &vp[b] : pvp,
+				VX_MODEL_AT(vs, b), VX_MODEL_AT(rho, b),
+				(src != NULL) ? &src[b] : psrc, k);
+  }
+  return(missing);
+}
+
+
+/* vx_model_surface through a horizontal cache, locations found in
+   the cache reuse their surface values. Returns 1 if the model has no
+   surfaces */
+int vx_model_surface_cached(const vx_model_t *m, vx_model_cache_t *c,
+			    const double *lon, const double *lat,
+			    double *out, int n)
+{
+  const vx_model_entry_t *e;
+  int p;
+
+  if (m->surf == NULL) {
+    return(1);
+  }
+  vx_model_cache_follow(m, c);
+  for (p = 0; p < n; p++) {
+    e = vx_model_cache_get(m, c, lon[p], lat[p]);
+    memcpy(&out[p * VX_SURF_NUM], e->surf, sizeof(e->surf));
+  }
+  return(0);
+}
+
+
+/* Close a model and release its volumes */
+void vx_model_close(vx_model_t *m)
+{
+  int i;
+
+  if (m == NULL) {
+    return;
+  }
+  for (i = 0; i < m->nmaps; i++) {
+    vx_io_unmapvolume(m->maps[i]);
+  }
+  for (i = 0; i < m->ncopies; i++) {
+    free(m->copies[i]);
+  }
+  for (i = 0; i < m->ngrids; i++) {
+    vx_query_freecover(&m->grids[i]);
+    vx_lazy_close(m->grids[i].lazy[0]);
+    vx_lazy_close(m->grids[i].lazy[1]);
+  }
+  for (i = 0; i < m->nq; i++) {
+    vx_io_unmapvolume((char *)m->q[i].code);
+  }
+  vx_utm_grid_free(m->lookup);
+  vx_surf_free(m->surf);
+  free(m);
+}
+
+
+/* Open the default model used by the legacy entry points */
+int vx_model_init(const char *data_dir)
+{
+  if (vx_model_dflt != NULL) {
+    return(0);
+  }
+  vx_model_dflt = vx_model_open(data_dir, NULL, 0);
+  if (vx_model_dflt == NULL) {
+    return(1);
+  }
+  vx_model_dflt_cache = vx_model_cache_new(0);
+  if (vx_model_dflt_cache == NULL) {
+    vx_model_finalize();
+    return(1);
+  }
+  return(0);
+}
+
+
+/* Default model, NULL before vx_model_init */
+vx_model_t *vx_model_default()
+{
+  return(vx_model_dflt);
+}
+
+
+/* Cache of the default model, NULL before vx_model_init */
+vx_model_cache_t *vx_model_default_cache()
+{
+  return(vx_model_dflt_cache);
+}
+
+
+/* Close the default model */
+int vx_model_finalize()
+{
+  vx_model_cache_free(vx_model_dflt_cache);
+  vx_model_dflt_cache = NULL;
+  vx_model_close(vx_model_dflt);
+  vx_model_dflt = NULL;
+  return(0);
+}
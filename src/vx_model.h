@@ -0,0 +1,132 @@
+#ifndef VX_MODEL_H
+#define VX_MODEL_H
+
+#include "vx_query.h"
+
+/* Most voxets a model context holds */
+#define VX_MODEL_MAXVOXETS 8
+
+/* Meaning of z in model queries */
+#define VX_MODEL_ZMODE_ELEV 0   /* elevation, meters above sea level */
+#define VX_MODEL_ZMODE_DEPTH 1  /* depth below topo_dem, meters */
+
+/* Default locations held by a horizontal cache */
+#define VX_MODEL_CACHE_SIZE 1024
+
+
+/* Loaded model, read-only once open and safe to query from many
+   threads at once */
+typedef struct vx_model_t vx_model_t;
+
+
+/* Horizontal location cache, for use by one thread at a time */
+typedef struct vx_model_cache_t vx_model_cache_t;
+
+
+/* Open the voxets of a model, in priority order. NULL selects
+   the CVMHSGBN basin, CVMSM and CVM_CM voxets */
+vx_model_t *vx_model_open(const char *, const char **, int);
+
+
+/* Open the voxets of a model with their volumes paged in bricks */
+vx_model_t *vx_model_openlazy(const char *, const char **, int, int, int);
+
+
+/* Hold vp and vs in brick order */
+int vx_model_setbricks(vx_model_t *, int);
+
+
+/* Answer lon/lat to UTM through a lookup grid over the first voxet */
+int vx_model_setlookup(vx_model_t *, double, double *);
+
+
+/* Select the exact or vector UTM path of queries */
+int vx_model_setutmmode(vx_model_t *, int);
+
+
+/* Write the 16-bit caches of vp and vs */
+int vx_model_writeq16(const vx_model_t *);
+
+
+/* Hold vp and vs in 16-bit fixed point, mapped from their caches */
+int vx_model_quantize(vx_model_t *, double *);
+
+
+/* Skip voxet reads in column blocks without data */
+int vx_model_setcover(vx_model_t *, int);
+
+
+/* Load the model surfaces from an interfaces voxet */
+int vx_model_setsurfaces(vx_model_t *, const char *, const char *);
+
+
+/* Take z of queries as elevation or depth */
+int vx_model_setzmode(vx_model_t *, int);
+
+
+/* Surface values at lon/lat (degrees) locations */
+int vx_model_surface(const vx_model_t *, const double *, const double *,
+		     double *, int);
+
+
+/* Query lon/lat (degrees) and elevation (m) points, NULL outputs are
+   skipped */
+int vx_model_query(const vx_model_t *, const double *, const double *,
+		   const double *, double *, double *, double *, int *, int);
+
+
+/* vx_model_query with the points visited in space filling curve order */
+int vx_model_query_sorted(const vx_model_t *, const double *, const double *,
+			  const double *, double *, double *, double *, int *,
+			  int);
+
+
+/* Query elevations (m) below one lon/lat (degrees) location, NULL
+   outputs are skipped */
+int vx_model_profile(const vx_model_t *, double, double, const double *,
+		     double *, double *, double *, int *, int);
+
+
+/* Create a horizontal cache */
+vx_model_cache_t *vx_model_cache_new(int);
+
+
+/* Query lon/lat (degrees) and elevation (m) points through a cache */
+int vx_model_query_cached(const vx_model_t *, vx_model_cache_t *,
+			  const double *, const double *, const double *,
+			  double *, double *, double *, int *, int);
+
+
+/* Surface values at lon/lat (degrees) locations through a cache */
+int vx_model_surface_cached(const vx_model_t *, vx_model_cache_t *,
+			    const double *, const double *, double *, int);
+
+
+/* Hit and miss counts of a cache */
+void vx_model_cache_stats(const vx_model_cache_t *, long *, long *);
+
+
+/* Free a horizontal cache */
+void vx_model_cache_free(vx_model_cache_t *);
+
+
+/* Close a model and release its volumes */
+void vx_model_close(vx_model_t *);
+
+
+/* Open the default model used by the legacy entry points */
+int vx_model_init(const char *);
+
+
+/* Default model, NULL before vx_model_init */
+vx_model_t *vx_model_default();
+
+
+/* Cache of the default model, NULL before vx_model_init */
+vx_model_cache_t *vx_model_default_cache();
+
+
+/* Close the default model */
+int vx_model_finalize();
+
+#endif
@@ -0,0 +1,764 @@
+/** vx_query.c - Batched voxet queries
+
+    Points are handled a block at a time, each step (UTM conversion,
+    cell indexing, property fetch, density) runs over the whole block
+    before the next one starts. Grids are tried in priority order and
+    a point keeps the first grid with data at its cell.
+**/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "params.h"
+#include "vx_query.h"
+#include "vx_utm.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VX_QUERY_X86 1
+#include <immintrin.h>
+#include <pthread.h>
+#endif
+
+#define VX_QUERY_INLINE static inline __attribute__((always_inline))
+
+#ifdef VX_QUERY_X86
+/* Instruction sets of this cpu, found once for every thread */
+static int vx_query_avx2 = 0;
+static int vx_query_fma = 0;
+static pthread_once_t vx_query_once = PTHREAD_ONCE_INIT;
+
+static void vx_query_cpuinit()
+{
+  __builtin_cpu_init();
+  vx_query_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  vx_query_fma = (vx_query_avx2 && __builtin_cpu_supports("fma")) ? 1 : 0;
+}
+#endif
+
+/* Set up a grid from voxet axis information. vs may be NULL */
+int vx_query_setgrid(vx_query_grid_t *g, const struct axis *a,
+		     const float *vp, const float *vs, float nodata)
+{
+  double span[3];
+  int i;
+
+  span[0] = a->U[0];
+  span[1] = a->V[1];
+  span[2] = a->W[2];
+  for (i = 0; i < 3; i++) {
+    if (a->N[i] <= 0) {
+      return(1);
+    }
+    g->O[i] = a->O[i];
+    g->N[i] = a->N[i];
+    g->step[i] = (a->N[i] > 1) ? span[i] / (a->N[i] - 1) : 1.0;
+    g->rstep[i] = 1.0 / g->step[i];
+    g->lim[i] = a->N[i];
+  }
+  g->stride[0] = a->N[0];
+  g->stride[1] = a->N[0] * a->N[1];
+  g->vp = vp;
+  g->vs = vs;
+  g->nodata = nodata;
+  g->qvp = NULL;
+  g->qvs = NULL;
+  g->cover = NULL;
+  g->cover_shift = 0;
+  g->cover_n = 0;
+  memset(&g->brick, 0, sizeof(vx_brick_layout_t));
+  g->lazy[0] = NULL;
+  g->lazy[1] = NULL;
+  return(0);
+}
+
+
+/* Index volumes of grid g in brick order with bricks bdim cells on a
+   side (<= 0 for VX_BRICK_DIM). The volumes, and any 16-bit forms,
+   must then hold vx_query_ncells cells as vx_brick_relayout lays
+   them out. The cells down a column then share a few bricks instead
+   of lying a depth slice apart */
+int vx_query_setbricks(vx_query_grid_t *g, int bdim)
+{
+  return(vx_brick_setup(&g->brick, g->N, bdim));
+}
+
+
+/* Cells held by each volume of grid g, bricked volumes are padded to
+   whole bricks */
+size_t vx_query_ncells(const vx_query_grid_t *g)
+{
+  if (g->brick.bdim > 0) {
+    return((size_t)g->brick.nb[0] * g->brick.nb[1] * g->brick.nb[2] *
+	   g->brick.bcells);
+  }
+  return((size_t)g->N[0] * g->N[1] * g->N[2]);
+}
+
+
+/* Offset of depth slice k and of column i, j in the volumes of grid
+   g, the index of cell i, j, k is their sum in linear and in brick
+   order alike */
+VX_QUERY_INLINE int vx_query_slice(const vx_query_grid_t *g, int k)
+{
+  if (g->brick.bdim > 0) {
+    return((int)vx_brick_index(&g->brick, 0, 0, k));
+  }
+  return(k * g->stride[1]);
+}
+
+
+VX_QUERY_INLINE int vx_query_col(const vx_query_grid_t *g, int i, int j)
+{
+  if (g->brick.bdim > 0) {
+    return((int)vx_brick_index(&g->brick, i, j, 0));
+  }
+  return(j * g->stride[0] + i);
+}
+
+
+/* Whether grid g has a vs volume in any form */
+#define VX_QUERY_HASVS(g) (((g)->vs != NULL) || ((g)->qvs != NULL) || \
+			   ((g)->lazy[1] != NULL))
+
+
+/* Fetch n cells of volume v (0 for vp, 1 for vs) of grid g by index
+   into out from whichever form the grid holds, cells at index -1
+   get fill */
+static void vx_query_fetch(const vx_query_grid_t *g, int v, const int *idx,
+			   double *out, int n, float fill)
+{
+  const vx_query_q16_t *q = (v == 0) ? g->qvp : g->qvs;
+  const float *vol = (v == 0) ? g->vp : g->vs;
+
+  if (q != NULL) {
+    vx_query_gather16(q, idx, out, n, fill);
+  } else if (vol != NULL) {
+    vx_query_gather(vol, idx, out, n, fill);
+  } else {
+    vx_lazy_gather(g->lazy[v], idx, out, n, fill);
+  }
+}
+
+
+/* Build the cover of grid g, one flag per block of 1 << shift by
+   1 << shift columns telling whether any cell in the block has vp
+   data. Points in empty blocks are then rejected at indexing, before
+   any volume access. Reads the whole vp volume once */
+int vx_query_setcover(vx_query_grid_t *g, int shift)
+{
+  unsigned char *cover;
+  int *idx, *blk;
+  double *cell;
+  int b[3], i0, j0, k0, i, j, k, ni, nj, n, p;
+
+  if ((shift < 0) || (shift > 16)) {
+    return(1);
+  }
+  ni = ((g->N[0] - 1) >> shift) + 1;
+  nj = ((g->N[1] - 1) >> shift) + 1;
+
+  /* Volumes are read a row, or a brick, at a time */
+  b[0] = (g->brick.bdim > 0) ? g->brick.bdim : g->N[0];
+  b[1] = (g->brick.bdim > 0) ? g->brick.bdim : 1;
+  b[2] = b[1];
+  cover = calloc(ni * nj, sizeof(unsigned char));
+  idx = malloc((size_t)b[0] * b[1] * b[2] * sizeof(int));
+  blk = malloc((size_t)b[0] * b[1] * b[2] * sizeof(int));
+  cell = malloc((size_t)b[0] * b[1] * b[2] * sizeof(double));
+  if ((cover == NULL) || (idx == NULL) || (blk == NULL) || (cell == NULL)) {
+    free(cover);
+    free(idx);
+    free(blk);
+    free(cell);
+    return(1);
+  }
+  for (k0 = 0; k0 < g->N[2]; k0 += b[2]) {
+    for (j0 = 0; j0 < g->N[1]; j0 += b[1]) {
+      for (i0 = 0; i0 < g->N[0]; i0 += b[0]) {
+	n = 0;
+	for (k = k0; (k < k0 + b[2]) && (k < g->N[2]); k++) {
+	  for (j = j0; (j < j0 + b[1]) && (j < g->N[1]); j++) {
+	    for (i = i0; (i < i0 + b[0]) && (i < g->N[0]); i++, n++) {
+	      idx[n] = vx_query_slice(g, k) + vx_query_col(g, i, j);
+	      blk[n] = (j >> shift) * ni + (i >> shift);
+	    }
+	  }
+	}
+	vx_query_fetch(g, 0, idx, cell, n, g->nodata);
+	for (p = 0; p < n; p++) {
+	  if (cell[p] != g->nodata) {
+	    cover[blk[p]] = 1;
+	  }
+	}
+      }
+    }
+  }
+  free(idx);
+  free(blk);
+  free(cell);
+  vx_query_freecover(g);
+  g->cover = cover;
+  g->cover_shift = shift;
+  g->cover_n = ni;
+  return(0);
+}
+
+
+/* Free the cover of grid g */
+void vx_query_freecover(vx_query_grid_t *g)
+{
+  free((unsigned char *)g->cover);
+  g->cover = NULL;
+}
+
+
+/* Convert n lon/lat points (degrees) to UTM zone 11 (meters) on path
+   mode, VX_UTM_MODE_EXACT for the inlined zone 11 transform that
+   matches gctp to the bit or VX_UTM_MODE_VECTOR. Points with a
+   non-finite coordinate, a latitude beyond the poles or a non-finite
+   result get NaN, which no grid covers. Returns the number of such
+   points */
+int vx_query_geo2utm(int mode, const double *lon, const double *lat,
+		     double *x, double *y, int n)
+{
+  int p;
+  int bad = 0;
+
+  vx_utm11_fwd_batch(mode, lon, lat, x, y, n);
+  for (p = 0; p < n; p++) {
+    if (!(fabs(lat[p]) <= 90.0) || !isfinite(lon[p]) || !isfinite(x[p]) ||
+	!isfinite(y[p])) {
+      x[p] = NAN;
+      y[p] = NAN;
+      bad++;
+    }
+  }
+  return(bad);
+}
+
+
+/* Cell coordinate of x along axis i of grid g, offset by half a cell
+   so truncation gives the nearest cell. In the grid when in
+   0..lim[i] */
+#define VX_QUERY_CELL(g, i, x) (((x) - (g)->O[i]) * (g)->rstep[i] + 0.5)
+
+
+/* Nearest cell index of n points, -1 for points outside the grid or
+   in a column block the cover marks empty */
+void vx_query_index(const vx_query_grid_t *g, const double *x,
+		    const double *y, const double *z, int *idx, int n)
+{
+  double ci, cj, ck;
+  int i, j, p;
+
+  for (p = 0; p < n; p++) {
+    ci = VX_QUERY_CELL(g, 0, x[p]);
+    cj = VX_QUERY_CELL(g, 1, y[p]);
+    ck = VX_QUERY_CELL(g, 2, z[p]);
+    idx[p] = -1;
+    if ((ci >= 0.0) && (ci < g->lim[0]) && (cj >= 0.0) && (cj < g->lim[1]) &&
+	(ck >= 0.0) && (ck < g->lim[2])) {
+      i = (int)ci;
+      j = (int)cj;
+      if (VX_QUERY_COVERED(g, i, j)) {
+	idx[p] = vx_query_slice(g, (int)ck) + vx_query_col(g, i, j);
+      }
+    }
+  }
+}
+
+
+/* Scalar gather */
+static void vx_query_gather_scalar(const float *vol, const int *idx,
+				   double *out, int n, float nodata)
+{
+  int p;
+
+  for (p = 0; p < n; p++) {
+    out[p] = (idx[p] >= 0) ? vol[idx[p]] : nodata;
+  }
+}
+
+
+#ifdef VX_QUERY_X86
+/* Eight cells per masked hardware gather */
+__attribute__((target("avx2")))
+static void vx_query_gather_avx2(const float *vol, const int *idx,
+				 double *out, int n, float nodata)
+{
+  __m256i vi, mask;
+  __m256 v;
+  __m256 fill = _mm256_set1_ps(nodata);
+  int p;
+
+  for (p = 0; p + 8 <= n; p += 8) {
+    vi = _mm256_loadu_si256((const __m256i *)&idx[p]);
+    mask = _mm256_cmpgt_epi32(vi, _mm256_set1_epi32(-1));
+    v = _mm256_mask_i32gather_ps(fill, vol, vi, _mm256_castsi256_ps(mask), 4);
+    _mm256_storeu_pd(&out[p], _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+    _mm256_storeu_pd(&out[p+4], _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+  }
+  vx_query_gather_scalar(vol, &idx[p], &out[p], n - p, nodata);
+}
+#endif
+
+
+/* Fetch n volume cells by index into out, cells at index -1 get
+   nodata. Uses AVX2 gathers when the cpu has them */
+void vx_query_gather(const float *vol, const int *idx, double *out, int n,
+		     float nodata)
+{
+#ifdef VX_QUERY_X86
+  pthread_once(&vx_query_once, vx_query_cpuinit);
+  if (vx_query_avx2) {
+    vx_query_gather_avx2(vol, idx, out, n, nodata);
+    return;
+  }
+#endif
+  vx_query_gather_scalar(vol, idx, out, n, nodata);
+}
+
+
+/* Convert volume vol of ncells floats to 16-bit fixed point in q.
+   Values span codes 0 to VX_QUERY_Q16_NODATA - 1 between the
+   smallest and largest value with data, so the decoding error is at
+   most half a code step. Cells at nodata get VX_QUERY_Q16_NODATA and
+   decode to nodata exactly. q->maxerr gets the largest error actually
+   made. Returns 1 when out of memory */
+int vx_query_quantize(const float *vol, int ncells, float nodata,
+		      vx_query_q16_t *q)
+{
+  double lo = 0.0, hi = 0.0, v, err;
+  int i, first = 1;
+  long c;
+
+  /* One code of padding for the 32-bit gathers of the last cell */
+  q->code = malloc((ncells + 1) * sizeof(uint16_t));
+  if (q->code == NULL) {
+    return(1);
+  }
+  q->code[ncells] = VX_QUERY_Q16_NODATA;
+  for (i = 0; i < ncells; i++) {
+    if (vol[i] == nodata) {
+      continue;
+    }
+    if (first || (vol[i] < lo)) {
+      lo = vol[i];
+    }
+    if (first || (vol[i] > hi)) {
+      hi = vol[i];
+    }
+    first = 0;
+  }
+  q->offset = lo;
+  q->scale = (hi > lo) ? (hi - lo) / (VX_QUERY_Q16_NODATA - 1) : 1.0;
+  q->nodata = nodata;
+  q->maxerr = 0.0;
+  for (i = 0; i < ncells; i++) {
+    if (vol[i] == nodata) {
+      q->code[i] = VX_QUERY_Q16_NODATA;
+      continue;
+    }
+    c = lround((vol[i] - q->offset) / q->scale);
+    c = (c < VX_QUERY_Q16_NODATA - 1) ? c : VX_QUERY_Q16_NODATA - 1;
+    q->code[i] = (uint16_t)c;
+    v = q->offset + q->scale * c;
+    err = fabs(v - vol[i]);
+    q->maxerr = (err > q->maxerr) ? err : q->maxerr;
+  }
+  return(0);
+}
+
+
+/* Free the cells of a 16-bit volume */
+void vx_query_freeq16(vx_query_q16_t *q)
+{
+  free(q->code);
+  q->code = NULL;
+}
+
+
+/* Scalar 16-bit gather */
+static void vx_query_gather16_scalar(const vx_query_q16_t *q, const int *idx,
+				     double *out, int n, float fill)
+{
+  uint16_t c;
+  int p;
+
+  for (p = 0; p < n; p++) {
+    if (idx[p] < 0) {
+      out[p] = fill;
+      continue;
+    }
+    c = q->code[idx[p]];
+    out[p] = (c == VX_QUERY_Q16_NODATA) ? q->nodata :
+      q->offset + q->scale * c;
+  }
+}
+
+
+#ifdef VX_QUERY_X86
+/* Eight cells per masked hardware gather, each reads the 32 bits at
+   its code and keeps the low half (x86 is little endian) */
+__attribute__((target("avx2")))
+static void vx_query_gather16_avx2(const vx_query_q16_t *q, const int *idx,
+				   double *out, int n, float fill)
+{
+  __m256i vi, mask, c, nd, keep;
+  __m256d lo, hi, f, ndv, sel;
+  __m256d off = _mm256_set1_pd(q->offset);
+  __m256d scale = _mm256_set1_pd(q->scale);
+  __m256d nodata = _mm256_set1_pd(q->nodata);
+  __m256d fillv = _mm256_set1_pd(fill);
+  __m256i low16 = _mm256_set1_epi32(0xffff);
+  int p;
+
+  for (p = 0; p + 8 <= n; p += 8) {
+    vi = _mm256_loadu_si256((const __m256i *)&idx[p]);
+    mask = _mm256_cmpgt_epi32(vi, _mm256_set1_epi32(-1));
+    c = _mm256_mask_i32gather_epi32(low16, (const int *)q->code, vi, mask, 2);
+    c = _mm256_and_si256(c, low16);
+    nd = _mm256_cmpeq_epi32(c, low16);
+    /* Per lane: fill off the grid, nodata for the code, else decode */
+    lo = _mm256_add_pd(off, _mm256_mul_pd(scale,
+	   _mm256_cvtepi32_pd(_mm256_castsi256_si128(c))));
+    hi = _mm256_add_pd(off, _mm256_mul_pd(scale,
+	   _mm256_cvtepi32_pd(_mm256_extracti128_si256(c, 1))));
+    keep = _mm256_andnot_si256(mask, _mm256_set1_epi32(-1));
+    sel = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(nd)));
+    f = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(keep)));
+    ndv = _mm256_blendv_pd(lo, nodata, sel);
+    _mm256_storeu_pd(&out[p], _mm256_blendv_pd(ndv, fillv, f));
+    sel = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(nd, 1)));
+    f = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(keep, 1)));
+    ndv = _mm256_blendv_pd(hi, nodata, sel);
+    _mm256_storeu_pd(&out[p+4], _mm256_blendv_pd(ndv, fillv, f));
+  }
+  vx_query_gather16_scalar(q, &idx[p], &out[p], n - p, fill);
+}
+#endif
+
+
+/* Fetch n cells of 16-bit volume q by index into out, cells at index
+   -1 get fill. Uses AVX2 gathers when the cpu has them */
+void vx_query_gather16(const vx_query_q16_t *q, const int *idx, double *out,
+		       int n, float fill)
+{
+#ifdef VX_QUERY_X86
+  pthread_once(&vx_query_once, vx_query_cpuinit);
+  if (vx_query_avx2) {
+    vx_query_gather16_avx2(q, idx, out, n, fill);
+    return;
+  }
+#endif
+  vx_query_gather16_scalar(q, idx, out, n, fill);
+}
+
+
+/* Nafe-Drake density of n vp values in Horner form. The no data
+   select is arithmetic, a branch or conditional keeps the compiler
+   from vectorizing the loop */
+VX_QUERY_INLINE void vx_query_rho_kernel(const double *vp, double *rho,
+					 int n, double nodata)
+{
+  double v, r, s;
+  int p;
+
+  for (p = 0; p < n; p++) {
+    v = vp[p] * 0.001;
+    r = 1000.0 * v * (1.6612 + v * (-0.4721 + v * (0.0671 +
+						   v * (-0.0043 + v * 0.000106))));
+    s = (double)(vp[p] == nodata);
+    rho[p] = r + s * (nodata - r);
+  }
+}
+
+
+/* Baseline instruction set build of the density kernel */
+static void vx_query_rho_base(const double *vp, double *rho, int n,
+			      double nodata)
+{
+  vx_query_rho_kernel(vp, rho, n, nodata);
+}
+
+
+#ifdef VX_QUERY_X86
+/* AVX2 build of the density kernel, four points per instruction */
+__attribute__((target("avx2,fma")))
+static void vx_query_rho_avx2(const double *vp, double *rho, int n,
+			      double nodata)
+{
+  vx_query_rho_kernel(vp, rho, n, nodata);
+}
+#endif
+
+
+/* Nafe-Drake density of n vp values (m/s), within
+   VX_QUERY_RHO_MAXERR of the polynomial in power form. nodata
+   values are passed through */
+void vx_query_rho(const double *vp, double *rho, int n, double nodata)
+{
+#ifdef VX_QUERY_X86
+  pthread_once(&vx_query_once, vx_query_cpuinit);
+  if (vx_query_fma) {
+    vx_query_rho_avx2(vp, rho, n, nodata);
+    return;
+  }
+#endif
+  vx_query_rho_base(vp, rho, n, nodata);
+}
+
+
+/* Take the cells at idx of grid k for the points that have no data
+   yet, idx is set to -1 where the grid has no data. vs may be NULL */
+static void vx_query_take(const vx_query_grid_t *g, int k, int *idx,
+			  double *vp, double *vs, int *src, int m)
+{
+  double cell[VX_QUERY_BLOCK];
+  int p;
+
+  for (p = 0; p < m; p++) {
+    if (src[p] >= 0) {
+      idx[p] = -1;
+    }
+  }
+  vx_query_fetch(g, 0, idx, cell, m, g->nodata);
+  for (p = 0; p < m; p++) {
+    if ((idx[p] >= 0) && (cell[p] != g->nodata)) {
+      vp[p] = cell[p];
+      src[p] = k;
+    } else {
+      idx[p] = -1;
+    }
+  }
+  if ((vs != NULL) && VX_QUERY_HASVS(g)) {
+    vx_query_fetch(g, 1, idx, cell, m, NIL);
+    for (p = 0; p < m; p++) {
+      if (idx[p] >= 0) {
+	vs[p] = cell[p];
+      }
+    }
+  }
+}
+
+
+/* Reset a block of outputs to no data, vs may be NULL */
+static void vx_query_clear(double *vp, double *vs, int *src, int m)
+{
+  int p;
+
+  for (p = 0; p < m; p++) {
+    vp[p] = NIL;
+    src[p] = -1;
+  }
+  if (vs != NULL) {
+    for (p = 0; p < m; p++) {
+      vs[p] = NIL;
+    }
+  }
+}
+
+
+/* Density of a block, unless rho is NULL, and its count of points
+   without data */
+static int vx_query_finish(const double *vp, double *rho, const int *src,
+			   int m)
+{
+  int p;
+  int missing = 0;
+
+  if (rho != NULL) {
+    vx_query_rho(vp, rho, m, NIL);
+  }
+  for (p = 0; p < m; p++) {
+    if (src[p] < 0) {
+      missing++;
+    }
+  }
+  return(missing);
+}
+
+
+/* Block b of an optional output array */
+#define VX_QUERY_AT(a, b) (((a) != NULL) ? &(a)[b] : NULL)
+
+
+/* Whether the UTM box x0..x1, y0..y1 reaches any cell of grid g,
+   cells extend half a step around their node */
+static int vx_query_overlaps(const vx_query_grid_t *g, double x0, double x1,
+			     double y0, double y1)
+{
+  return((x1 >= g->O[0] - 0.5 * g->step[0]) &&
+	 (x0 <= g->O[0] + (g->N[0] - 0.5) * g->step[0]) &&
+	 (y1 >= g->O[1] - 0.5 * g->step[1]) &&
+	 (y0 <= g->O[1] + (g->N[1] - 0.5) * g->step[1]));
+}
+
+
+/* Query n UTM points (x, y meters, z elevation) against ngrids grids
+   in priority order. vp, vs and rho get NIL and src gets -1 for points
+   no grid covers, src is the grid index otherwise. vs and rho may be
+   NULL, their volume reads and density are then skipped. Grids a
+   block's bounding box misses are skipped. Returns the number of
+   points without data */
+int vx_query_batch(const vx_query_grid_t *grids, int ngrids,
+		   const double *x, const double *y, const double *z,
+		   double *vp, double *vs, double *rho, int *src, int n)
+{
+  int idx[VX_QUERY_BLOCK];
+  double x0, x1, y0, y1;
+  int b, m, k, p;
+  int missing = 0;
+
+  for (b = 0; b < n; b += VX_QUERY_BLOCK) {
+    m = (n - b < VX_QUERY_BLOCK) ? n - b : VX_QUERY_BLOCK;
+    vx_query_clear(&vp[b], VX_QUERY_AT(vs, b), &src[b], m);
+    x0 = x1 = x[b];
+    y0 = y1 = y[b];
+    for (p = 1; p < m; p++) {
+      x0 = fmin(x0, x[b+p]);
+      x1 = fmax(x1, x[b+p]);
+      y0 = fmin(y0, y[b+p]);
+      y1 = fmax(y1, y[b+p]);
+    }
+    for (k = 0; k < ngrids; k++) {
+      if (!vx_query_overlaps(&grids[k], x0, x1, y0, y1)) {
+	continue;
+      }
+      vx_query_index(&grids[k], &x[b], &y[b], &z[b], idx, m);
+      vx_query_take(&grids[k], k, idx, &vp[b], VX_QUERY_AT(vs, b), &src[b],
+		    m);
+    }
+    missing += vx_query_finish(&vp[b], VX_QUERY_AT(rho, b), &src[b], m);
+  }
+
+  return(missing);
+}
+
+
+/* Spread the low 21 bits of v to every third bit */
+VX_QUERY_INLINE uint64_t vx_query_spread3(uint64_t v)
+{
+  v &= 0x1fffff;
+  v = (v | (v << 32)) & 0x1f00000000ffffULL;
+  v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+  v = (v | (v << 8)) & 0x100f00f00f00f00fULL;
+  v = (v | (v << 4)) & 0x10c30c30c30c30c3ULL;
+  v = (v | (v << 2)) & 0x1249249249249249ULL;
+  return(v);
+}
+
+
+/* Morton (Z order) keys of the cells of grid g nearest n UTM points.
+   Cells are counted from 2^20 cells before the origin and clamped to
+   21 bits per axis, so points near the grid still order by position.
+   Points with close keys share cells, or cache lines of neighbouring
+   cells, in every grid at least as fine as g */
+void vx_query_morton(const vx_query_grid_t *g, const double *x,
+		     const double *y, const double *z, uint64_t *key, int n)
+{
+  double c[3];
+  int i, p;
+
+  for (p = 0; p < n; p++) {
+    c[0] = VX_QUERY_CELL(g, 0, x[p]);
+    c[1] = VX_QUERY_CELL(g, 1, y[p]);
+    c[2] = VX_QUERY_CELL(g, 2, z[p]);
+    key[p] = 0;
+    for (i = 0; i < 3; i++) {
+      c[i] = c[i] + 1048576.0;
+      c[i] = (c[i] > 0.0) ? c[i] : 0.0;
+      c[i] = (c[i] < 2097151.0) ? c[i] : 2097151.0;
+      key[p] |= vx_query_spread3((uint64_t)c[i]) << i;
+    }
+  }
+}
+
+
+/* Horizontal cell of grid g at UTM x, y, as the offset of its column
+   in the volumes, -1 if the grid or its cover does not cover the
+   location */
+int vx_query_column(const vx_query_grid_t *g, double x, double y)
+{
+  double ci, cj;
+
+  ci = VX_QUERY_CELL(g, 0, x);
+  cj = VX_QUERY_CELL(g, 1, y);
+  if (!((ci >= 0.0) && (ci < g->lim[0]) && (cj >= 0.0) && (cj < g->lim[1])) ||
+      !VX_QUERY_COVERED(g, (int)ci, (int)cj)) {
+    return(-1);
+  }
+  return(vx_query_col(g, (int)ci, (int)cj));
+}
+
+
+/* Query n points whose horizontal cells are known, cols[p * ngrids + k]
+   is the vx_query_column of point p in grid k. Outputs and return
+   value are as for vx_query_batch */
+int vx_query_columns(const vx_query_grid_t *grids, int ngrids,
+		     const int *cols, const double *z, double *vp, double *vs,
+		     double *rho, int *src, int n)
+{
+  int idx[VX_QUERY_BLOCK];
+  const vx_query_grid_t *g;
+  double ck;
+  int b, m, p, k, col;
+  int missing = 0;
+
+  for (b = 0; b < n; b += VX_QUERY_BLOCK) {
+    m = (n - b < VX_QUERY_BLOCK) ? n - b : VX_QUERY_BLOCK;
+    vx_query_clear(&vp[b], VX_QUERY_AT(vs, b), &src[b], m);
+    for (k = 0; k < ngrids; k++) {
+      g = &grids[k];
+      for (p = 0; p < m; p++) {
+	col = cols[(b + p) * ngrids + k];
+	ck = VX_QUERY_CELL(g, 2, z[b+p]);
+	idx[p] = ((col >= 0) && (ck >= 0.0) && (ck < g->lim[2])) ?
+	  vx_query_slice(g, (int)ck) + col : -1;
+      }
+      vx_query_take(g, k, idx, &vp[b], VX_QUERY_AT(vs, b), &src[b], m);
+    }
+    missing += vx_query_finish(&vp[b], VX_QUERY_AT(rho, b), &src[b], m);
+  }
+
+  return(missing);
+}
+
+
+/* Query a vertical profile, n elevations z below one UTM location
+   x, y. The horizontal cell of each grid is found once and grids that
+   do not cover the location are skipped, each point then only needs
+   its vertical index. Outputs and return value are as for
+   vx_query_batch */
+int vx_query_profile(const vx_query_grid_t *grids, int ngrids, double x,
+		     double y, const double *z, double *vp, double *vs,
+		     double *rho, int *src, int n)
+{
+  int idx[VX_QUERY_BLOCK];
+  const vx_query_grid_t *g;
+  double ck;
+  int b, m, p, k, col;
+  int missing = 0;
+
+  for (b = 0; b < n; b += VX_QUERY_BLOCK) {
+    m = (n - b < VX_QUERY_BLOCK) ? n - b : VX_QUERY_BLOCK;
+    vx_query_clear(&vp[b], VX_QUERY_AT(vs, b), &src[b], m);
+    for (k = 0; k < ngrids; k++) {
+      g = &grids[k];
+      col = vx_query_column(g, x, y);
+      if (col < 0) {
+	continue;
+      }
+      for (p = 0; p < m; p++) {
+	ck = VX_QUERY_CELL(g, 2, z[b+p]);
+	idx[p] = ((ck >= 0.0) && (ck < g->lim[2])) ?
+	  vx_query_slice(g, (int)ck) + col : -1;
+      }
+      vx_query_take(g, k, idx, &vp[b], VX_QUERY_AT(vs, b), &src[b], m);
+    }
+    missing += vx_query_finish(&vp[b], VX_QUERY_AT(rho, b), &src[b], m);
+  }
+
+  return(missing);
+}
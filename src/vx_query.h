@@ -0,0 +1,146 @@
+#ifndef VX_QUERY_H
+#define VX_QUERY_H
+
+#include <stdint.h>
+#include "voxet.h"
+#include "vx_brick.h"
+
+/* Points handled per pass of vx_query_batch */
+#define VX_QUERY_BLOCK 1024
+
+/* Largest relative difference between vx_query_rho and the
+   Nafe-Drake polynomial in power form for vp up to 10 km/s, the
+   test checks it */
+#define VX_QUERY_RHO_MAXERR 1.0e-12
+
+
+/* Code of cells without data in a 16-bit volume */
+#define VX_QUERY_Q16_NODATA 0xffff
+
+
+/* Volume in 16-bit fixed point, a cell decodes to offset + scale * code */
+typedef struct vx_query_q16_t {
+  uint16_t *code;      /* cells, padded by one code for 32-bit gathers */
+  double scale;        /* value step of a code */
+  double offset;       /* value of code 0 */
+  float nodata;        /* value VX_QUERY_Q16_NODATA decodes to */
+  double maxerr;       /* largest decoding error over the volume */
+} vx_query_q16_t;
+
+
+/* Nearest cell lookup of one voxet, volumes are host order, i fastest
+   or in the brick order of brick. Setup precomputes everything
+   indexing needs so a point costs three multiply-adds, compares and
+   integer math */
+typedef struct vx_query_grid_t {
+  double O[3];         /* origin of cell 0,0,0 */
+  double step[3];      /* cell spacing per axis */
+  double rstep[3];     /* cells per unit length per axis */
+  double lim[3];       /* cells per axis, as compared against */
+  int N[3];            /* cells per axis */
+  int stride[2];       /* cells per row and per depth slice */
+  const float *vp;     /* vp volume */
+  const float *vs;     /* vs volume, NULL if the voxet has none */
+  float nodata;        /* PROP_NO_DATA_VALUE of vp */
+  const vx_query_q16_t *qvp; /* 16-bit vp, used instead of vp when set */
+  const vx_query_q16_t *qvs; /* 16-bit vs, used instead of vs when set */
+  const unsigned char *cover; /* per column block, 0 if no cell has data,
+				 NULL when not built */
+  int cover_shift;     /* blocks are 1 << cover_shift columns square */
+  int cover_n;         /* blocks along i */
+  vx_brick_layout_t brick; /* brick order of the volumes, bdim is 0
+			      for linear volumes */
+  vx_lazy_t *lazy[2];  /* vp and vs paged in bricks of the brick
+			  order, used when vp and qvp are NULL */
+} vx_query_grid_t;
+
+
+/* Whether column i, j (in range) of a grid lies in a block with data,
+   always true without a cover */
+#define VX_QUERY_COVERED(g, i, j) (((g)->cover == NULL) || \
+  (g)->cover[((j) >> (g)->cover_shift) * (g)->cover_n + \
+	     ((i) >> (g)->cover_shift)])
+
+
+/* Set up a grid from voxet axis information */
+int vx_query_setgrid(vx_query_grid_t *, const struct axis *,
+		     const float *, const float *, float);
+
+
+/* Store the volumes of a grid in brick order */
+int vx_query_setbricks(vx_query_grid_t *, int);
+
+
+/* Cells held by each volume of a grid */
+size_t vx_query_ncells(const vx_query_grid_t *);
+
+
+/* Convert a float volume to 16-bit fixed point */
+int vx_query_quantize(const float *, int, float, vx_query_q16_t *);
+
+
+/* Free a 16-bit volume */
+void vx_query_freeq16(vx_query_q16_t *);
+
+
+/* Fetch 16-bit volume cells by index, cells at index -1 get a fill */
+void vx_query_gather16(const vx_query_q16_t *, const int *, double *, int,
+		       float);
+
+
+/* Build the column block cover of a grid */
+int vx_query_setcover(vx_query_grid_t *, int);
+
+
+/* Free the column block cover of a grid */
+void vx_query_freecover(vx_query_grid_t *);
+
+
+/* Convert lon/lat (degrees) to UTM zone 11 (meters) on a vx_utm path */
+int vx_query_geo2utm(int, const double *, const double *, double *, double *,
+		     int);
+
+
+/* Nearest cell index of every point, -1 outside the grid */
+void vx_query_index(const vx_query_grid_t *, const double *, const double *,
+		    const double *, int *, int);
+
+
+/* Fetch volume cells by index, cells at index -1 get nodata */
+void vx_query_gather(const float *, const int *, double *, int, float);
+
+
+/* Nafe-Drake density from vp (m/s), nodata is passed through */
+void vx_query_rho(const double *, double *, int, double);
+
+
+/* Query a batch of UTM points against grids in priority order, vs
+   and rho may be NULL */
+int vx_query_batch(const vx_query_grid_t *, int, const double *,
+		   const double *, const double *, double *, double *,
+		   double *, int *, int);
+
+
+/* Morton order keys of the cells of a grid at UTM points */
+void vx_query_morton(const vx_query_grid_t *, const double *, const double *,
+		     const double *, uint64_t *, int);
+
+
+/* Horizontal cell of a grid at a UTM location, -1 outside */
+int vx_query_column(const vx_query_grid_t *, double, double);
+
+
+/* Query points with known horizontal cells against grids in priority
+   order */
+int vx_query_columns(const vx_query_grid_t *, int, const int *,
+		     const double *, double *, double *, double *, int *,
+		     int);
+
+
+/* Query elevations below one UTM location against grids in priority
+   order */
+int vx_query_profile(const vx_query_grid_t *, int, double, double,
+		     const double *, double *, double *, double *, int *,
+		     int);
+
+#endif
@@ -0,0 +1,184 @@
+/** vx_surf.c - Interleaved 2D model surfaces
+
+    topo_dem, model_top, base and moho share the horizontal grid of
+    the interfaces voxet. They are held interleaved, every lookup
+    reads the four corner nodes of one cell for all surfaces at once,
+    and interpolated bilinearly with the inverse node spacing
+    precomputed.
+**/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "params.h"
+#include "vx_io.h"
+#include "vx_surf.h"
+
+/* Property names of the surfaces, in node order */
+static const char *vx_surf_names[VX_SURF_NUM] = { "topo_dem", "model_top",
+						  "base", "moho" };
+
+
+/* Build surfaces on the horizontal grid of a, from VX_SURF_NUM node
+   arrays of a->N[0] * a->N[1] values. Nodes equal to their surface's
+   value in surfnodata (NULL when every surface uses nodata) are held
+   as nodata. Returns NULL on a bad grid or when out of memory */
+vx_surf_t *vx_surf_new(const struct axis *a, const float **surf,
+		       const float *surfnodata, float nodata)
+{
+  vx_surf_t *s;
+  double span[2];
+  float v, own;
+  int i, k, n;
+
+  span[0] = a->U[0];
+  span[1] = a->V[1];
+  if ((a->N[0] < 2) || (a->N[1] < 2) || (span[0] <= 0.0) ||
+      (span[1] <= 0.0)) {
+    return(NULL);
+  }
+  s = malloc(sizeof(vx_surf_t));
+  if (s == NULL) {
+    return(NULL);
+  }
+  n = a->N[0] * a->N[1];
+  s->node = malloc(n * VX_SURF_NUM * sizeof(float));
+  if (s->node == NULL) {
+    free(s);
+    return(NULL);
+  }
+  for (i = 0; i < 2; i++) {
+    s->O[i] = a->O[i];
+    s->N[i] = a->N[i];
+    s->rstep[i] = (a->N[i] - 1) / span[i];
+  }
+  s->nodata = nodata;
+  for (k = 0; k < VX_SURF_NUM; k++) {
+    own = (surfnodata != NULL) ? surfnodata[k] : nodata;
+    for (i = 0; i < n; i++) {
+      v = (surf[k] != NULL) ? surf[k][i] : nodata;
+      s->node[i * VX_SURF_NUM + k] = (v == own) ? nodata : v;
+    }
+  }
+  return(s);
+}
+
+
+/* Load the surfaces of interfaces voxet vo in data_dir. Surfaces the
+   header does not list have no data, each surface's own
+   PROP_NO_DATA_VALUE is held as NIL */
+vx_surf_t *vx_surf_load(const char *data_dir, const char *vo)
+{
+  vx_io_header_t *hdr;
+  struct axis a;
+  char vo_path[CMLEN], fn[CMLEN];
+  float *surf[VX_SURF_NUM];
+  float nodata[VX_SURF_NUM];
+  vx_surf_t *s = NULL;
+  int k, key, ncells;
+
+  if (vo == NULL) {
+    vo = VX_SURF_VO;
+  }
+  sprintf(vo_path, "%s/%s", data_dir, vo);
+  hdr = vx_io_open(vo_path);
+  if (hdr == NULL) {
+    fprintf(stderr, "Failed to read interfaces header %s\n", vo_path);
+    return(NULL);
+  }
+  memset(&a, 0, sizeof(struct axis));
+  if ((vx_io_header_getvec(hdr, "AXIS_O", a.O) != 0) ||
+      (vx_io_header_getvec(hdr, "AXIS_U", a.U) != 0) ||
+      (vx_io_header_getvec(hdr, "AXIS_V", a.V) != 0) ||
+      (vx_io_header_getdim(hdr, "AXIS_N", a.N) != 0)) {
+    fprintf(stderr, "Incomplete interfaces header %s\n", vo_path);
+    vx_io_close(hdr);
+    return(NULL);
+  }
+  ncells = a.N[0] * a.N[1];
+
+  memset(surf, 0, sizeof(surf));
+  for (k = 0; k < VX_SURF_NUM; k++) {
+    nodata[k] = NIL;
+    key = vx_io_header_getpropkey(hdr, vx_surf_names[k]);
+    if ((key <= 0) ||
+	(vx_io_header_getpropname(hdr, "PROP_FILE", key, fn) != 0)) {
+      continue;
+    }
+    vx_io_header_getpropval(hdr, "PROP_NO_DATA_VALUE", key, &nodata[k]);
+    surf[k] = malloc(ncells * sizeof(float));
+    if ((surf[k] == NULL) ||
+	(vx_io_loadvolume(data_dir, fn, 4, ncells, (char *)surf[k]) != 0)) {
+      fprintf(stderr, "Failed to load surface %s\n", fn);
+      break;
+    }
+  }
+  if (k == VX_SURF_NUM) {
+    s = vx_surf_new(&a, (const float **)surf, nodata, NIL);
+  }
+
+  for (k = 0; k < VX_SURF_NUM; k++) {
+    free(surf[k]);
+  }
+  vx_io_close(hdr);
+  return(s);
+}
+
+
+/* Values of every surface at n UTM points into out, VX_SURF_NUM per
+   point in node order. Values are bilinear in the cell, a surface
+   with a corner node without data takes the nearest node instead.
+   Points off the grid get nodata */
+void vx_surf_query(const vx_surf_t *s, const double *x, const double *y,
+		   double *out, int n)
+{
+  const float *a, *b;
+  double fi, fj, u, v, w[4];
+  int i, j, k, p, near;
+
+  for (p = 0; p < n; p++) {
+    fi = (x[p] - s->O[0]) * s->rstep[0];
+    fj = (y[p] - s->O[1]) * s->rstep[1];
+    if ((fi < 0.0) || (fi > s->N[0] - 1) || (fj < 0.0) ||
+	(fj > s->N[1] - 1)) {
+      for (k = 0; k < VX_SURF_NUM; k++) {
+	out[p * VX_SURF_NUM + k] = s->nodata;
+      }
+      continue;
+    }
+
+    /* Last row and column use the cell before them */
+    i = (fi < s->N[0] - 1) ? (int)fi : s->N[0] - 2;
+    j = (fj < s->N[1] - 1) ? (int)fj : s->N[1] - 2;
+    u = fi - i;
+    v = fj - j;
+    w[0] = (1.0 - u) * (1.0 - v);
+    w[1] = u * (1.0 - v);
+    w[2] = (1.0 - u) * v;
+    w[3] = u * v;
+    near = ((v < 0.5) ? 0 : 2) + ((u < 0.5) ? 0 : 1);
+    a = &s->node[(j * s->N[0] + i) * VX_SURF_NUM];
+    b = a + s->N[0] * VX_SURF_NUM;
+    for (k = 0; k < VX_SURF_NUM; k++) {
+      if ((a[k] == s->nodata) || (a[k+VX_SURF_NUM] == s->nodata) ||
+	  (b[k] == s->nodata) || (b[k+VX_SURF_NUM] == s->nodata)) {
+	out[p * VX_SURF_NUM + k] = (near < 2) ?
+	  a[k + (near & 1) * VX_SURF_NUM] : b[k + (near & 1) * VX_SURF_NUM];
+      } else {
+	out[p * VX_SURF_NUM + k] = w[0] * a[k] + w[1] * a[k+VX_SURF_NUM] +
+	  w[2] * b[k] + w[3] * b[k+VX_SURF_NUM];
+      }
+    }
+  }
+}
+
+
+/* Free surfaces */
+void vx_surf_free(vx_surf_t *s)
+{
+  if (s == NULL) {
+    return;
+  }
+  free(s->node);
+  free(s);
+}
@@ -0,0 +1,46 @@
+#ifndef VX_SURF_H
+#define VX_SURF_H
+
+#include "voxet.h"
+
+/* Surfaces of the interfaces voxet, in node order */
+#define VX_SURF_TOPO 0       /* topo_dem */
+#define VX_SURF_TOP 1        /* model_top */
+#define VX_SURF_BASE 2       /* base */
+#define VX_SURF_MOHO 3       /* moho */
+#define VX_SURF_NUM 4
+
+/* Default interfaces voxet */
+#define VX_SURF_VO "interfaces.vo"
+
+
+/* 2D surfaces on one horizontal grid, the values of all surfaces
+   at a node are adjacent so one cache line serves every surface */
+typedef struct vx_surf_t {
+  double O[2];         /* UTM origin of node 0,0 */
+  double rstep[2];     /* nodes per meter */
+  int N[2];            /* nodes per axis */
+  float nodata;        /* value of nodes without data */
+  float *node;         /* VX_SURF_NUM values per node, i fastest */
+} vx_surf_t;
+
+
+/* Build surfaces from separate host order node arrays with their own
+   no data values, NULL arrays give surfaces without data */
+vx_surf_t *vx_surf_new(const struct axis *, const float **, const float *,
+		       float);
+
+
+/* Load the surfaces of an interfaces voxet */
+vx_surf_t *vx_surf_load(const char *, const char *);
+
+
+/* Bilinear values of every surface at UTM points */
+void vx_surf_query(const vx_surf_t *, const double *, const double *,
+		   double *, int);
+
+
+/* Free surfaces */
+void vx_surf_free(vx_surf_t *);
+
+#endif
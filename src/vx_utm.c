@@ -0,0 +1,429 @@
+/** vx_utm.c - Batched UTM zone 11 transforms
+
+    Two paths convert arrays of points. The exact path runs the
+    scalar transforms of vx_utm.h, which match gctp to the bit. The
+    vector path replaces the libm calls with the polynomial sin/cos
+    and 1/sqrt kernels below and the multiple angle sines of the
+    meridian distance with products of sin and cos, so every loop is
+    straight line code the compiler turns into SIMD. Over the model
+    region it stays within VX_UTM_VECTOR_MAXERR meters of the exact
+    path.
+**/
+
+#include <stdlib.h>
+#include <math.h>
+#include "vx_utm.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VX_UTM_X86 1
+#include <pthread.h>
+#endif
+
+#define VX_UTM_INLINE static inline __attribute__((always_inline))
+
+/* Points per pass of the inverse iteration */
+#define VX_UTM_BLOCK 256
+
+/* sin and cos of x. Cody-Waite reduction by pi/2 and the fdlibm
+   kernel polynomials on -pi/4..pi/4, a few ulp for |x| up to 1e5 */
+VX_UTM_INLINE void vx_utm_sincos(double x, double *s, double *c)
+{
+  const double shift = 6755399441055744.0;
+  double k, r, z, ps, pc, so, co;
+  int q;
+
+  k = (x * 0.63661977236758134308 + shift) - shift;
+  r = (x - k * 1.57079632673412561417) - k * 6.07710050650619224932e-11;
+  q = (int)k;
+  z = r * r;
+  ps = r + r * z * (-1.66666666666666324348e-01 + z *
+       (8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04 + z *
+       (2.75573137070700676789e-06 + z * (-2.50507602534068634195e-08 + z *
+       1.58969099521155010221e-10)))));
+  pc = 1.0 - 0.5 * z + z * z * (4.16666666666666019037e-02 + z *
+       (-1.38888888888741095749e-03 + z * (2.48015872894767294178e-05 + z *
+       (-2.75573143513906633035e-07 + z * (2.08757232129817482790e-09 + z *
+       -1.13596475577881948265e-11)))));
+  so = (q & 1) ? pc : ps;
+  co = (q & 1) ? ps : pc;
+  *s = (q & 2) ? -so : so;
+  *c = ((q + 1) & 2) ? -co : co;
+}
+
+
+/* Periodic terms of the meridian distance, e1 sin(2 phi) - e2 sin(4 phi)
+   + e3 sin(6 phi), with the multiple angle sines built from s = sin(phi)
+   and c = cos(phi) */
+VX_UTM_INLINE double vx_utm_mlsin(double s, double c)
+{
+  double s2, c2, s4, c4, s6;
+
+  s2 = 2.0 * s * c;
+  c2 = 1.0 - 2.0 * s * s;
+  s4 = 2.0 * s2 * c2;
+  c4 = 1.0 - 2.0 * s2 * s2;
+  s6 = s4 * c2 + c4 * s2;
+  return(VX_UTM_E1 * s2 - VX_UTM_E2 * s4 + VX_UTM_E3 * s6);
+}
+
+
+/* 1 / sqrt(1 - u) for 0 <= u <= es, the binomial series to the
+   u^8 term leaves under 1e-18. Unlike sqrt it has no errno path to
+   keep the loops from vectorizing */
+VX_UTM_INLINE double vx_utm_rsqrt1m(double u)
+{
+  return(1.0 + u * (0.5 + u * (0.375 + u * (0.3125 + u * (0.2734375 + u *
+	 (0.24609375 + u * (0.2255859375 + u * (0.20947265625 + u *
+	 0.196380615234375))))))));
+}
+
+
+/* Branch free vx_utm_adjust_lon */
+VX_UTM_INLINE double vx_utm_adjust_lon_sel(double x)
+{
+  return(x - (VX_UTM_PI * 2.0) * (double)((x > VX_UTM_PI) -
+					  (x < -VX_UTM_PI)));
+}
+
+
+/* Forward series of vx_utm11_fwd over n points */
+VX_UTM_INLINE void vx_utm11_fwd_kernel(const double *lon, const double *lat,
+				       double *x, double *y, int n)
+{
+  double lam, phi, delta_lon, sin_phi, cos_phi;
+  double al, als, c, t, tq, con, nn, ml;
+  int p;
+
+  for (p = 0; p < n; p++) {
+    lam = lon[p] * VX_UTM_DEG2RAD;
+    phi = lat[p] * VX_UTM_DEG2RAD;
+    delta_lon = vx_utm_adjust_lon_sel(lam - VX_UTM_LON_CENTER);
+    vx_utm_sincos(phi, &sin_phi, &cos_phi);
+
+    al  = cos_phi * delta_lon;
+    als = al * al;
+    c   = VX_UTM_ESP * cos_phi * cos_phi;
+    tq  = sin_phi / cos_phi;
+    t   = tq * tq;
+    con = VX_UTM_ES * sin_phi * sin_phi;
+    nn  = VX_UTM_R_MAJOR * vx_utm_rsqrt1m(con);
+    ml  = VX_UTM_R_MAJOR * (VX_UTM_E0 * phi - vx_utm_mlsin(sin_phi, cos_phi));
+
+    x[p] = VX_UTM_SCALE * nn * al * (1.0 + als / 6.0 * (1.0 - t + c + als /
+	   20.0 * (5.0 - 18.0 * t + t * t + 72.0 * c - 58.0 * VX_UTM_ESP))) +
+      VX_UTM_FALSE_EASTING;
+    y[p] = VX_UTM_SCALE * (ml - VX_UTM_ML0 + nn * tq * (als * (0.5 + als /
+	   24.0 * (5.0 - t + 9.0 * c + 4.0 * c * c + als / 30.0 * (61.0 - 58.0
+	   * t + t * t + 600.0 * c - 330.0 * VX_UTM_ESP)))));
+  }
+}
+
+
+/* Inverse series of vx_utm11_inv over n <= VX_UTM_BLOCK points. The
+   footpoint latitude iteration runs on the whole block until every
+   point has converged, points that have not after VX_UTM_MAXITER
+   passes are marked in bad, as are footpoints at a pole */
+VX_UTM_INLINE void vx_utm11_inv_kernel(const double *x, const double *y,
+				       double *lon, double *lat, int *bad,
+				       int n)
+{
+  double con[VX_UTM_BLOCK], phi[VX_UTM_BLOCK], dphi[VX_UTM_BLOCK];
+  double s, cp, tan_phi, c, cs, t, ts, cn, nn, r, d, ds, la, lo;
+  int i, p, left;
+
+  for (p = 0; p < n; p++) {
+    con[p] = (VX_UTM_ML0 + y[p] / VX_UTM_SCALE) / VX_UTM_R_MAJOR;
+    phi[p] = con[p];
+  }
+  for (i = 0;; i++) {
+    left = 0;
+    for (p = 0; p < n; p++) {
+      vx_utm_sincos(phi[p], &s, &cp);
+      dphi[p] = ((con[p] + vx_utm_mlsin(s, cp)) / VX_UTM_E0) - phi[p];
+      phi[p] += dphi[p];
+      left += (fabs(dphi[p]) > VX_UTM_EPSLN);
+    }
+    if ((left == 0) || (i >= VX_UTM_MAXITER)) {
+      break;
+    }
+  }
+
+  for (p = 0; p < n; p++) {
+    bad[p] = (fabs(dphi[p]) > VX_UTM_EPSLN) |
+      (fabs(phi[p]) >= VX_UTM_HALF_PI);
+    vx_utm_sincos(phi[p], &s, &cp);
+    tan_phi = s / cp;
+    c    = VX_UTM_ESP * cp * cp;
+    cs   = c * c;
+    t    = tan_phi * tan_phi;
+    ts   = t * t;
+    cn   = 1.0 - VX_UTM_ES * s * s;
+    nn   = VX_UTM_R_MAJOR * vx_utm_rsqrt1m(VX_UTM_ES * s * s);
+    r    = nn * (1.0 - VX_UTM_ES) / cn;
+    d    = (x[p] - VX_UTM_FALSE_EASTING) / (nn * VX_UTM_SCALE);
+    ds   = d * d;
+    la = phi[p] - (nn * tan_phi * ds / r) * (0.5 - ds / 24.0 * (5.0 + 3.0 *
+	 t + 10.0 * c - 4.0 * cs - 9.0 * VX_UTM_ESP - ds / 30.0 * (61.0 +
+	 90.0 * t + 298.0 * c + 45.0 * ts - 252.0 * VX_UTM_ESP - 3.0 * cs)));
+    lo = vx_utm_adjust_lon_sel(VX_UTM_LON_CENTER + (d * (1.0 - ds / 6.0 *
+	 (1.0 + 2.0 * t + c - ds / 20.0 * (5.0 - 2.0 * c + 28.0 * t - 3.0 *
+	 cs + 8.0 * VX_UTM_ESP + 24.0 * ts))) / cp));
+    lon[p] = lo * VX_UTM_RAD2DEG;
+    lat[p] = la * VX_UTM_RAD2DEG;
+  }
+}
+
+
+/* Baseline instruction set builds of the kernels */
+static void vx_utm11_fwd_base(const double *lon, const double *lat,
+			      double *x, double *y, int n)
+{
+  vx_utm11_fwd_kernel(lon, lat, x, y, n);
+}
+
+static void vx_utm11_inv_base(const double *x, const double *y,
+			      double *lon, double *lat, int *bad, int n)
+{
+  vx_utm11_inv_kernel(x, y, lon, lat, bad, n);
+}
+
+
+#ifdef VX_UTM_X86
+/* AVX2 builds of the kernels, four points per instruction */
+__attribute__((target("avx2,fma")))
+static void vx_utm11_fwd_avx2(const double *lon, const double *lat,
+			      double *x, double *y, int n)
+{
+  vx_utm11_fwd_kernel(lon, lat, x, y, n);
+}
+
+__attribute__((target("avx2,fma")))
+static void vx_utm11_inv_avx2(const double *x, const double *y,
+			      double *lon, double *lat, int *bad, int n)
+{
+  vx_utm11_inv_kernel(x, y, lon, lat, bad, n);
+}
+
+
+/* Whether the cpu has AVX2 and FMA, found once for every thread */
+static int vx_utm_has_avx2 = 0;
+static pthread_once_t vx_utm_once = PTHREAD_ONCE_INIT;
+
+static void vx_utm_cpuinit()
+{
+  __builtin_cpu_init();
+  vx_utm_has_avx2 = (__builtin_cpu_supports("avx2") &&
+		     __builtin_cpu_supports("fma")) ? 1 : 0;
+}
+
+static int vx_utm_avx2()
+{
+  pthread_once(&vx_utm_once, vx_utm_cpuinit);
+  return(vx_utm_has_avx2);
+}
+#endif
+
+
+/* Vector path of vx_utm11_fwd over n points */
+void vx_utm11_fwd_vec(const double *lon, const double *lat, double *x,
+		      double *y, int n)
+{
+#ifdef VX_UTM_X86
+  if (vx_utm_avx2()) {
+    vx_utm11_fwd_avx2(lon, lat, x, y, n);
+    return;
+  }
+#endif
+  vx_utm11_fwd_base(lon, lat, x, y, n);
+}
+
+
+/* Vector path of vx_utm11_inv over n points. Points whose footpoint
+   latitude does not converge, or lies at a pole, are redone on the
+   exact path, returns the number of points that fail there */
+int vx_utm11_inv_vec(const double *x, const double *y, double *lon,
+		     double *lat, int n)
+{
+  int bad[VX_UTM_BLOCK];
+  int b, m, p;
+  int failed = 0;
+
+  for (b = 0; b < n; b += VX_UTM_BLOCK) {
+    m = (n - b < VX_UTM_BLOCK) ? n - b : VX_UTM_BLOCK;
+#ifdef VX_UTM_X86
+    if (vx_utm_avx2()) {
+      vx_utm11_inv_avx2(&x[b], &y[b], &lon[b], &lat[b], bad, m);
+    } else
+#endif
+      vx_utm11_inv_base(&x[b], &y[b], &lon[b], &lat[b], bad, m);
+    for (p = 0; p < m; p++) {
+      if (bad[p]) {
+	failed += vx_utm11_inv(x[b+p], y[b+p], &lon[b+p], &lat[b+p]);
+      }
+    }
+  }
+  return(failed);
+}
+
+
+/* lon/lat (degrees) to UTM zone 11 (meters) on path mode,
+   VX_UTM_MODE_EXACT or VX_UTM_MODE_VECTOR */
+void vx_utm11_fwd_batch(int mode, const double *lon, const double *lat,
+			double *x, double *y, int n)
+{
+  int p;
+
+  if (mode == VX_UTM_MODE_VECTOR) {
+    vx_utm11_fwd_vec(lon, lat, x, y, n);
+    return;
+  }
+  for (p = 0; p < n; p++) {
+    vx_utm11_fwd(lon[p], lat[p], &x[p], &y[p]);
+  }
+}
+
+
+/* UTM zone 11 (meters) to lon/lat (degrees) on path mode, returns
+   the number of points that did not converge */
+int vx_utm11_inv_batch(int mode, const double *x, const double *y,
+		       double *lon, double *lat, int n)
+{
+  int p;
+  int failed = 0;
+
+  if (mode == VX_UTM_MODE_VECTOR) {
+    return(vx_utm11_inv_vec(x, y, lon, lat, n));
+  }
+  for (p = 0; p < n; p++) {
+    failed += vx_utm11_inv(x[p], y[p], &lon[p], &lat[p]);
+  }
+  return(failed);
+}
+
+
+/* Absolute second difference of coordinate k (0 x, 1 y) of lookup
+   grid g along axis a (0 lon, 1 lat) at node i, j, taken at the
+   nearest node with neighbours on both sides */
+static double vx_utm_grid_d2(const vx_utm_grid_t *g, int i, int j, int k,
+			     int a)
+{
+  const double *c;
+  int d;
+
+  i = (i < 1) ? 1 : ((i > g->nlon - 2) ? g->nlon - 2 : i);
+  j = (j < 1) ? 1 : ((j > g->nlat - 2) ? g->nlat - 2 : j);
+  c = &g->xy[2 * (j * g->nlon + i) + k];
+  d = (a == 0) ? 2 : 2 * g->nlon;
+  return(fabs(c[d] - 2.0 * c[0] + c[-d]));
+}
+
+
+/* Build a lookup grid over lon0..lon1, lat0..lat1 (degrees) with
+   nodes step degrees apart, at least three per axis. Bilinear
+   interpolation misses a coordinate in a cell by at most
+   (h_lon^2 |f_lon,lon| + h_lat^2 |f_lat,lat|) / 8. The second
+   derivatives come from second differences at the cell corners, the
+   bounds of x and y combine into a bound on the distance, and the
+   largest over all cells with a margin of a quarter becomes maxerr.
+   Returns NULL on bad arguments or when out of memory */
+vx_utm_grid_t *vx_utm_grid_new(double lon0, double lon1, double lat0,
+			       double lat1, double step)
+{
+  vx_utm_grid_t *g;
+  double e[2], d, err = 0.0;
+  int i, j, k, a, di, dj, n;
+
+  if ((step <= 0.0) || (lon1 <= lon0) || (lat1 <= lat0)) {
+    return(NULL);
+  }
+  g = malloc(sizeof(vx_utm_grid_t));
+  if (g == NULL) {
+    return(NULL);
+  }
+  g->nlon = (int)ceil((lon1 - lon0) / step) + 1;
+  g->nlat = (int)ceil((lat1 - lat0) / step) + 1;
+  g->nlon = (g->nlon < 3) ? 3 : g->nlon;
+  g->nlat = (g->nlat < 3) ? 3 : g->nlat;
+  g->lon0 = lon0;
+  g->lat0 = lat0;
+  g->dlon = step;
+  g->dlat = step;
+  g->rdlon = 1.0 / step;
+  g->rdlat = 1.0 / step;
+  n = g->nlon * g->nlat;
+  g->xy = malloc(2 * n * sizeof(double));
+  if (g->xy == NULL) {
+    free(g);
+    return(NULL);
+  }
+  for (j = 0; j < g->nlat; j++) {
+    for (i = 0; i < g->nlon; i++) {
+      k = 2 * (j * g->nlon + i);
+      vx_utm11_fwd(lon0 + i * step, lat0 + j * step, &g->xy[k], &g->xy[k+1]);
+    }
+  }
+
+  /* Bound of x and of y in each cell, from the largest second
+     differences along each axis at its corners */
+  for (j = 0; j < g->nlat - 1; j++) {
+    for (i = 0; i < g->nlon - 1; i++) {
+      for (k = 0; k < 2; k++) {
+	e[k] = 0.0;
+	for (a = 0; a < 2; a++) {
+	  d = 0.0;
+	  for (dj = 0; dj < 2; dj++) {
+	    for (di = 0; di < 2; di++) {
+	      d = fmax(d, vx_utm_grid_d2(g, i + di, j + dj, k, a));
+	    }
+	  }
+	  e[k] += d / 8.0;
+	}
+      }
+      err = fmax(err, sqrt(e[0] * e[0] + e[1] * e[1]));
+    }
+  }
+  g->maxerr = 1.25 * err;
+  return(g);
+}
+
+
+/* lon/lat (degrees) to UTM zone 11 (meters) for n points, by bilinear
+   interpolation inside the grid and on the exact path outside */
+void vx_utm_grid_fwd(const vx_utm_grid_t *g, const double *lon,
+		     const double *lat, double *x, double *y, int n)
+{
+  const double *a, *b;
+  double fi, fj, u, v;
+  int i, j, p;
+
+  for (p = 0; p < n; p++) {
+    fi = (lon[p] - g->lon0) * g->rdlon;
+    fj = (lat[p] - g->lat0) * g->rdlat;
+    if ((fi >= 0.0) && (fi < g->nlon - 1) && (fj >= 0.0) &&
+	(fj < g->nlat - 1)) {
+      i = (int)fi;
+      j = (int)fj;
+      u = fi - i;
+      v = fj - j;
+      a = &g->xy[2 * (j * g->nlon + i)];
+      b = a + 2 * g->nlon;
+      x[p] = (1.0 - v) * ((1.0 - u) * a[0] + u * a[2]) +
+	v * ((1.0 - u) * b[0] + u * b[2]);
+      y[p] = (1.0 - v) * ((1.0 - u) * a[1] + u * a[3]) +
+	v * ((1.0 - u) * b[1] + u * b[3]);
+    } else {
+      vx_utm11_fwd(lon[p], lat[p], &x[p], &y[p]);
+    }
+  }
+}
+
+
+/* Free a lookup grid */
+void vx_utm_grid_free(vx_utm_grid_t *g)
+{
+  if (g == NULL) {
+    return;
+  }
+  free(g->xy);
+  free(g);
+}
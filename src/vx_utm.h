@@ -0,0 +1,194 @@
+#ifndef VX_UTM_H
+#define VX_UTM_H
+
+#include <math.h>
+
+/* UTM zone 11 on the Clarke 1866 spheroid, as gctp sets it up for
+   outsys 1, outzone 11, outdatum 0. The constants are utmforint's
+   for that zone, the expressions follow utmfor and utminv term for
+   term so results match gctp to the bit */
+#define VX_UTM_R_MAJOR 6378206.4
+#define VX_UTM_SCALE 0.9996
+#define VX_UTM_LON_CENTER -2.0420352248333637
+#define VX_UTM_FALSE_EASTING 500000.0
+#define VX_UTM_ES 0.0067686579972912053
+#define VX_UTM_ESP 0.0068147849459151942
+#define VX_UTM_E0 0.99830568187843405
+#define VX_UTM_E1 0.0025425555076513504
+#define VX_UTM_E2 2.6980845274661006e-06
+#define VX_UTM_E3 3.5330887396357043e-09
+#define VX_UTM_ML0 0.0
+
+/* gctp unit factors (untfz), degrees to radians and back */
+#define VX_UTM_DEG2RAD .0174532925199433
+#define VX_UTM_RAD2DEG 57.29577951308231
+
+/* gctp constants (cproj.h) */
+#define VX_UTM_PI 3.141592653589793238
+#define VX_UTM_HALF_PI (VX_UTM_PI*0.5)
+#define VX_UTM_EPSLN 1.0e-10
+#define VX_UTM_MAXITER 6
+
+/* Paths of the batch transforms, exact matches gctp to the bit,
+   vector uses the SIMD kernels of vx_utm.c */
+#define VX_UTM_MODE_EXACT 0
+#define VX_UTM_MODE_VECTOR 1
+
+/* Largest distance (m) between the vector and exact paths over the
+   model region, the test checks it */
+#define VX_UTM_VECTOR_MAXERR 1.0e-7
+
+/* Default node spacing (degrees) of a lookup grid */
+#define VX_UTM_GRID_STEP 0.005
+
+
+/* Lookup grid of UTM zone 11 coordinates over a lon/lat box,
+   answering the forward transform by bilinear interpolation */
+typedef struct vx_utm_grid_t {
+  double lon0, lat0;   /* first node, degrees */
+  double dlon, dlat;   /* node spacing, degrees */
+  double rdlon, rdlat; /* nodes per degree */
+  int nlon, nlat;      /* nodes per axis */
+  double *xy;          /* x,y of each node, lon fastest */
+  double maxerr;       /* bound on the distance to the exact point
+			  inside the grid, meters */
+} vx_utm_grid_t;
+
+
+/* Bring a longitude back into -PI..PI, adjust_lon for the range a
+   single zone can produce */
+static inline double vx_utm_adjust_lon(double x)
+{
+  if (fabs(x) > VX_UTM_PI) {
+    x = x - ((x < 0.0) ? -1.0 : 1.0) * (VX_UTM_PI * 2.0);
+  }
+  return(x);
+}
+
+
+/* Distance along the meridian, mlfn */
+static inline double vx_utm_mlfn(double phi)
+{
+  return(VX_UTM_E0 * phi - VX_UTM_E1 * sin(2.0 * phi) +
+	 VX_UTM_E2 * sin(4.0 * phi) - VX_UTM_E3 * sin(6.0 * phi));
+}
+
+
+/* lon/lat in degrees to UTM zone 11 x/y in meters */
+static inline void vx_utm11_fwd(double lon, double lat, double *x, double *y)
+{
+  double delta_lon, sin_phi, cos_phi;
+  double al, als, c, t, tq, con, n, ml;
+
+  lon = lon * VX_UTM_DEG2RAD;
+  lat = lat * VX_UTM_DEG2RAD;
+  delta_lon = vx_utm_adjust_lon(lon - VX_UTM_LON_CENTER);
+  sin_phi = sin(lat);
+  cos_phi = cos(lat);
+
+  al  = cos_phi * delta_lon;
+  als = al * al;
+  c   = VX_UTM_ESP * cos_phi * cos_phi;
+  tq  = tan(lat);
+  t   = tq * tq;
+  con = 1.0 - VX_UTM_ES * sin_phi * sin_phi;
+  n   = VX_UTM_R_MAJOR / sqrt(con);
+  ml  = VX_UTM_R_MAJOR * vx_utm_mlfn(lat);
+
+  *x = VX_UTM_SCALE * n * al * (1.0 + als / 6.0 * (1.0 - t + c + als / 20.0 *
+	(5.0 - 18.0 * t + t * t + 72.0 * c - 58.0 * VX_UTM_ESP))) +
+    VX_UTM_FALSE_EASTING;
+  *y = VX_UTM_SCALE * (ml - VX_UTM_ML0 + n * tq * (als * (0.5 + als / 24.0 *
+	(5.0 - t + 9.0 * c + 4.0 * c * c + als / 30.0 * (61.0 - 58.0 * t
+	+ t * t + 600.0 * c - 330.0 * VX_UTM_ESP))))) + 0.0;
+}
+
+
+/* UTM zone 11 x/y in meters to lon/lat in degrees. Returns 1 if the
+   footpoint latitude does not converge */
+static inline int vx_utm11_inv(double x, double y, double *lon, double *lat)
+{
+  double con, phi, delta_phi;
+  double sin_phi, cos_phi, tan_phi;
+  double c, cs, t, ts, n, r, d, ds;
+  int i;
+
+  x = x - VX_UTM_FALSE_EASTING;
+  y = y - 0.0;
+
+  con = (VX_UTM_ML0 + y / VX_UTM_SCALE) / VX_UTM_R_MAJOR;
+  phi = con;
+  for (i = 0;; i++) {
+    delta_phi = ((con + VX_UTM_E1 * sin(2.0 * phi) - VX_UTM_E2 * sin(4.0 * phi)
+		  + VX_UTM_E3 * sin(6.0 * phi)) / VX_UTM_E0) - phi;
+    phi += delta_phi;
+    if (fabs(delta_phi) <= VX_UTM_EPSLN) {
+      break;
+    }
+    if (i >= VX_UTM_MAXITER) {
+      return(1);
+    }
+  }
+
+  if (fabs(phi) < VX_UTM_HALF_PI) {
+    sin_phi = sin(phi);
+    cos_phi = cos(phi);
+    tan_phi = tan(phi);
+    c    = VX_UTM_ESP * cos_phi * cos_phi;
+    cs   = c * c;
+    t    = tan_phi * tan_phi;
+    ts   = t * t;
+    con  = 1.0 - VX_UTM_ES * sin_phi * sin_phi;
+    n    = VX_UTM_R_MAJOR / sqrt(con);
+    r    = n * (1.0 - VX_UTM_ES) / con;
+    d    = x / (n * VX_UTM_SCALE);
+    ds   = d * d;
+    *lat = phi - (n * tan_phi * ds / r) * (0.5 - ds / 24.0 * (5.0 + 3.0 * t +
+	   10.0 * c - 4.0 * cs - 9.0 * VX_UTM_ESP - ds / 30.0 * (61.0 + 90.0 *
+	   t + 298.0 * c + 45.0 * ts - 252.0 * VX_UTM_ESP - 3.0 * cs)));
+    *lon = vx_utm_adjust_lon(VX_UTM_LON_CENTER + (d * (1.0 - ds / 6.0 *
+	   (1.0 + 2.0 * t + c - ds / 20.0 * (5.0 - 2.0 * c + 28.0 * t - 3.0 *
+	   cs + 8.0 * VX_UTM_ESP + 24.0 * ts))) / cos_phi));
+  } else {
+    *lat = VX_UTM_HALF_PI * ((y < 0.0) ? -1.0 : 1.0);
+    *lon = VX_UTM_LON_CENTER;
+  }
+  *lon = *lon * VX_UTM_RAD2DEG;
+  *lat = *lat * VX_UTM_RAD2DEG;
+  return(0);
+}
+
+
+
+/* lon/lat (degrees) to UTM zone 11 (meters), vector path */
+void vx_utm11_fwd_vec(const double *, const double *, double *, double *,
+		      int);
+
+
+/* UTM zone 11 (meters) to lon/lat (degrees), vector path */
+int vx_utm11_inv_vec(const double *, const double *, double *, double *, int);
+
+
+/* lon/lat (degrees) to UTM zone 11 (meters) on the given path */
+void vx_utm11_fwd_batch(int, const double *, const double *, double *,
+			double *, int);
+
+
+/* UTM zone 11 (meters) to lon/lat (degrees) on the given path */
+int vx_utm11_inv_batch(int, const double *, const double *, double *,
+		       double *, int);
+
+
+/* Build a lookup grid over a lon/lat box */
+vx_utm_grid_t *vx_utm_grid_new(double, double, double, double, double);
+
+
+/* lon/lat (degrees) to UTM zone 11 (meters) through a lookup grid */
+void vx_utm_grid_fwd(const vx_utm_grid_t *, const double *, const double *,
+		     double *, double *, int);
+
+
+/* Free a lookup grid */
+void vx_utm_grid_free(vx_utm_grid_t *);
+
+#endif
@@ -0,0 +1,197 @@
+/**  
+   brickbench.c
+
+   compares linear (i-fastest) and bricked volume layouts for 
+     depth-major trilinear profile queries. Reports wall time and 
+     simulated cache misses per query
+**/
+
+#define _DEFAULT_SOURCE  /* Required for gettimeofday */ 
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "params.h"
+#include "vx_io.h"
+#include "vx_brick.h"
+#include "unittest_defs.h"
+
+/* Used when the model data is not installed */
+#define BRICKBENCH_NX 256
+#define BRICKBENCH_NY 256
+#define BRICKBENCH_NZ 128
+
+/* Number of random vertical profiles */
+#define BRICKBENCH_PROFILES 2000
+
+/* Simulated cache, 64 byte lines, 8 way, 1 MB */
+#define BB_LINE_SHIFT 6
+#define BB_WAYS 8
+#define BB_SETS 2048
+
+typedef struct bb_cache_t {
+  size_t tag[BB_SETS][BB_WAYS];
+  long misses;
+} bb_cache_t;
+
+
+double brickbench_now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return(tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+
+/* LRU set associative lookup, way 0 is most recent */
+void bb_touch(bb_cache_t *c, size_t addr)
+{
+  size_t line = (addr >> BB_LINE_SHIFT) + 1;
+  size_t *set = c->tag[line % BB_SETS];
+  int w;
+
+  for (w = 0; w < BB_WAYS - 1; w++) {
+    if (set[w] == line) {
+      break;
+    }
+  }
+  if (set[w] != line) {
+    c->misses++;
+  }
+  memmove(&set[1], &set[0], w * sizeof(size_t));
+  set[0] = line;
+}
+
+
+/* Trilinear sample at the center of cell i,j,k */
+float bb_linear(const float *v, const int *d, int i, int j, int k,
+		bb_cache_t *c)
+{
+  int di, dj, dk;
+  size_t idx;
+  float sum = 0.0;
+
+  for (dk = 0; dk < 2; dk++) {
+    for (dj = 0; dj < 2; dj++) {
+      for (di = 0; di < 2; di++) {
+	idx = ((size_t)(k + dk) * d[1] + (j + dj)) * d[0] + (i + di);
+	if (c != NULL) {
+	  bb_touch(c, idx * sizeof(float));
+	}
+	sum += 0.125 * v[idx];
+      }
+    }
+  }
+  return(sum);
+}
+
+
+float bb_bricked(const float *v, const vx_brick_layout_t *bl,
+		 int i, int j, int k, bb_cache_t *c)
+{
+  int di, dj, dk;
+  size_t idx;
+  float sum = 0.0;
+
+  for (dk = 0; dk < 2; dk++) {
+    for (dj = 0; dj < 2; dj++) {
+      for (di = 0; di < 2; di++) {
+	idx = vx_brick_index(bl, i + di, j + dj, k + dk);
+	if (c != NULL) {
+	  bb_touch(c, idx * sizeof(float));
+	}
+	sum += 0.125 * v[idx];
+      }
+    }
+  }
+  return(sum);
+}
+
+
+int main (int argc, char *argv[])
+{
+  const char *data_dir = MODEL_DIR;
+  char vo_path[CMLEN];
+  int dims[3] = { BRICKBENCH_NX, BRICKBENCH_NY, BRICKBENCH_NZ };
+  int *col;
+  int p, k, pass, ncells;
+  float *lin, *brk;
+  double t0, t[2];
+  float sum = 0.0;
+  long nq;
+  vx_brick_layout_t bl;
+  bb_cache_t *cache;
+  vx_io_header_t *hdr;
+
+  if (argc == 2) {
+    data_dir = argv[1];
+  }
+  sprintf(vo_path, "%s/%s", data_dir, "CVM_CM.vo");
+  hdr = vx_io_open(vo_path);
+  if (hdr != NULL) {
+    vx_io_header_getdim(hdr, "AXIS_N", dims);
+    vx_io_close(hdr);
+  }
+  ncells = dims[0] * dims[1] * dims[2];
+  if (vx_brick_setup(&bl, dims, VX_BRICK_DIM) != 0) {
+    fprintf(stderr, "ERROR: bad volume dims\n");
+    return(1);
+  }
+
+  lin = malloc((size_t)ncells * sizeof(float));
+  col = malloc(2 * BRICKBENCH_PROFILES * sizeof(int));
+  cache = calloc(1, sizeof(bb_cache_t));
+  for (k = 0; k < ncells; k++) {
+    lin[k] = (float)(k % 7919);
+  }
+  brk = (float *)vx_brick_relayout((char *)lin, sizeof(float), &bl);
+  if ((brk == NULL) || (col == NULL) || (cache == NULL)) {
+    fprintf(stderr, "ERROR: unable to allocate %d cells\n", ncells);
+    return(1);
+  }
+  srand(1);
+  for (p = 0; p < BRICKBENCH_PROFILES; p++) {
+    col[2*p] = rand() % (dims[0] - 1);
+    col[2*p+1] = rand() % (dims[1] - 1);
+  }
+  nq = (long)BRICKBENCH_PROFILES * (dims[2] - 1);
+
+  printf("volume %d x %d x %d, %d profiles, brick %d^3\n", dims[0], dims[1],
+	 dims[2], BRICKBENCH_PROFILES, bl.bdim);
+  for (pass = 0; pass < 2; pass++) {
+    /* Timed run without the cache model */
+    t0 = brickbench_now();
+    for (p = 0; p < BRICKBENCH_PROFILES; p++) {
+      for (k = 0; k < dims[2] - 1; k++) {
+	sum += (pass == 0) ? 
+	  bb_linear(lin, dims, col[2*p], col[2*p+1], k, NULL) :
+	  bb_bricked(brk, &bl, col[2*p], col[2*p+1], k, NULL);
+      }
+    }
+    t[pass] = brickbench_now() - t0;
+
+    memset(cache, 0, sizeof(bb_cache_t));
+    for (p = 0; p < BRICKBENCH_PROFILES; p++) {
+      for (k = 0; k < dims[2] - 1; k++) {
+	if (pass == 0) {
+	  bb_linear(lin, dims, col[2*p], col[2*p+1], k, cache);
+	} else {
+	  bb_bricked(brk, &bl, col[2*p], col[2*p+1], k, cache);
+	}
+      }
+    }
+    printf("%-8s %8.1f ns/query  %6.3f cache misses/query\n",
+	   (pass == 0) ? "linear" : "bricked", t[pass] * 1.0e9 / nq,
+	   (double)cache->misses / nq);
+  }
+  if (sum == 0.5) {
+    printf("\n");
+  }
+
+  free(lin);
+  free(brk);
+  free(col);
+  free(cache);
+  return(0);
+}
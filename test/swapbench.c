@@ -0,0 +1,127 @@
+/**  
+   swapbench.c
+
+   times the voxet endian swap, the original per-cell union zahl 
+     loop against each vx_swap4 kernel the cpu supports, on volumes
+     sized from the model .vo headers
+**/
+
+#define _DEFAULT_SOURCE  /* Required for gettimeofday */ 
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "params.h"
+#include "voxet.h"
+#include "utils.h"
+#include "vx_io.h"
+#include "unittest_defs.h"
+
+/* Voxet headers to size the benchmark volumes from */
+const char *swapbench_vo[] = { "CVM_CM.vo", "CVMHB-San-Gabriel-Basin.vo",
+			       "interfaces.vo" };
+#define SWAPBENCH_NUM_VO 3
+
+/* Used when the model data is not installed */
+#define SWAPBENCH_DEFAULT_CELLS (64*1024*1024)
+
+
+double swapbench_now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return(tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+
+/* The swap loop vx_io_loadvolume used before vx_swap4 */
+void swapbench_legacy(char *buffer, int ESIZE, int ncells)
+{
+  int j;
+  union zahl l,*h;
+
+  for (j = 0; j < ncells; j++) {
+    h = (union zahl *)&(buffer[j*ESIZE]);
+    l.c[3]=h->c[0];
+    l.c[2]=h->c[1];
+    l.c[1]=h->c[2];
+    l.c[0]=h->c[3];
+    memcpy(&(buffer[j*ESIZE]), &l, sizeof(union zahl));
+  }
+}
+
+
+int swapbench_run(const char *name, int ncells)
+{
+  char *buf, *ref;
+  size_t len = (size_t)ncells * 4;
+  size_t i;
+  double t0, t_legacy, t;
+  vx_swap_kernel_t k, best;
+
+  buf = malloc(len);
+  ref = malloc(len);
+  if ((buf == NULL) || (ref == NULL)) {
+    fprintf(stderr, "ERROR: unable to allocate %d cells\n", ncells);
+    return(1);
+  }
+  for (i = 0; i < len; i++) {
+    buf[i] = (char)(i * 31 + 7);
+  }
+  memcpy(ref, buf, len);
+
+  t0 = swapbench_now();
+  swapbench_legacy(ref, 4, ncells);
+  t_legacy = swapbench_now() - t0;
+  printf("%-28s %10d cells  %-7s %8.3f ms\n", name, ncells, "legacy",
+	 t_legacy * 1000.0);
+
+  best = vx_swap4_select();
+  for (k = VX_SWAP_SCALAR; k <= best; k++) {
+    for (i = 0; i < len; i++) {
+      buf[i] = (char)(i * 31 + 7);
+    }
+    t0 = swapbench_now();
+    vx_swap4(buf, ncells, k);
+    t = swapbench_now() - t0;
+    printf("%-28s %10d cells  %-7s %8.3f ms  %5.2fx%s\n", name, ncells, 
+	   vx_swap4_name(k), t * 1000.0, (t > 0.0) ? t_legacy / t : 0.0,
+	   (memcmp(buf, ref, len) == 0) ? "" : "  MISMATCH");
+  }
+
+  free(buf);
+  free(ref);
+  return(0);
+}
+
+
+int main (int argc, char *argv[])
+{
+  const char *data_dir = MODEL_DIR;
+  char vo_path[CMLEN];
+  int dims[3];
+  int i, found = 0;
+
+  if (argc == 2) {
+    data_dir = argv[1];
+  }
+
+  for (i = 0; i < SWAPBENCH_NUM_VO; i++) {
+    sprintf(vo_path, "%s/%s", data_dir, swapbench_vo[i]);
+    if (vx_io_init(vo_path) != 0) {
+      continue;
+    }
+    if (vx_io_getdim("AXIS_N", dims) == 0) {
+      swapbench_run(swapbench_vo[i], dims[0] * dims[1] * dims[2]);
+      found++;
+    }
+    vx_io_finalize();
+  }
+
+  if (found == 0) {
+    swapbench_run("synthetic", SWAPBENCH_DEFAULT_CELLS);
+  }
+
+  return(0);
+}
@@ -0,0 +1,456 @@
+/**  
+   test_gctpc_exec.c
+
+   exercises the gctpc entry points used by the model,
+     gctp, gctp_batch, gctp_r, gctp_ctx_errors, contexts sharing
+       transverse mercator state
+**/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "params.h"
+#include "unittest_defs.h"
+#include "test_gctpc_exec.h"
+
+int GCTPC_TESTS=5;
+
+/* Coordinate transforms, gctpc */
+void gctp();
+void gctp_batch();
+void gctp_r();
+struct gctp_ctx *gctp_ctx_new();
+void gctp_ctx_free(struct gctp_ctx *);
+long gctp_ctx_errors(struct gctp_ctx *);
+
+/* Threads converting on their own contexts, alternating UTM zones */
+#define GCTPC_TEST_THREADS 4
+#define GCTPC_TEST_REPEAT 8
+
+/* Geographic degrees and UTM zone 11 meters, as in coor_para.h */
+static long gctpc_geo = 0;
+static long gctpc_utm = 1;
+static long gctpc_zone = 11;
+static long gctpc_nozone = 0;
+static long gctpc_tm = 9;
+static long gctpc_datum = 0;
+static long gctpc_degrees = 4;
+static long gctpc_meters = 2;
+static long gctpc_ipr = 5;
+static long gctpc_jpr = 5;
+static char gctpc_efile[CMLEN] = "errfile";
+static char gctpc_pfile[CMLEN] = "pfile";
+static char gctpc_file27[CMLEN] = "proj27";
+static char gctpc_file83[CMLEN] = "file83";
+
+/* Per thread conversion job */
+typedef struct gctpc_test_job_t {
+  long zone;
+  int n;
+  const double *lon;
+  const double *lat;
+  double *x;
+  double *y;
+  long iflg;
+} gctpc_test_job_t;
+
+
+/* Read the lon/lat pairs of a test input file */
+int read_gctpc_points(const char *filename, double **lon, double **lat)
+{
+  char infile[1280];
+  char currentdir[1000];
+  char line[1000];
+  FILE *fp;
+  int n = 0, max = 1024;
+
+  getcwd(currentdir, 1000);
+  sprintf(infile, "%s/%s", currentdir, filename);
+  fp = fopen(infile, "r");
+  if (fp == NULL) {
+    return(0);
+  }
+  *lon = malloc(max * sizeof(double));
+  *lat = malloc(max * sizeof(double));
+  while (fgets(line, 1000, fp) != NULL) {
+    if (n == max) {
+      max *= 2;
+      *lon = realloc(*lon, max * sizeof(double));
+      *lat = realloc(*lat, max * sizeof(double));
+    }
+    if ((line[0] != '#') &&
+	(sscanf(line, "%lf %lf", &(*lon)[n], &(*lat)[n]) == 2)) {
+      n++;
+    }
+  }
+  fclose(fp);
+  return(n);
+}
+
+
+int test_gctp_batch_fwd()
+{
+  double *lon = NULL, *lat = NULL, *x, *y;
+  double inparm[15], outparm[15], in[2], out[2];
+  long iflg;
+  int i, n;
+
+  printf("Test: gctp_batch lon/lat to UTM against gctp\n");
+
+  n = read_gctpc_points("./inputs/test-grid-depth.in", &lon, &lat);
+  if (n == 0) {
+    return _failure("cannot read test-grid-depth.in");
+  }
+  memset(inparm, 0, sizeof(inparm));
+  memset(outparm, 0, sizeof(outparm));
+  x = malloc(n * sizeof(double));
+  y = malloc(n * sizeof(double));
+  gctp_batch((long)n, lon, lat, &gctpc_geo, &gctpc_nozone, inparm,
+	     &gctpc_degrees, &gctpc_datum, &gctpc_ipr, gctpc_efile,
+	     &gctpc_jpr, gctpc_pfile, x, y, &gctpc_utm, &gctpc_zone, outparm,
+	     &gctpc_meters, &gctpc_datum, gctpc_file27, gctpc_file83, &iflg);
+  if (iflg != 0) {
+    return _failure("gctp_batch failure");
+  }
+  for (i = 0; i < n; i++) {
+    in[0] = lon[i];
+    in[1] = lat[i];
+    gctp(in, &gctpc_geo, &gctpc_nozone, inparm, &gctpc_degrees,
+	 &gctpc_datum, &gctpc_ipr, gctpc_efile, &gctpc_jpr, gctpc_pfile,
+	 out, &gctpc_utm, &gctpc_zone, outparm, &gctpc_meters, &gctpc_datum,
+	 gctpc_file27, gctpc_file83, &iflg);
+    if ((out[0] != x[i]) || (out[1] != y[i])) {
+      break;
+    }
+  }
+  free(lon);
+  free(lat);
+  free(x);
+  free(y);
+  if (i < n) {
+    return _failure("batch differs from gctp");
+  }
+
+  return _success();
+}
+
+
+int test_gctp_batch_inv()
+{
+  double *lon = NULL, *lat = NULL, *x, *y;
+  double inparm[15], outparm[15];
+  long iflg;
+  int i, n;
+
+  printf("Test: gctp_batch UTM round trip in place\n");
+
+  n = read_gctpc_points("./inputs/test-grid-elev.in", &lon, &lat);
+  if (n == 0) {
+    return _failure("cannot read test-grid-elev.in");
+  }
+  memset(inparm, 0, sizeof(inparm));
+  memset(outparm, 0, sizeof(outparm));
+  x = malloc(n * sizeof(double));
+  y = malloc(n * sizeof(double));
+  memcpy(x, lon, n * sizeof(double));
+  memcpy(y, lat, n * sizeof(double));
+  gctp_batch((long)n, x, y, &gctpc_geo, &gctpc_nozone, inparm,
+	     &gctpc_degrees, &gctpc_datum, &gctpc_ipr, gctpc_efile,
+	     &gctpc_jpr, gctpc_pfile, x, y, &gctpc_utm, &gctpc_zone, outparm,
+	     &gctpc_meters, &gctpc_datum, gctpc_file27, gctpc_file83, &iflg);
+  if (iflg == 0) {
+    gctp_batch((long)n, x, y, &gctpc_utm, &gctpc_zone, outparm,
+	       &gctpc_meters, &gctpc_datum, &gctpc_ipr, gctpc_efile,
+	       &gctpc_jpr, gctpc_pfile, x, y, &gctpc_geo, &gctpc_nozone,
+	       inparm, &gctpc_degrees, &gctpc_datum, gctpc_file27,
+	       gctpc_file83, &iflg);
+  }
+  if (iflg != 0) {
+    return _failure("gctp_batch failure");
+  }
+  for (i = 0; i < n; i++) {
+    if ((test_assert_double(x[i], lon[i]) != 0) ||
+	(test_assert_double(y[i], lat[i]) != 0)) {
+      break;
+    }
+  }
+  free(lon);
+  free(lat);
+  free(x);
+  free(y);
+  if (i < n) {
+    return _failure("round trip differs");
+  }
+
+  return _success();
+}
+
+
+/* Convert the job points one at a time on a private context */
+static void *gctpc_test_worker(void *arg)
+{
+  gctpc_test_job_t *job = arg;
+  struct gctp_ctx *ctx;
+  double inparm[15], outparm[15], in[2], out[2];
+  int i, r;
+
+  memset(inparm, 0, sizeof(inparm));
+  memset(outparm, 0, sizeof(outparm));
+  ctx = gctp_ctx_new();
+  if (ctx == NULL) {
+    job->iflg = -1;
+    return(NULL);
+  }
+  job->iflg = 0;
+  for (r = 0; (r < GCTPC_TEST_REPEAT) && (job->iflg == 0); r++) {
+    for (i = 0; i < job->n; i++) {
+      in[0] = job->lon[i];
+      in[1] = job->lat[i];
+      gctp_r(ctx, in, &gctpc_geo, &gctpc_nozone, inparm, &gctpc_degrees,
+	     &gctpc_datum, &gctpc_ipr, gctpc_efile, &gctpc_jpr, gctpc_pfile,
+	     out, &gctpc_utm, &job->zone, outparm, &gctpc_meters,
+	     &gctpc_datum, gctpc_file27, gctpc_file83, &job->iflg);
+      if (job->iflg != 0) {
+	break;
+      }
+      job->x[i] = out[0];
+      job->y[i] = out[1];
+    }
+  }
+  gctp_ctx_free(ctx);
+  return(NULL);
+}
+
+
+int test_gctp_ctx_threads()
+{
+  double *lon = NULL, *lat = NULL, *x, *y;
+  double inparm[15], outparm[15], in[2], out[2];
+  gctpc_test_job_t jobs[GCTPC_TEST_THREADS];
+  pthread_t threads[GCTPC_TEST_THREADS];
+  long iflg, zone;
+  int i, n, t;
+
+  printf("Test: gctp_r concurrent conversions to zones 10 and 11\n");
+
+  n = read_gctpc_points("./inputs/test-grid-depth.in", &lon, &lat);
+  if (n == 0) {
+    return _failure("cannot read test-grid-depth.in");
+  }
+  x = malloc(GCTPC_TEST_THREADS * n * sizeof(double));
+  y = malloc(GCTPC_TEST_THREADS * n * sizeof(double));
+  for (t = 0; t < GCTPC_TEST_THREADS; t++) {
+    jobs[t].zone = (t % 2 == 0) ? gctpc_zone : gctpc_zone - 1;
+    jobs[t].n = n;
+    jobs[t].lon = lon;
+    jobs[t].lat = lat;
+    jobs[t].x = &x[t * n];
+    jobs[t].y = &y[t * n];
+    pthread_create(&threads[t], NULL, gctpc_test_worker, &jobs[t]);
+  }
+  for (t = 0; t < GCTPC_TEST_THREADS; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  /* Serial reference through the default context */
+  memset(inparm, 0, sizeof(inparm));
+  memset(outparm, 0, sizeof(outparm));
+  for (t = 0; t < GCTPC_TEST_THREADS; t++) {
+    if (jobs[t].iflg != 0) {
+      break;
+    }
+    zone = jobs[t].zone;
+    for (i = 0; i < n; i++) {
+      in[0] = lon[i];
+      in[1] = lat[i];
+      gctp(in, &gctpc_geo, &gctpc_nozone, inparm, &gctpc_degrees,
+	   &gctpc_datum, &gctpc_ipr, gctpc_efile, &gctpc_jpr, gctpc_pfile,
+	   out, &gctpc_utm, &zone, outparm, &gctpc_meters, &gctpc_datum,
+	   gctpc_file27, gctpc_file83, &iflg);
+      if ((out[0] != jobs[t].x[i]) || (out[1] != jobs[t].y[i])) {
+	break;
+      }
+    }
+    if (i < n) {
+      break;
+    }
+  }
+  free(lon);
+  free(lat);
+  free(x);
+  free(y);
+  if (t < GCTPC_TEST_THREADS) {
+    return _failure("threaded conversions differ from gctp");
+  }
+
+  return _success();
+}
+
+
+int test_gctp_ctx_quiet()
+{
+  struct gctp_ctx *ctx;
+  double inparm[15], outparm[15], in[2], out[2], ref[2];
+  long iflg, badzone = 61;
+  int i;
+
+  printf("Test: gctp_r quiet reporting counts errors\n");
+
+  ctx = gctp_ctx_new();
+  if (ctx == NULL) {
+    return _failure("gctp_ctx_new failure");
+  }
+  memset(inparm, 0, sizeof(inparm));
+  memset(outparm, 0, sizeof(outparm));
+  in[0] = -118.0;
+  in[1] = 34.0;
+
+  /* A zone gctp rejects, then a good one, twice */
+  for (i = 0; i < 2; i++) {
+    gctp_r(ctx, in, &gctpc_geo, &gctpc_nozone, inparm, &gctpc_degrees,
+	   &gctpc_datum, &gctpc_ipr, gctpc_efile, &gctpc_jpr, gctpc_pfile,
+	   out, &gctpc_utm, &badzone, outparm, &gctpc_meters, &gctpc_datum,
+	   gctpc_file27, gctpc_file83, &iflg);
+    if (iflg == 0) {
+      gctp_ctx_free(ctx);
+      return _failure("zone 61 accepted");
+    }
+    gctp_r(ctx, in, &gctpc_geo, &gctpc_nozone, inparm, &gctpc_degrees,
+	   &gctpc_datum, &gctpc_ipr, gctpc_efile, &gctpc_jpr, gctpc_pfile,
+	   out, &gctpc_utm, &gctpc_zone, outparm, &gctpc_meters,
+	   &gctpc_datum, gctpc_file27, gctpc_file83, &iflg);
+  }
+  if ((iflg != 0) || (test_assert_int((int)gctp_ctx_errors(ctx), 2) != 0)) {
+    gctp_ctx_free(ctx);
+    return _failure("suppressed errors not counted");
+  }
+  gctp_ctx_free(ctx);
+
+  gctp(in, &gctpc_geo, &gctpc_nozone, inparm, &gctpc_degrees,
+       &gctpc_datum, &gctpc_ipr, gctpc_efile, &gctpc_jpr, gctpc_pfile,
+       ref, &gctpc_utm, &gctpc_zone, outparm, &gctpc_meters, &gctpc_datum,
+       gctpc_file27, gctpc_file83, &iflg);
+  if ((iflg != 0) || (out[0] != ref[0]) || (out[1] != ref[1])) {
+    return _failure("conversion after errors differs from gctp");
+  }
+
+  return _success();
+}
+
+
+int test_gctp_ctx_shared()
+{
+  struct gctp_ctx *ctx[2];
+  double inparm[15], outparm[2][15], in[2], out[2], ref[2][2];
+  long iflg = 0;
+  int c, r, differ = 0;
+
+  printf("Test: gctp_r contexts with different transverse mercators\n");
+
+  /* Central meridians 118W and 117W, packed degrees */
+  memset(inparm, 0, sizeof(inparm));
+  memset(outparm, 0, sizeof(outparm));
+  outparm[0][2] = outparm[1][2] = 0.9996;
+  outparm[0][4] = -118000000.0;
+  outparm[1][4] = -117000000.0;
+  in[0] = -117.5;
+  in[1] = 34.0;
+
+  /* Each meridian on a context of its own, then both contexts
+     alternating */
+  for (r = 0; (r < 5) && (iflg == 0); r++) {
+    for (c = 0; c < 2; c++) {
+      if (r < 2) {
+	ctx[c] = gctp_ctx_new();
+      }
+      gctp_r(ctx[c], in, &gctpc_geo, &gctpc_nozone, inparm, &gctpc_degrees,
+	     &gctpc_datum, &gctpc_ipr, gctpc_efile, &gctpc_jpr, gctpc_pfile,
+	     out, &gctpc_tm, &gctpc_nozone, outparm[c], &gctpc_meters,
+	     &gctpc_datum, gctpc_file27, gctpc_file83, &iflg);
+      if (r == 0) {
+	ref[c][0] = out[0];
+	ref[c][1] = out[1];
+	gctp_ctx_free(ctx[c]);
+	ctx[c] = NULL;
+      } else if ((out[0] != ref[c][0]) || (out[1] != ref[c][1])) {
+	differ = 1;
+      }
+    }
+  }
+  gctp_ctx_free(ctx[0]);
+  gctp_ctx_free(ctx[1]);
+
+  /* The meridians are on either side of the point */
+  if ((iflg != 0) || differ || (ref[0][0] <= 0.0) || (ref[1][0] >= 0.0)) {
+    return _failure("contexts share transverse mercator parameters");
+  }
+
+  return _success();
+}
+
+
+int suite_gctpc_exec(const char *xmldir)
+{
+  suite_t suite;
+  char logfile[1280];
+  FILE *lf = NULL;
+
+  /* Setup test suite */
+  strcpy(suite.suite_name, "suite_gctpc_exec");
+
+  suite.num_tests = GCTPC_TESTS;
+  suite.tests = malloc(suite.num_tests * sizeof(test_t));
+  if (suite.tests == NULL) {
+    fprintf(stderr, "ERROR: Failed to alloc test structure\n");
+    return(1);
+  }
+  test_get_time(&suite.exec_time);
+
+  /* Setup test cases */
+  strcpy(suite.tests[0].test_name, "test_gctp_batch_fwd");
+  suite.tests[0].test_func = &test_gctp_batch_fwd;
+  suite.tests[0].elapsed_time = 0.0;
+
+  strcpy(suite.tests[1].test_name, "test_gctp_batch_inv");
+  suite.tests[1].test_func = &test_gctp_batch_inv;
+  suite.tests[1].elapsed_time = 0.0;
+
+  strcpy(suite.tests[2].test_name, "test_gctp_ctx_threads");
+  suite.tests[2].test_func = &test_gctp_ctx_threads;
+  suite.tests[2].elapsed_time = 0.0;
+
+  strcpy(suite.tests[3].test_name, "test_gctp_ctx_quiet");
+  suite.tests[3].test_func = &test_gctp_ctx_quiet;
+  suite.tests[3].elapsed_time = 0.0;
+
+  strcpy(suite.tests[4].test_name, "test_gctp_ctx_shared");
+  suite.tests[4].test_func = &test_gctp_ctx_shared;
+  suite.tests[4].elapsed_time = 0.0;
+
+  if (test_run_suite(&suite) != 0) {
+    fprintf(stderr, "ERROR: Failed to execute tests\n");
+    return(1);
+  }
+
+  if (xmldir != NULL) {
+    sprintf(logfile, "%s/%s.xml", xmldir, suite.suite_name);
+    lf = init_log(logfile);
+    if (lf == NULL) {
+      fprintf(stderr, "ERROR: Failed to initialize logfile\n");
+      return(1);
+    }
+    
+    if (write_log(lf, &suite) != 0) {
+      fprintf(stderr, "ERROR: Failed to write test log\n");
+      return(1);
+    }
+    
+    close_log(lf);
+  }
+
+  free(suite.tests);
+
+  return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef TEST_GCTPC_EXEC_H
+#define TEST_GCTPC_EXEC_H
+
+int suite_gctpc_exec(const char *xmldir);
+
+#endif
@@ -0,0 +1,594 @@
+/**  
+   test_vx_io_exec.c
+
+   exercises the voxet io layer directly on small synthetic
+     volumes, vx_io_loadvolume, vx_io_mapvolume,
+       vx_io_writenative, vx_io_verifynative, vx_swap4,
+       vx_io_init and the header getters, vx_io_open,
+       vx_io_loadvolumes, vx_lazy_open, vx_lazy_get,
+       vx_brick_relayout
+**/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include "params.h"
+#include "vx_io.h"
+#include "utils.h"
+#include "vx_brick.h"
+#include "unittest_defs.h"
+#include "test_vx_io_exec.h"
+
+int VX_IO_TESTS=8;
+
+/* Synthetic volume */
+#define VX_IO_TEST_FILE "test-vx-io-volume@@"
+#define VX_IO_TEST_CELLS 1000
+#define VX_IO_TEST_VO "test-vx-io-header.vo"
+
+
+/* Header with keys that substring matching confuses */
+int write_test_header(const char *filename)
+{
+  FILE *fp;
+
+  fp = fopen(filename, "w");
+  if (fp == NULL) {
+    fprintf(stderr,"ERROR: cannot open %s\n", filename);
+    return(1);
+  }
+  fprintf(fp, "GOCAD Voxet 1\n");
+  fprintf(fp, "AXIS_O 100.5 200.5 -3000\n");
+  fprintf(fp, "AXIS_U 1000 0 0\n");
+  fprintf(fp, "AXIS_NAME \"X\" \"Y\" \"Z\"\n");
+  fprintf(fp, "AXIS_N 11 21 31\n");
+  fprintf(fp, "PROPERTY 10 vp63_basin\n");
+  fprintf(fp, "PROP_ESIZE 10 2\n");
+  fprintf(fp, "PROP_NO_DATA_VALUE 10 -99\n");
+  fprintf(fp, "PROP_FILE 10 basin_vp@@\n");
+  fprintf(fp, "PROPERTY 1 vp\n");
+  fprintf(fp, "PROP_ESIZE 1 4\n");
+  fprintf(fp, "PROP_NO_DATA_VALUE 1 -99999\n");
+  fprintf(fp, "PROP_FILE 1 vp@@\n");
+  fclose(fp);
+  return(0);
+}
+
+
+/* Write a big endian volume the way GOCAD does */
+int write_test_volume(const char *filename, int ncells)
+{
+  FILE *fp;
+  int i, one = 1;
+  float val;
+  unsigned char *c, be[4];
+
+  fp = fopen(filename, "w");
+  if (fp == NULL) {
+    fprintf(stderr,"ERROR: cannot open %s\n", filename);
+    return(1);
+  }
+  for (i = 0; i < ncells; i++) {
+    val = 1000.0 + i * 0.5;
+    c = (unsigned char *)&val;
+    if (*(char *)&one == 1) {
+      /* little endian host */
+      be[0] = c[3]; be[1] = c[2]; be[2] = c[1]; be[3] = c[0];
+    } else {
+      memcpy(be, c, 4);
+    }
+    if (fwrite(be, 4, 1, fp) != 1) {
+      fclose(fp);
+      return(1);
+    }
+  }
+  fclose(fp);
+  return(0);
+}
+
+
+int check_test_volume(float *buf, int ncells)
+{
+  int i;
+
+  for (i = 0; i < ncells; i++) {
+    if (test_assert_float(buf[i], 1000.0 + i * 0.5) != 0) {
+      return(1);
+    }
+  }
+  return(0);
+}
+
+
+int test_vx_io_load_map()
+{
+  char currentdir[1000];
+  float *buf;
+  char *mbuf;
+
+  printf("Test: vx_io load and map volume\n");
+
+  getcwd(currentdir, 1000);
+  if (write_test_volume(VX_IO_TEST_FILE, VX_IO_TEST_CELLS) != 0) {
+    return _failure("write test volume failed");
+  }
+
+  buf = malloc(VX_IO_TEST_CELLS * sizeof(float));
+  if (test_assert_int(vx_io_loadvolume(currentdir, VX_IO_TEST_FILE, 4,
+				       VX_IO_TEST_CELLS, (char *)buf), 0) != 0) {
+    free(buf);
+    return _failure("vx_io_loadvolume failure");
+  }
+  if (check_test_volume(buf, VX_IO_TEST_CELLS) != 0) {
+    free(buf);
+    return _failure("loaded values differ");
+  }
+  free(buf);
+
+  if (test_assert_int(vx_io_mapvolume(currentdir, VX_IO_TEST_FILE, 4,
+				      VX_IO_TEST_CELLS, &mbuf), 0) != 0) {
+    return _failure("vx_io_mapvolume failure");
+  }
+  if (check_test_volume((float *)mbuf, VX_IO_TEST_CELLS) != 0) {
+    vx_io_unmapvolume(mbuf);
+    return _failure("mapped values differ");
+  }
+  if (test_assert_int(vx_io_unmapvolume(mbuf), 0) != 0) {
+    return _failure("vx_io_unmapvolume failure");
+  }
+
+  /* A volume shorter than requested must not map */
+  if (test_assert_int(vx_io_mapvolume(currentdir, VX_IO_TEST_FILE, 4,
+				      VX_IO_TEST_CELLS+1, &mbuf), 1) != 0) {
+    return _failure("short volume mapped");
+  }
+
+  unlink(VX_IO_TEST_FILE);
+
+  return _success();
+}
+
+
+int test_vx_io_native()
+{
+  char currentdir[1000];
+  char native[1280];
+  float *buf;
+  char *mbuf;
+  FILE *fp;
+  float junk = -1.0;
+  int dims[3] = { 10, 10, 10 };
+
+  printf("Test: vx_io native cache files\n");
+
+  getcwd(currentdir, 1000);
+  sprintf(native, "%s%s", VX_IO_TEST_FILE, VX_IO_NATIVE_SUFFIX);
+  if (write_test_volume(VX_IO_TEST_FILE, VX_IO_TEST_CELLS) != 0) {
+    return _failure("write test volume failed");
+  }
+
+  if (test_assert_int(vx_io_writenative(currentdir, VX_IO_TEST_FILE, 4,
+					dims), 0) != 0) {
+    return _failure("vx_io_writenative failure");
+  }
+  if (test_assert_int(vx_io_checknative(currentdir, VX_IO_TEST_FILE, 4,
+					VX_IO_TEST_CELLS, NULL), 0) != 0) {
+    return _failure("vx_io_checknative failure");
+  }
+  if (test_assert_int(vx_io_verifynative(currentdir, VX_IO_TEST_FILE), 
+		      0) != 0) {
+    return _failure("vx_io_verifynative failure");
+  }
+
+  /* Rewriting a cache leaves existing mappings of it whole */
+  if ((vx_io_mapvolume(currentdir, VX_IO_TEST_FILE, 4,
+		       VX_IO_TEST_CELLS, &mbuf) != 0) ||
+      (vx_io_writenative(currentdir, VX_IO_TEST_FILE, 4, dims) != 0) ||
+      (check_test_volume((float *)mbuf, VX_IO_TEST_CELLS) != 0)) {
+    return _failure("mapped cache rewritten in place");
+  }
+  vx_io_unmapvolume(mbuf);
+
+  /* A corrupt payload is caught by the offline check */
+  fp = fopen(native, "r+");
+  if ((fp == NULL) || (fseek(fp, VX_IO_NATIVE_HDRLEN, SEEK_SET) != 0) ||
+      (fwrite(&junk, sizeof(float), 1, fp) != 1)) {
+    return _failure("corrupt cache failure");
+  }
+  fclose(fp);
+  if (test_assert_int(vx_io_verifynative(currentdir, VX_IO_TEST_FILE),
+		      1) != 0) {
+    return _failure("corrupt cache verified");
+  }
+
+  /* A rewritten original makes the cache stale */
+  if ((write_test_volume(VX_IO_TEST_FILE, VX_IO_TEST_CELLS) != 0) ||
+      (test_assert_int(vx_io_checknative(currentdir, VX_IO_TEST_FILE, 4,
+					 VX_IO_TEST_CELLS, NULL), 1) != 0)) {
+    return _failure("stale cache accepted");
+  }
+  if (vx_io_writenative(currentdir, VX_IO_TEST_FILE, 4, dims) != 0) {
+    return _failure("vx_io_writenative failure");
+  }
+
+  /* Loads must come from the cache and need no swap */
+  unlink(VX_IO_TEST_FILE);
+  buf = malloc(VX_IO_TEST_CELLS * sizeof(float));
+  if ((vx_io_loadvolume(currentdir, VX_IO_TEST_FILE, 4,
+			VX_IO_TEST_CELLS, (char *)buf) != 0) ||
+      (check_test_volume(buf, VX_IO_TEST_CELLS) != 0)) {
+    free(buf);
+    return _failure("native load failure");
+  }
+  free(buf);
+
+  if ((vx_io_mapvolume(currentdir, VX_IO_TEST_FILE, 4,
+		       VX_IO_TEST_CELLS, &mbuf) != 0) ||
+      (check_test_volume((float *)mbuf, VX_IO_TEST_CELLS) != 0)) {
+    return _failure("native map failure");
+  }
+  vx_io_unmapvolume(mbuf);
+
+  /* A cache of the wrong size is ignored */
+  if (test_assert_int(vx_io_checknative(currentdir, VX_IO_TEST_FILE, 4,
+					VX_IO_TEST_CELLS/2, NULL), 1) != 0) {
+    return _failure("mismatched cache accepted");
+  }
+
+  unlink(native);
+
+  return _success();
+}
+
+
+int test_vx_io_swap()
+{
+  /* Odd length exercises the scalar tail of the vector kernels */
+  const int ncells = 1037;
+  unsigned char *buf;
+  int i, k;
+
+  printf("Test: vx_swap4 kernels\n");
+
+  buf = malloc(ncells * 4);
+  for (k = VX_SWAP_SCALAR; k <= vx_swap4_select(); k++) {
+    for (i = 0; i < ncells * 4; i++) {
+      buf[i] = (unsigned char)i;
+    }
+    if (test_assert_int(vx_swap4((char *)buf, ncells, k), 0) != 0) {
+      free(buf);
+      return _failure("supported kernel refused");
+    }
+    for (i = 0; i < ncells * 4; i++) {
+      if (buf[i] != (unsigned char)((i & ~3) + 3 - (i & 3))) {
+	free(buf);
+	return _failure("swapped bytes differ");
+      }
+    }
+  }
+  free(buf);
+
+  return _success();
+}
+
+
+int test_vx_io_header()
+{
+  float vec[3];
+  int dims[3];
+  int size;
+  float val;
+  char name[CMLEN];
+
+  printf("Test: vx_io header lookups\n");
+
+  if (write_test_header(VX_IO_TEST_VO) != 0) {
+    return _failure("write test header failed");
+  }
+  if (test_assert_int(vx_io_init(VX_IO_TEST_VO), 0) != 0) {
+    return _failure("vx_io_init failure");
+  }
+
+  if ((vx_io_getvec("AXIS_O", vec) != 0) || 
+      (test_assert_float(vec[0], 100.5) != 0) ||
+      (test_assert_float(vec[2], -3000.0) != 0)) {
+    vx_io_finalize();
+    return _failure("AXIS_O lookup");
+  }
+  /* AXIS_NAME must not be taken for AXIS_N */
+  if ((vx_io_getdim("AXIS_N ", dims) != 0) || 
+      (test_assert_int(dims[0], 11) != 0) ||
+      (test_assert_int(dims[2], 31) != 0)) {
+    vx_io_finalize();
+    return _failure("AXIS_N lookup");
+  }
+  /* Property 1 must not be taken for property 10 */
+  if ((vx_io_getpropsize("PROP_ESIZE", 1, &size) != 0) ||
+      (test_assert_int(size, 4) != 0) ||
+      (vx_io_getpropval("PROP_NO_DATA_VALUE", 1, &val) != 0) ||
+      (test_assert_float(val, -99999.0) != 0) ||
+      (vx_io_getpropname("PROP_FILE", 1, name) != 0) ||
+      (strcmp(name, "vp@@") != 0)) {
+    vx_io_finalize();
+    return _failure("property 1 lookup");
+  }
+  if ((test_assert_int(vx_io_getpropkey("vp"), 1) != 0) ||
+      (test_assert_int(vx_io_getpropkey("vp63_basin"), 10) != 0) ||
+      (test_assert_int(vx_io_getpropkey("vp63"), 10) != 0) ||
+      (test_assert_int(vx_io_getpropkey("vs"), 0) != 0)) {
+    vx_io_finalize();
+    return _failure("property key lookup");
+  }
+  if (test_assert_int(vx_io_getpropname("PROP_FILE", 2, name), 1) != 0) {
+    vx_io_finalize();
+    return _failure("missing property found");
+  }
+
+  vx_io_finalize();
+  unlink(VX_IO_TEST_VO);
+
+  return _success();
+}
+
+
+int test_vx_io_open()
+{
+  vx_io_header_t *h1, *h2;
+  int dims[3];
+  char name[CMLEN];
+
+  printf("Test: vx_io independent header objects\n");
+
+  if (write_test_header(VX_IO_TEST_VO) != 0) {
+    return _failure("write test header failed");
+  }
+
+  /* Two headers and the legacy reader all open at once */
+  h1 = vx_io_open(VX_IO_TEST_VO);
+  h2 = vx_io_open(VX_IO_TEST_VO);
+  if ((h1 == NULL) || (h2 == NULL) || (vx_io_init(VX_IO_TEST_VO) != 0)) {
+    return _failure("vx_io_open failure");
+  }
+  if (test_assert_int(vx_io_init(VX_IO_TEST_VO), 1) != 0) {
+    return _failure("second vx_io_init accepted");
+  }
+  vx_io_close(h1);
+  if ((vx_io_header_getdim(h2, "AXIS_N", dims) != 0) ||
+      (test_assert_int(dims[1], 21) != 0) ||
+      (vx_io_header_getpropname(h2, "PROPERTY", 10, name) != 0) ||
+      (strcmp(name, "vp63_basin") != 0) ||
+      (vx_io_getdim("AXIS_N", dims) != 0)) {
+    return _failure("lookup after close of another header");
+  }
+  vx_io_close(h2);
+  vx_io_finalize();
+
+  if (vx_io_open("no-such-file.vo") != NULL) {
+    return _failure("missing header opened");
+  }
+
+  unlink(VX_IO_TEST_VO);
+
+  return _success();
+}
+
+
+int test_vx_io_loadvolumes()
+{
+  char currentdir[1000];
+  vx_io_load_t jobs[4];
+  int i;
+
+  printf("Test: vx_io concurrent volume loads\n");
+
+  getcwd(currentdir, 1000);
+  if (write_test_volume(VX_IO_TEST_FILE, VX_IO_TEST_CELLS) != 0) {
+    return _failure("write test volume failed");
+  }
+
+  for (i = 0; i < 4; i++) {
+    jobs[i].data_dir = currentdir;
+    jobs[i].FN = VX_IO_TEST_FILE;
+    jobs[i].ESIZE = 4;
+    jobs[i].ncells = VX_IO_TEST_CELLS;
+    jobs[i].map = i % 2;
+    jobs[i].buffer = jobs[i].map ? NULL : 
+      malloc(VX_IO_TEST_CELLS * sizeof(float));
+  }
+  jobs[3].FN = "no-such-volume@@";
+
+  /* Only the missing file may fail */
+  if (test_assert_int(vx_io_loadvolumes(jobs, 4, 3), 1) != 0) {
+    return _failure("vx_io_loadvolumes failure count");
+  }
+  for (i = 0; i < 3; i++) {
+    if ((jobs[i].status != 0) || 
+	(check_test_volume((float *)jobs[i].buffer, VX_IO_TEST_CELLS) != 0)) {
+      return _failure("loaded values differ");
+    }
+  }
+  if (jobs[3].status == 0) {
+    return _failure("missing volume loaded");
+  }
+
+  free(jobs[0].buffer);
+  free(jobs[2].buffer);
+  vx_io_unmapvolume(jobs[1].buffer);
+  unlink(VX_IO_TEST_FILE);
+
+  return _success();
+}
+
+
+int test_vx_io_lazy()
+{
+  char currentdir[1000];
+  int dims[3] = { 10, 10, 10 };
+  int i, j, k;
+  float val;
+  vx_lazy_t *lv;
+  vx_lazy_stats_t stats;
+
+  printf("Test: vx_io lazy brick paging\n");
+
+  getcwd(currentdir, 1000);
+  if (write_test_volume(VX_IO_TEST_FILE, VX_IO_TEST_CELLS) != 0) {
+    return _failure("write test volume failed");
+  }
+
+  /* 4^3 bricks with room for only two of them */
+  lv = vx_lazy_open(currentdir, VX_IO_TEST_FILE, 4, dims, 4, 2);
+  if (lv == NULL) {
+    return _failure("vx_lazy_open failure");
+  }
+  for (k = 0; k < dims[2]; k++) {
+    for (j = 0; j < dims[1]; j++) {
+      for (i = 0; i < dims[0]; i++) {
+	if ((vx_lazy_get(lv, i, j, k, &val) != 0) ||
+	    (test_assert_float(val, 1000.0 + 
+			       ((k * dims[1] + j) * dims[0] + i) * 0.5) != 0)) {
+	  vx_lazy_close(lv);
+	  return _failure("lazy values differ");
+	}
+      }
+    }
+  }
+  if (test_assert_int(vx_lazy_get(lv, 10, 0, 0, &val), 1) != 0) {
+    vx_lazy_close(lv);
+    return _failure("cell outside volume returned");
+  }
+
+  vx_lazy_stats(lv, &stats);
+  vx_lazy_close(lv);
+  if ((test_assert_int(stats.hits + stats.misses, VX_IO_TEST_CELLS) != 0) ||
+      (test_assert_int(stats.resident, 2) != 0) ||
+      (stats.misses < 27) || (stats.evictions != stats.misses - 2)) {
+    return _failure("lazy counters");
+  }
+
+  unlink(VX_IO_TEST_FILE);
+
+  return _success();
+}
+
+
+int test_vx_io_relayout()
+{
+  int dims[3] = { 10, 9, 5 };
+  int i, j, k;
+  float *lin, *brk;
+  vx_brick_layout_t bl;
+
+  printf("Test: vx_io brick relayout\n");
+
+  if (vx_brick_setup(&bl, dims, 4) != 0) {
+    return _failure("vx_brick_setup failure");
+  }
+  if (test_assert_int(bl.nb[0] * bl.nb[1] * bl.nb[2], 18) != 0) {
+    return _failure("brick count");
+  }
+  lin = malloc(dims[0] * dims[1] * dims[2] * sizeof(float));
+  for (i = 0; i < dims[0] * dims[1] * dims[2]; i++) {
+    lin[i] = 1000.0 + i * 0.5;
+  }
+  brk = (float *)vx_brick_relayout((char *)lin, sizeof(float), &bl);
+  if (brk == NULL) {
+    free(lin);
+    return _failure("vx_brick_relayout failure");
+  }
+  for (k = 0; k < dims[2]; k++) {
+    for (j = 0; j < dims[1]; j++) {
+      for (i = 0; i < dims[0]; i++) {
+	if (test_assert_float(brk[vx_brick_index(&bl, i, j, k)],
+			      lin[(k * dims[1] + j) * dims[0] + i]) != 0) {
+	  free(lin);
+	  free(brk);
+	  return _failure("bricked values differ");
+	}
+      }
+    }
+  }
+  free(lin);
+  free(brk);
+
+  return _success();
+}
+
+
+int suite_vx_io_exec(const char *xmldir)
+{
+  suite_t suite;
+  char logfile[1280];
+  FILE *lf = NULL;
+
+  /* Setup test suite */
+  strcpy(suite.suite_name, "suite_vx_io_exec");
+
+  suite.num_tests = VX_IO_TESTS;
+  suite.tests = malloc(suite.num_tests * sizeof(test_t));
+  if (suite.tests == NULL) {
+    fprintf(stderr, "ERROR: Failed to alloc test structure\n");
+    return(1);
+  }
+  test_get_time(&suite.exec_time);
+
+  /* Setup test cases */
+  strcpy(suite.tests[0].test_name, "test_vx_io_load_map");
+  suite.tests[0].test_func = &test_vx_io_load_map;
+  suite.tests[0].elapsed_time = 0.0;
+
+  strcpy(suite.tests[1].test_name, "test_vx_io_native");
+  suite.tests[1].test_func = &test_vx_io_native;
+  suite.tests[1].elapsed_time = 0.0;
+
+  strcpy(suite.tests[2].test_name, "test_vx_io_swap");
+  suite.tests[2].test_func = &test_vx_io_swap;
+  suite.tests[2].elapsed_time = 0.0;
+
+  strcpy(suite.tests[3].test_name, "test_vx_io_header");
+  suite.tests[3].test_func = &test_vx_io_header;
+  suite.tests[3].elapsed_time = 0.0;
+
+  strcpy(suite.tests[4].test_name, "test_vx_io_open");
+  suite.tests[4].test_func = &test_vx_io_open;
+  suite.tests[4].elapsed_time = 0.0;
+
+  strcpy(suite.tests[5].test_name, "test_vx_io_loadvolumes");
+  suite.tests[5].test_func = &test_vx_io_loadvolumes;
+  suite.tests[5].elapsed_time = 0.0;
+
+  strcpy(suite.tests[6].test_name, "test_vx_io_lazy");
+  suite.tests[6].test_func = &test_vx_io_lazy;
+  suite.tests[6].elapsed_time = 0.0;
+
+  strcpy(suite.tests[7].test_name, "test_vx_io_relayout");
+  suite.tests[7].test_func = &test_vx_io_relayout;
+  suite.tests[7].elapsed_time = 0.0;
+
+  if (test_run_suite(&suite) != 0) {
+    fprintf(stderr, "ERROR: Failed to execute tests\n");
+    return(1);
+  }
+
+  if (xmldir != NULL) {
+    sprintf(logfile, "%s/%s.xml", xmldir, suite.suite_name);
+    lf = init_log(logfile);
+    if (lf == NULL) {
+      fprintf(stderr, "ERROR: Failed to initialize logfile\n");
+      return(1);
+    }
+    
+    if (write_log(lf, &suite) != 0) {
+      fprintf(stderr, "ERROR: Failed to write test log\n");
+      return(1);
+    }
+    
+    close_log(lf);
+  }
+
+  free(suite.tests);
+
+  return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef TEST_VX_IO_EXEC_H
+#define TEST_VX_IO_EXEC_H
+
+int suite_vx_io_exec(const char *xmldir);
+
+#endif
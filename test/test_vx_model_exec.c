@@ -0,0 +1,1141 @@
+/**  
+   test_vx_model_exec.c
+
+   exercises model context handles on synthetic voxets,
+     vx_model_open, vx_model_query from several threads,
+       vx_model_profile, vx_model_query_cached, vx_model_setlookup,
+       vx_model_setutmmode, vx_model_surface_cached,
+       vx_model_setcover, vx_model_query with NULL outputs,
+       vx_model_query_sorted, vx_model_writeq16, vx_model_quantize,
+       vx_model_setbricks, vx_model_openlazy, vx_model_setzmode,
+       vx_model_init, vx_model_default,
+       vx_model_finalize
+**/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "params.h"
+#include "vx_query.h"
+#include "vx_utm.h"
+#include "vx_surf.h"
+#include "vx_model.h"
+#include "unittest_defs.h"
+#include "test_vx_model_exec.h"
+
+int VX_MODEL_TESTS=12;
+
+/* Synthetic basin voxet near -118.1 34.1, inside a coarse one */
+#define VX_MODEL_TEST_BASIN "test-vx-model-basin.vo"
+#define VX_MODEL_TEST_CM "test-vx-model-cm.vo"
+#define VX_MODEL_TEST_NX 30
+#define VX_MODEL_TEST_NY 30
+#define VX_MODEL_TEST_NZ 11
+#define VX_MODEL_TEST_POINTS 3000
+#define VX_MODEL_TEST_THREADS 4
+
+/* Synthetic interfaces voxet over the basin, nodes 500 m apart */
+#define VX_MODEL_TEST_SURF "test-vx-model-surf.vo"
+#define VX_MODEL_TEST_SURF_N 20
+
+/* Query points shared by the threads */
+typedef struct model_test_job_t {
+  const vx_model_t *model;
+  const double *lon, *lat, *z;
+  double vp[VX_MODEL_TEST_POINTS];
+  double vs[VX_MODEL_TEST_POINTS];
+  double rho[VX_MODEL_TEST_POINTS];
+  int src[VX_MODEL_TEST_POINTS];
+  int missing;
+} model_test_job_t;
+
+
+/* Big endian property file with cell values base + i, every
+   fifth cell nodata when it is not 0 */
+int write_model_volume(const char *filename, float base, int ncells,
+		       float nodata)
+{
+  FILE *fp;
+  int i, one = 1;
+  float val;
+  unsigned char *c, be[4];
+
+  fp = fopen(filename, "w");
+  if (fp == NULL) {
+    fprintf(stderr,"ERROR: cannot open %s\n", filename);
+    return(1);
+  }
+  for (i = 0; i < ncells; i++) {
+    val = ((nodata != 0.0) && (i % 5 == 0)) ? nodata : base + i;
+    c = (unsigned char *)&val;
+    if (*(char *)&one == 1) {
+      be[0] = c[3]; be[1] = c[2]; be[2] = c[1]; be[3] = c[0];
+    } else {
+      memcpy(be, c, 4);
+    }
+    if (fwrite(be, 4, 1, fp) != 1) {
+      fclose(fp);
+      return(1);
+    }
+  }
+  fclose(fp);
+  return(0);
+}
+
+
+int write_model_voxet(const char *vo, const char *prefix, double ox,
+		      double oy, double oz, double step, int vs)
+{
+  FILE *fp;
+  char fn[CMLEN];
+  int ncells = VX_MODEL_TEST_NX * VX_MODEL_TEST_NY * VX_MODEL_TEST_NZ;
+
+  fp = fopen(vo, "w");
+  if (fp == NULL) {
+    fprintf(stderr,"ERROR: cannot open %s\n", vo);
+    return(1);
+  }
+  fprintf(fp, "GOCAD Voxet 1\n");
+  fprintf(fp, "AXIS_O %lf %lf %lf\n", ox, oy, oz);
+  fprintf(fp, "AXIS_U %lf 0 0\n", step * (VX_MODEL_TEST_NX - 1));
+  fprintf(fp, "AXIS_V 0 %lf 0\n", step * (VX_MODEL_TEST_NY - 1));
+  fprintf(fp, "AXIS_W 0 0 %lf\n", step * (VX_MODEL_TEST_NZ - 1));
+  fprintf(fp, "AXIS_N %d %d %d\n", VX_MODEL_TEST_NX, VX_MODEL_TEST_NY,
+	  VX_MODEL_TEST_NZ);
+  fprintf(fp, "PROPERTY 1 vp\n");
+  fprintf(fp, "PROP_ESIZE 1 4\n");
+  fprintf(fp, "PROP_NO_DATA_VALUE 1 -99999\n");
+  fprintf(fp, "PROP_FILE 1 %s_vp@@\n", prefix);
+  if (vs) {
+    fprintf(fp, "PROPERTY 3 vs\n");
+    fprintf(fp, "PROP_ESIZE 3 4\n");
+    fprintf(fp, "PROP_NO_DATA_VALUE 3 -88888\n");
+    fprintf(fp, "PROP_FILE 3 %s_vs@@\n", prefix);
+  }
+  fclose(fp);
+
+  sprintf(fn, "%s_vp@@", prefix);
+  if (write_model_volume(fn, (vs) ? 2000.0 : 6000.0, ncells,
+			 (vs) ? -99999.0 : 0.0) != 0) {
+    return(1);
+  }
+  if (vs) {
+    sprintf(fn, "%s_vs@@", prefix);
+    if (write_model_volume(fn, 1000.0, ncells, -88888.0) != 0) {
+      return(1);
+    }
+  }
+  return(0);
+}
+
+
+/* Elevation of surface k of the synthetic interfaces at UTM x, y */
+double model_test_surface(int k, double x, double y)
+{
+  double topo = 300.0 + 0.01 * (x - 395000.0) - 0.02 * (y - 3770000.0);
+
+  return((k == 0) ? topo : topo - 50.0 * k);
+}
+
+
+/* Interfaces voxet with planar topo_dem, model_top, base and moho */
+int write_model_surfaces()
+{
+  const char *names[4] = { "topo_dem", "model_top", "base", "moho" };
+  float nodes[VX_MODEL_TEST_SURF_N * VX_MODEL_TEST_SURF_N];
+  unsigned char *c, be[4];
+  char fn[CMLEN];
+  FILE *fp;
+  int i, k, one = 1;
+
+  fp = fopen(VX_MODEL_TEST_SURF, "w");
+  if (fp == NULL) {
+    fprintf(stderr,"ERROR: cannot open %s\n", VX_MODEL_TEST_SURF);
+    return(1);
+  }
+  fprintf(fp, "GOCAD Voxet 1\n");
+  fprintf(fp, "AXIS_O 395000 3770000 0\n");
+  fprintf(fp, "AXIS_U %lf 0 0\n", 500.0 * (VX_MODEL_TEST_SURF_N - 1));
+  fprintf(fp, "AXIS_V 0 %lf 0\n", 500.0 * (VX_MODEL_TEST_SURF_N - 1));
+  fprintf(fp, "AXIS_W 0 0 1\n");
+  fprintf(fp, "AXIS_N %d %d 1\n", VX_MODEL_TEST_SURF_N, VX_MODEL_TEST_SURF_N);
+  for (k = 0; k < 4; k++) {
+    fprintf(fp, "PROPERTY %d %s\n", k + 1, names[k]);
+    fprintf(fp, "PROP_ESIZE %d 4\n", k + 1);
+    fprintf(fp, "PROP_NO_DATA_VALUE %d -99999\n", k + 1);
+    fprintf(fp, "PROP_FILE %d test-vx-model-surf_%s@@\n", k + 1, names[k]);
+  }
+  fclose(fp);
+
+  for (k = 0; k < 4; k++) {
+    for (i = 0; i < VX_MODEL_TEST_SURF_N * VX_MODEL_TEST_SURF_N; i++) {
+      nodes[i] = model_test_surface(k,
+				    395000.0 + 500.0 * (i % VX_MODEL_TEST_SURF_N),
+				    3770000.0 + 500.0 * (i / VX_MODEL_TEST_SURF_N));
+    }
+    sprintf(fn, "test-vx-model-surf_%s@@", names[k]);
+    fp = fopen(fn, "w");
+    if (fp == NULL) {
+      fprintf(stderr,"ERROR: cannot open %s\n", fn);
+      return(1);
+    }
+    for (i = 0; i < VX_MODEL_TEST_SURF_N * VX_MODEL_TEST_SURF_N; i++) {
+      c = (unsigned char *)&nodes[i];
+      if (*(char *)&one == 1) {
+	be[0] = c[3]; be[1] = c[2]; be[2] = c[1]; be[3] = c[0];
+      } else {
+	memcpy(be, c, 4);
+      }
+      if (fwrite(be, 4, 1, fp) != 1) {
+	fclose(fp);
+	return(1);
+      }
+    }
+    fclose(fp);
+  }
+  return(0);
+}
+
+
+void remove_model_surfaces()
+{
+  unlink(VX_MODEL_TEST_SURF);
+  unlink("test-vx-model-surf_topo_dem@@");
+  unlink("test-vx-model-surf_model_top@@");
+  unlink("test-vx-model-surf_base@@");
+  unlink("test-vx-model-surf_moho@@");
+}
+
+
+void remove_model_voxets()
+{
+  unlink(VX_MODEL_TEST_BASIN);
+  unlink(VX_MODEL_TEST_CM);
+  unlink("test-vx-model-basin_vp@@");
+  unlink("test-vx-model-basin_vs@@");
+  unlink("test-vx-model-cm_vp@@");
+  unlink("test-vx-model-basin_vp@@.q16");
+  unlink("test-vx-model-basin_vs@@.q16");
+  unlink("test-vx-model-cm_vp@@.q16");
+}
+
+
+/* Basin first, the coarse voxet fills the basin gaps */
+vx_model_t *open_model_voxets()
+{
+  char currentdir[1000];
+  const char *vo[2] = { VX_MODEL_TEST_BASIN, VX_MODEL_TEST_CM };
+
+  getcwd(currentdir, 1000);
+  if ((write_model_voxet(VX_MODEL_TEST_BASIN, "test-vx-model-basin",
+			 398000.0, 3773000.0, -1000.0, 100.0, 1) != 0) ||
+      (write_model_voxet(VX_MODEL_TEST_CM, "test-vx-model-cm",
+			 390000.0, 3765000.0, -10000.0, 1000.0, 0) != 0)) {
+    return(NULL);
+  }
+  return(vx_model_open(currentdir, vo, 2));
+}
+
+
+/* Points on and around the basin voxet */
+void make_model_points(double *lon, double *lat, double *z, int n)
+{
+  int p;
+
+  for (p = 0; p < n; p++) {
+    lon[p] = -118.1 + (p % 37) * 0.001;
+    lat[p] = 34.1 + (p % 41) * 0.001;
+    z[p] = -1200.0 + (p % 13) * 100.0;
+  }
+}
+
+
+/* Nearest cell of a synthetic voxet, -1 outside */
+int model_test_cell(double x, double y, double z, double ox, double oy,
+		    double oz, double step)
+{
+  int i, j, k;
+
+  i = (int)floor((x - ox) / step + 0.5);
+  j = (int)floor((y - oy) / step + 0.5);
+  k = (int)floor((z - oz) / step + 0.5);
+  if ((i < 0) || (j < 0) || (k < 0) || (i >= VX_MODEL_TEST_NX) ||
+      (j >= VX_MODEL_TEST_NY) || (k >= VX_MODEL_TEST_NZ)) {
+    return(-1);
+  }
+  return((k * VX_MODEL_TEST_NY + j) * VX_MODEL_TEST_NX + i);
+}
+
+
+void *model_test_worker(void *arg)
+{
+  model_test_job_t *job = (model_test_job_t *)arg;
+
+  job->missing = vx_model_query(job->model, job->lon, job->lat, job->z,
+				job->vp, job->vs, job->rho, job->src,
+				VX_MODEL_TEST_POINTS);
+  return(NULL);
+}
+
+
+int test_vx_model_query()
+{
+  vx_model_t *m;
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS];
+  double x, y;
+  model_test_job_t *job;
+  int p, idx, basin = 0, cm = 0;
+
+  printf("Test: vx_model query of a two voxet model\n");
+
+  m = open_model_voxets();
+  if (m == NULL) {
+    remove_model_voxets();
+    return _failure("vx_model_open failure");
+  }
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  job = calloc(1, sizeof(model_test_job_t));
+  job->model = m;
+  job->lon = lon;
+  job->lat = lat;
+  job->z = z;
+  model_test_worker(job);
+
+  for (p = 0; p < VX_MODEL_TEST_POINTS; p++) {
+    vx_query_geo2utm(VX_UTM_MODE_EXACT, &lon[p], &lat[p], &x, &y, 1);
+    idx = model_test_cell(x, y, z[p], 398000.0, 3773000.0, -1000.0, 100.0);
+    if ((idx >= 0) && (idx % 5 != 0)) {
+      basin++;
+      if ((test_assert_int(job->src[p], 0) != 0) ||
+	  (test_assert_double(job->vp[p], 2000.0 + idx) != 0) ||
+	  (test_assert_double(job->vs[p], 1000.0 + idx) != 0)) {
+	break;
+      }
+    } else {
+      cm++;
+      idx = model_test_cell(x, y, z[p], 390000.0, 3765000.0, -10000.0,
+			    1000.0);
+      if ((test_assert_int(job->src[p], 1) != 0) ||
+	  (test_assert_double(job->vp[p], 6000.0 + idx) != 0) ||
+	  (test_assert_double(job->vs[p], NIL) != 0)) {
+	break;
+      }
+    }
+  }
+  vx_model_close(m);
+  remove_model_voxets();
+  if (p < VX_MODEL_TEST_POINTS) {
+    free(job);
+    return _failure("queried values differ");
+  }
+  if ((basin == 0) || (cm == 0) || (test_assert_int(job->missing, 0) != 0)) {
+    free(job);
+    return _failure("points not split between voxets");
+  }
+  free(job);
+
+  return _success();
+}
+
+
+int test_vx_model_threads()
+{
+  vx_model_t *m;
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS];
+  model_test_job_t *jobs;
+  pthread_t threads[VX_MODEL_TEST_THREADS];
+  int t;
+
+  printf("Test: vx_model concurrent queries\n");
+
+  m = open_model_voxets();
+  if (m == NULL) {
+    remove_model_voxets();
+    return _failure("vx_model_open failure");
+  }
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  jobs = calloc(VX_MODEL_TEST_THREADS + 1, sizeof(model_test_job_t));
+  for (t = 0; t <= VX_MODEL_TEST_THREADS; t++) {
+    jobs[t].model = m;
+    jobs[t].lon = lon;
+    jobs[t].lat = lat;
+    jobs[t].z = z;
+  }
+
+  /* Last job is the single threaded reference */
+  model_test_worker(&jobs[VX_MODEL_TEST_THREADS]);
+  for (t = 0; t < VX_MODEL_TEST_THREADS; t++) {
+    pthread_create(&threads[t], NULL, model_test_worker, &jobs[t]);
+  }
+  for (t = 0; t < VX_MODEL_TEST_THREADS; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  vx_model_close(m);
+  remove_model_voxets();
+
+  for (t = 0; t < VX_MODEL_TEST_THREADS; t++) {
+    if ((memcmp(jobs[t].vp, jobs[VX_MODEL_TEST_THREADS].vp,
+		sizeof(jobs[t].vp)) != 0) ||
+	(memcmp(jobs[t].vs, jobs[VX_MODEL_TEST_THREADS].vs,
+		sizeof(jobs[t].vs)) != 0) ||
+	(memcmp(jobs[t].src, jobs[VX_MODEL_TEST_THREADS].src,
+		sizeof(jobs[t].src)) != 0)) {
+      free(jobs);
+      return _failure("threaded results differ");
+    }
+  }
+  free(jobs);
+
+  return _success();
+}
+
+
+int test_vx_model_profile()
+{
+  vx_model_t *m;
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS];
+  model_test_job_t *jobs;
+  int c, p, missing;
+
+  printf("Test: vx_model profile against query\n");
+
+  m = open_model_voxets();
+  if (m == NULL) {
+    remove_model_voxets();
+    return _failure("vx_model_open failure");
+  }
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  jobs = calloc(2, sizeof(model_test_job_t));
+
+  /* Profiles at a few of the test locations */
+  for (c = 0; c < 5; c++) {
+    for (p = 0; p < VX_MODEL_TEST_POINTS; p++) {
+      lon[p] = lon[c * 7];
+      lat[p] = lat[c * 7];
+      z[p] = 500.0 - 3.0 * p;
+    }
+    jobs[0].model = m;
+    jobs[0].lon = lon;
+    jobs[0].lat = lat;
+    jobs[0].z = z;
+    model_test_worker(&jobs[0]);
+    missing = vx_model_profile(m, lon[0], lat[0], z, jobs[1].vp, jobs[1].vs,
+			       jobs[1].rho, jobs[1].src, VX_MODEL_TEST_POINTS);
+    if ((test_assert_int(missing, jobs[0].missing) != 0) ||
+	(memcmp(jobs[0].vp, jobs[1].vp, sizeof(jobs[0].vp)) != 0) ||
+	(memcmp(jobs[0].vs, jobs[1].vs, sizeof(jobs[0].vs)) != 0) ||
+	(memcmp(jobs[0].src, jobs[1].src, sizeof(jobs[0].src)) != 0)) {
+      break;
+    }
+
+    /* vs alone, without vp or src */
+    memset(jobs[1].vs, 0, sizeof(jobs[1].vs));
+    missing = vx_model_profile(m, lon[0], lat[0], z, NULL, jobs[1].vs, NULL,
+			       NULL, VX_MODEL_TEST_POINTS);
+    if ((test_assert_int(missing, jobs[0].missing) != 0) ||
+	(memcmp(jobs[0].vs, jobs[1].vs, sizeof(jobs[0].vs)) != 0)) {
+      break;
+    }
+  }
+  vx_model_close(m);
+  remove_model_voxets();
+  free(jobs);
+  if (c < 5) {
+    return _failure("profile differs from query");
+  }
+
+  return _success();
+}
+
+
+int test_vx_model_cache()
+{
+  vx_model_t *m;
+  vx_model_cache_t *c;
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS];
+  model_test_job_t *jobs;
+  char currentdir[1000];
+  double *surf[2];
+  long hits, misses;
+  int p, missing, r;
+
+  printf("Test: vx_model query through the horizontal cache\n");
+
+  m = open_model_voxets();
+  c = vx_model_cache_new(0);
+  if ((m == NULL) || (c == NULL)) {
+    vx_model_close(m);
+    vx_model_cache_free(c);
+    remove_model_voxets();
+    return _failure("open failure");
+  }
+  jobs = calloc(2, sizeof(model_test_job_t));
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  jobs[0].model = m;
+  jobs[0].lon = lon;
+  jobs[0].lat = lat;
+  jobs[0].z = z;
+  model_test_worker(&jobs[0]);
+  missing = vx_model_query_cached(m, c, lon, lat, z, jobs[1].vp, jobs[1].vs,
+				  jobs[1].rho, jobs[1].src,
+				  VX_MODEL_TEST_POINTS);
+  r = ((missing == jobs[0].missing) &&
+       (memcmp(jobs[0].vp, jobs[1].vp, sizeof(jobs[0].vp)) == 0) &&
+       (memcmp(jobs[0].vs, jobs[1].vs, sizeof(jobs[0].vs)) == 0) &&
+       (memcmp(jobs[0].src, jobs[1].src, sizeof(jobs[0].src)) == 0));
+  vx_model_cache_free(c);
+
+  /* Five locations of 600 depths each, one miss per location */
+  c = vx_model_cache_new(0);
+  for (p = VX_MODEL_TEST_POINTS - 1; p >= 0; p--) {
+    lon[p] = lon[(p / 600) * 7];
+    lat[p] = lat[(p / 600) * 7];
+  }
+  vx_model_query_cached(m, c, lon, lat, z, jobs[1].vp, jobs[1].vs,
+			jobs[1].rho, jobs[1].src, VX_MODEL_TEST_POINTS);
+  vx_model_cache_stats(c, &hits, &misses);
+
+  /* Entries of an earlier generation of the model are not reused,
+     brick order moves every column */
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  vx_model_query_cached(m, c, lon, lat, z, jobs[1].vp, jobs[1].vs,
+			jobs[1].rho, jobs[1].src, VX_MODEL_TEST_POINTS);
+  getcwd(currentdir, 1000);
+  if ((vx_model_setbricks(m, 4) != 0) ||
+      (write_model_surfaces() != 0) ||
+      (vx_model_setsurfaces(m, currentdir, VX_MODEL_TEST_SURF) != 0)) {
+    r = 0;
+  }
+  remove_model_surfaces();
+  memset(jobs[1].vs, 0, sizeof(jobs[1].vs));
+  if ((vx_model_query_cached(m, c, lon, lat, z, NULL, jobs[1].vs, NULL,
+			     NULL, VX_MODEL_TEST_POINTS) != jobs[0].missing) ||
+      (memcmp(jobs[0].vs, jobs[1].vs, sizeof(jobs[0].vs)) != 0)) {
+    r = 0;
+  }
+
+  /* Surfaces come back from the cache as computed */
+  surf[0] = malloc(2 * VX_SURF_NUM * VX_MODEL_TEST_POINTS * sizeof(double));
+  surf[1] = &surf[0][VX_SURF_NUM * VX_MODEL_TEST_POINTS];
+  if ((vx_model_surface(m, lon, lat, surf[0], VX_MODEL_TEST_POINTS) != 0) ||
+      (vx_model_surface_cached(m, c, lon, lat, surf[1],
+			       VX_MODEL_TEST_POINTS) != 0) ||
+      (memcmp(surf[0], surf[1], VX_SURF_NUM * VX_MODEL_TEST_POINTS *
+	      sizeof(double)) != 0)) {
+    r = 0;
+  }
+  free(surf[0]);
+  vx_model_cache_free(c);
+  vx_model_close(m);
+  remove_model_voxets();
+  free(jobs);
+  if (!r) {
+    return _failure("cached results differ");
+  }
+  if ((test_assert_int((int)misses, 5) != 0) ||
+      (test_assert_int((int)hits, VX_MODEL_TEST_POINTS - 5) != 0)) {
+    return _failure("cache statistics");
+  }
+
+  return _success();
+}
+
+
+int test_vx_model_lookup()
+{
+  vx_model_t *m;
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS];
+  double maxerr = -1.0;
+  model_test_job_t *jobs;
+
+  printf("Test: vx_model query on the vector UTM path and the lookup grid\n");
+
+  m = open_model_voxets();
+  if (m == NULL) {
+    remove_model_voxets();
+    return _failure("vx_model_open failure");
+  }
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  jobs = calloc(3, sizeof(model_test_job_t));
+  jobs[0].model = m;
+  jobs[0].lon = lon;
+  jobs[0].lat = lat;
+  jobs[0].z = z;
+  jobs[1] = jobs[0];
+  jobs[2] = jobs[0];
+
+  /* Exact transform first, then the vector path and the lookup grid */
+  model_test_worker(&jobs[0]);
+  if ((vx_model_setutmmode(m, 2) == 0) ||
+      (vx_model_setutmmode(m, VX_UTM_MODE_VECTOR) != 0)) {
+    vx_model_close(m);
+    remove_model_voxets();
+    free(jobs);
+    return _failure("vx_model_setutmmode failure");
+  }
+  model_test_worker(&jobs[2]);
+  if (vx_model_setlookup(m, 0.0, &maxerr) != 0) {
+    vx_model_close(m);
+    remove_model_voxets();
+    free(jobs);
+    return _failure("vx_model_setlookup failure");
+  }
+  model_test_worker(&jobs[1]);
+  vx_model_close(m);
+  remove_model_voxets();
+
+  if ((maxerr <= 0.0) || (maxerr > 0.01)) {
+    fprintf(stderr, "lookup error bound %g m\n", maxerr);
+    free(jobs);
+    return _failure("unexpected error bound");
+  }
+  /* Millimeter errors do not move points to other cells here */
+  if ((memcmp(jobs[0].vp, jobs[1].vp, sizeof(jobs[0].vp)) != 0) ||
+      (memcmp(jobs[0].src, jobs[1].src, sizeof(jobs[0].src)) != 0)) {
+    free(jobs);
+    return _failure("lookup results differ");
+  }
+  if ((memcmp(jobs[0].vp, jobs[2].vp, sizeof(jobs[0].vp)) != 0) ||
+      (memcmp(jobs[0].src, jobs[2].src, sizeof(jobs[0].src)) != 0)) {
+    free(jobs);
+    return _failure("vector path results differ");
+  }
+  free(jobs);
+
+  return _success();
+}
+
+
+int test_vx_model_default()
+{
+  char currentdir[1000];
+
+  printf("Test: vx_model default context\n");
+
+  getcwd(currentdir, 1000);
+  if (vx_model_default() != NULL) {
+    return _failure("default model before init");
+  }
+  /* Default voxets are not in the test directory */
+  if ((test_assert_int(vx_model_init(currentdir), 1) != 0) ||
+      (vx_model_default() != NULL)) {
+    return _failure("vx_model_init without model files");
+  }
+  vx_model_finalize();
+
+  return _success();
+}
+
+
+int test_vx_model_coverage()
+{
+  vx_model_t *m;
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS];
+  model_test_job_t *jobs;
+  int p, outside = 0;
+
+  printf("Test: vx_model early out of points outside the voxets\n");
+
+  m = open_model_voxets();
+  if (m == NULL) {
+    remove_model_voxets();
+    return _failure("vx_model_open failure");
+  }
+  jobs = calloc(3, sizeof(model_test_job_t));
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  for (p = 0; p < 3; p++) {
+    jobs[p].model = m;
+    jobs[p].lon = lon;
+    jobs[p].lat = lat;
+    jobs[p].z = z;
+  }
+  model_test_worker(&jobs[0]);
+
+  /* Every third point and the whole last block far outside */
+  for (p = 0; p < VX_MODEL_TEST_POINTS; p++) {
+    if ((p % 3 == 0) || (p >= 2 * VX_QUERY_BLOCK)) {
+      lon[p] = -100.0 - p * 0.001;
+      outside++;
+    }
+  }
+  model_test_worker(&jobs[1]);
+  if (vx_model_setcover(m, 2) != 0) {
+    vx_model_close(m);
+    remove_model_voxets();
+    free(jobs);
+    return _failure("vx_model_setcover failure");
+  }
+  model_test_worker(&jobs[2]);
+  vx_model_close(m);
+  remove_model_voxets();
+
+  for (p = 0; p < VX_MODEL_TEST_POINTS; p++) {
+    if ((p % 3 == 0) || (p >= 2 * VX_QUERY_BLOCK)) {
+      if ((test_assert_int(jobs[1].src[p], -1) != 0) ||
+	  (test_assert_double(jobs[1].vp[p], NIL) != 0) ||
+	  (test_assert_double(jobs[1].rho[p], NIL) != 0)) {
+	break;
+      }
+    } else if ((test_assert_int(jobs[1].src[p], jobs[0].src[p]) != 0) ||
+	       (test_assert_double(jobs[1].vp[p], jobs[0].vp[p]) != 0) ||
+	       (test_assert_double(jobs[1].vs[p], jobs[0].vs[p]) != 0)) {
+      break;
+    }
+  }
+  if ((p < VX_MODEL_TEST_POINTS) ||
+      (test_assert_int(jobs[1].missing, outside) != 0) ||
+      (memcmp(jobs[1].vp, jobs[2].vp, sizeof(jobs[1].vp)) != 0) ||
+      (memcmp(jobs[1].src, jobs[2].src, sizeof(jobs[1].src)) != 0)) {
+    free(jobs);
+    return _failure("early out results differ");
+  }
+  free(jobs);
+
+  return _success();
+}
+
+
+int test_vx_model_outputs()
+{
+  vx_model_t *m;
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS];
+  model_test_job_t *jobs;
+  int p, missing[3];
+
+  printf("Test: vx_model query with skipped outputs\n");
+
+  m = open_model_voxets();
+  if (m == NULL) {
+    remove_model_voxets();
+    return _failure("vx_model_open failure");
+  }
+  jobs = calloc(2, sizeof(model_test_job_t));
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  /* Some blocks also take the packed path */
+  for (p = VX_QUERY_BLOCK; p < VX_MODEL_TEST_POINTS; p += 3) {
+    lon[p] = -100.0;
+  }
+  for (p = 0; p < VX_MODEL_TEST_POINTS; p++) {
+    jobs[1].vp[p] = jobs[1].rho[p] = 1.0;
+    jobs[1].src[p] = 7;
+  }
+  missing[0] = vx_model_query(m, lon, lat, z, jobs[0].vp, jobs[0].vs,
+			      jobs[0].rho, jobs[0].src, VX_MODEL_TEST_POINTS);
+  missing[1] = vx_model_query(m, lon, lat, z, NULL, jobs[1].vs, NULL, NULL,
+			      VX_MODEL_TEST_POINTS);
+  missing[2] = vx_model_query(m, lon, lat, z, NULL, NULL, NULL, jobs[1].src,
+			      VX_MODEL_TEST_POINTS);
+  vx_model_close(m);
+  remove_model_voxets();
+
+  if ((test_assert_int(missing[1], missing[0]) != 0) ||
+      (test_assert_int(missing[2], missing[0]) != 0) ||
+      (missing[0] == 0) ||
+      (memcmp(jobs[0].vs, jobs[1].vs, sizeof(jobs[0].vs)) != 0) ||
+      (memcmp(jobs[0].src, jobs[1].src, sizeof(jobs[0].src)) != 0)) {
+    free(jobs);
+    return _failure("selected outputs differ");
+  }
+  for (p = 0; p < VX_MODEL_TEST_POINTS; p++) {
+    if ((jobs[1].vp[p] != 1.0) || (jobs[1].rho[p] != 1.0)) {
+      free(jobs);
+      return _failure("skipped output written");
+    }
+  }
+  free(jobs);
+
+  return _success();
+}
+
+
+int test_vx_model_sorted()
+{
+  vx_model_t *m;
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS];
+  model_test_job_t *jobs;
+  int p, missing[3];
+
+  printf("Test: vx_model query in Morton order\n");
+
+  m = open_model_voxets();
+  if (m == NULL) {
+    remove_model_voxets();
+    return _failure("vx_model_open failure");
+  }
+  jobs = calloc(3, sizeof(model_test_job_t));
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  for (p = 0; p < VX_MODEL_TEST_POINTS; p += 11) {
+    lat[p] = 40.0;
+  }
+  missing[0] = vx_model_query(m, lon, lat, z, jobs[0].vp, jobs[0].vs,
+			      jobs[0].rho, jobs[0].src, VX_MODEL_TEST_POINTS);
+  missing[1] = vx_model_query_sorted(m, lon, lat, z, jobs[1].vp, jobs[1].vs,
+				     jobs[1].rho, jobs[1].src,
+				     VX_MODEL_TEST_POINTS);
+  missing[2] = vx_model_query_sorted(m, lon, lat, z, NULL, jobs[2].vs, NULL,
+				     NULL, VX_MODEL_TEST_POINTS);
+  vx_model_close(m);
+  remove_model_voxets();
+
+  if ((test_assert_int(missing[1], missing[0]) != 0) ||
+      (test_assert_int(missing[2], missing[0]) != 0) ||
+      (memcmp(jobs[0].vp, jobs[1].vp, sizeof(jobs[0].vp)) != 0) ||
+      (memcmp(jobs[0].vs, jobs[1].vs, sizeof(jobs[0].vs)) != 0) ||
+      (memcmp(jobs[0].rho, jobs[1].rho, sizeof(jobs[0].rho)) != 0) ||
+      (memcmp(jobs[0].src, jobs[1].src, sizeof(jobs[0].src)) != 0) ||
+      (memcmp(jobs[0].vs, jobs[2].vs, sizeof(jobs[0].vs)) != 0)) {
+    free(jobs);
+    return _failure("sorted results differ");
+  }
+  free(jobs);
+
+  return _success();
+}
+
+
+int test_vx_model_quantize()
+{
+  vx_model_t *m;
+  char currentdir[1000];
+  const char *vo[2] = { VX_MODEL_TEST_BASIN, VX_MODEL_TEST_CM };
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS];
+  double maxerr[2] = { -1.0, -1.0 };
+  struct stat st[2];
+  model_test_job_t *jobs;
+  int p, rc, missing[3];
+
+  printf("Test: vx_model 16-bit volumes\n");
+
+  getcwd(currentdir, 1000);
+  m = open_model_voxets();
+  if (m == NULL) {
+    remove_model_voxets();
+    return _failure("vx_model_open failure");
+  }
+  jobs = calloc(3, sizeof(model_test_job_t));
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  missing[0] = vx_model_query(m, lon, lat, z, jobs[0].vp, jobs[0].vs,
+			      jobs[0].rho, jobs[0].src, VX_MODEL_TEST_POINTS);
+  /* Without caches the model reports it and keeps full precision */
+  rc = (vx_model_quantize(m, &maxerr[0]) == 2) ? 0 : 1;
+  if (rc == 0) {
+    rc = vx_model_writeq16(m);
+  }
+  if (rc == 0) {
+    rc = vx_model_quantize(m, &maxerr[0]);
+  }
+  if (rc == 0) {
+    /* Covers are built from the 16-bit volumes */
+    rc = vx_model_setcover(m, 2);
+  }
+  missing[1] = vx_model_query(m, lon, lat, z, jobs[1].vp, jobs[1].vs,
+			      jobs[1].rho, jobs[1].src, VX_MODEL_TEST_POINTS);
+  vx_model_close(m);
+
+  /* A second model maps the same caches */
+  if ((rc == 0) && (stat("test-vx-model-basin_vs@@.q16", &st[0]) != 0)) {
+    rc = 1;
+  }
+  m = vx_model_open(currentdir, vo, 2);
+  if ((m == NULL) || (vx_model_quantize(m, &maxerr[1]) != 0) ||
+      (stat("test-vx-model-basin_vs@@.q16", &st[1]) != 0) ||
+      (st[1].st_ino != st[0].st_ino) || (maxerr[1] != maxerr[0])) {
+    rc = 1;
+  } else {
+    missing[2] = vx_model_query(m, lon, lat, z, jobs[2].vp, jobs[2].vs,
+				jobs[2].rho, jobs[2].src,
+				VX_MODEL_TEST_POINTS);
+    if ((missing[2] != missing[1]) ||
+	(memcmp(jobs[1].vp, jobs[2].vp, sizeof(jobs[1].vp)) != 0) ||
+	(memcmp(jobs[1].vs, jobs[2].vs, sizeof(jobs[1].vs)) != 0)) {
+      rc = 1;
+    }
+  }
+  vx_model_close(m);
+  remove_model_voxets();
+
+  /* Values span 2000 to 12000 m/s, 0.1 m/s is well above the bound.
+     vs cells at its own no data value stay out of its range */
+  if ((rc != 0) || (maxerr[0] < 0.0) || (maxerr[0] > 0.1) ||
+      (test_assert_int(missing[1], missing[0]) != 0) ||
+      (memcmp(jobs[0].src, jobs[1].src, sizeof(jobs[0].src)) != 0)) {
+    free(jobs);
+    return _failure("quantized model");
+  }
+  for (p = 0; p < VX_MODEL_TEST_POINTS; p++) {
+    if ((fabs(jobs[1].vp[p] - jobs[0].vp[p]) > maxerr[0]) ||
+	(fabs(jobs[1].vs[p] - jobs[0].vs[p]) > maxerr[0])) {
+      free(jobs);
+      return _failure("quantized values outside the bound");
+    }
+  }
+  free(jobs);
+
+  return _success();
+}
+
+
+int test_vx_model_bricks()
+{
+  vx_model_t *m;
+  char currentdir[1000];
+  const char *vo[2] = { VX_MODEL_TEST_BASIN, VX_MODEL_TEST_CM };
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS];
+  model_test_job_t *jobs;
+  int c, rc, missing[3];
+
+  printf("Test: vx_model brick order and lazy volumes\n");
+
+  getcwd(currentdir, 1000);
+  m = open_model_voxets();
+  if (m == NULL) {
+    remove_model_voxets();
+    return _failure("vx_model_open failure");
+  }
+  jobs = calloc(3, sizeof(model_test_job_t));
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  missing[0] = vx_model_query(m, lon, lat, z, jobs[0].vp, jobs[0].vs,
+			      jobs[0].rho, jobs[0].src, VX_MODEL_TEST_POINTS);
+  rc = vx_model_setbricks(m, 4);
+  if (rc == 0) {
+    rc = vx_model_setcover(m, 2);
+  }
+  missing[1] = vx_model_query(m, lon, lat, z, jobs[1].vp, jobs[1].vs,
+			      jobs[1].rho, jobs[1].src, VX_MODEL_TEST_POINTS);
+  vx_model_close(m);
+
+  /* Few enough bricks that queries evict them */
+  m = vx_model_openlazy(currentdir, vo, 2, 4, 8);
+  if (m == NULL) {
+    rc = 1;
+  } else {
+    missing[2] = vx_model_query(m, lon, lat, z, jobs[2].vp, jobs[2].vs,
+				jobs[2].rho, jobs[2].src, VX_MODEL_TEST_POINTS);
+    if (vx_model_quantize(m, NULL) == 0) {
+      rc = 1;
+    }
+    vx_model_close(m);
+  }
+  remove_model_voxets();
+
+  for (c = 1; (c < 3) && (rc == 0); c++) {
+    if ((test_assert_int(missing[c], missing[0]) != 0) ||
+	(memcmp(jobs[0].vp, jobs[c].vp, sizeof(jobs[0].vp)) != 0) ||
+	(memcmp(jobs[0].vs, jobs[c].vs, sizeof(jobs[0].vs)) != 0) ||
+	(memcmp(jobs[0].rho, jobs[c].rho, sizeof(jobs[0].rho)) != 0) ||
+	(memcmp(jobs[0].src, jobs[c].src, sizeof(jobs[0].src)) != 0)) {
+      rc = 1;
+    }
+  }
+  free(jobs);
+  if (rc != 0) {
+    return _failure("brick order results differ");
+  }
+
+  return _success();
+}
+
+
+int test_vx_model_depth()
+{
+  vx_model_t *m;
+  vx_model_cache_t *c;
+  double lon[VX_MODEL_TEST_POINTS], lat[VX_MODEL_TEST_POINTS];
+  double z[VX_MODEL_TEST_POINTS], d[VX_MODEL_TEST_POINTS];
+  double *surf;
+  char currentdir[1000];
+  model_test_job_t *jobs;
+  int j, p, rc = 0, missing[4];
+
+  printf("Test: vx_model depth queries below topo_dem\n");
+
+  getcwd(currentdir, 1000);
+  m = open_model_voxets();
+  if (m == NULL) {
+    remove_model_voxets();
+    return _failure("vx_model_open failure");
+  }
+  /* Depths need surfaces */
+  if (vx_model_setzmode(m, VX_MODEL_ZMODE_DEPTH) == 0) {
+    rc = 1;
+  }
+  if ((write_model_surfaces() != 0) ||
+      (vx_model_setsurfaces(m, currentdir, VX_MODEL_TEST_SURF) != 0)) {
+    rc = 1;
+  }
+  remove_model_surfaces();
+  c = vx_model_cache_new(0);
+  jobs = calloc(4, sizeof(model_test_job_t));
+  surf = malloc(VX_SURF_NUM * VX_MODEL_TEST_POINTS * sizeof(double));
+  if ((rc != 0) || (c == NULL) || (jobs == NULL) || (surf == NULL)) {
+    vx_model_cache_free(c);
+    vx_model_close(m);
+    remove_model_voxets();
+    free(jobs);
+    free(surf);
+    return _failure("setup failure");
+  }
+
+  /* Depths of the test points against elevations below topo_dem */
+  make_model_points(lon, lat, z, VX_MODEL_TEST_POINTS);
+  vx_model_surface(m, lon, lat, surf, VX_MODEL_TEST_POINTS);
+  for (p = 0; p < VX_MODEL_TEST_POINTS; p++) {
+    d[p] = surf[p * VX_SURF_NUM + VX_SURF_TOPO] - z[p];
+    z[p] = surf[p * VX_SURF_NUM + VX_SURF_TOPO] - d[p];
+  }
+  missing[0] = vx_model_query(m, lon, lat, z, jobs[0].vp, jobs[0].vs,
+			      jobs[0].rho, jobs[0].src, VX_MODEL_TEST_POINTS);
+  if (vx_model_setzmode(m, VX_MODEL_ZMODE_DEPTH) != 0) {
+    rc = 1;
+  }
+  missing[1] = vx_model_query(m, lon, lat, d, jobs[1].vp, jobs[1].vs,
+			      jobs[1].rho, jobs[1].src, VX_MODEL_TEST_POINTS);
+  missing[2] = vx_model_query_sorted(m, lon, lat, d, jobs[2].vp, jobs[2].vs,
+				     jobs[2].rho, jobs[2].src,
+				     VX_MODEL_TEST_POINTS);
+  missing[3] = vx_model_query_cached(m, c, lon, lat, d, jobs[3].vp,
+				     jobs[3].vs, jobs[3].rho, jobs[3].src,
+				     VX_MODEL_TEST_POINTS);
+  for (j = 1; j < 4; j++) {
+    if ((test_assert_int(missing[j], missing[0]) != 0) ||
+	(memcmp(jobs[0].vp, jobs[j].vp, sizeof(jobs[0].vp)) != 0) ||
+	(memcmp(jobs[0].vs, jobs[j].vs, sizeof(jobs[0].vs)) != 0) ||
+	(memcmp(jobs[0].src, jobs[j].src, sizeof(jobs[0].src)) != 0)) {
+      rc = 1;
+    }
+  }
+
+  /* Profile of the same depths below the first point */
+  missing[1] = vx_model_profile(m, lon[0], lat[0], d, jobs[1].vp, jobs[1].vs,
+				jobs[1].rho, jobs[1].src, VX_MODEL_TEST_POINTS);
+  vx_model_setzmode(m, VX_MODEL_ZMODE_ELEV);
+  for (p = 0; p < VX_MODEL_TEST_POINTS; p++) {
+    lon[p] = lon[0];
+    lat[p] = lat[0];
+    z[p] = surf[VX_SURF_TOPO] - d[p];
+  }
+  missing[0] = vx_model_query(m, lon, lat, z, jobs[0].vp, jobs[0].vs,
+			      jobs[0].rho, jobs[0].src, VX_MODEL_TEST_POINTS);
+  if ((test_assert_int(missing[1], missing[0]) != 0) ||
+      (memcmp(jobs[0].vp, jobs[1].vp, sizeof(jobs[0].vp)) != 0) ||
+      (memcmp(jobs[0].src, jobs[1].src, sizeof(jobs[0].src)) != 0)) {
+    rc = 1;
+  }
+  vx_model_cache_free(c);
+  vx_model_close(m);
+  remove_model_voxets();
+  free(surf);
+  free(jobs);
+  if (rc != 0) {
+    return _failure("depth results differ");
+  }
+
+  return _success();
+}
+
+
+int suite_vx_model_exec(const char *xmldir)
+{
+  suite_t suite;
+  char logfile[1280];
+  FILE *lf = NULL;
+
+  /* Setup test suite */
+  strcpy(suite.suite_name, "suite_vx_model_exec");
+
+  suite.num_tests = VX_MODEL_TESTS;
+  suite.tests = malloc(suite.num_tests * sizeof(test_t));
+  if (suite.tests == NULL) {
+    fprintf(stderr, "ERROR: Failed to alloc test structure\n");
+    return(1);
+  }
+  test_get_time(&suite.exec_time);
+
+  /* Setup test cases */
+  strcpy(suite.tests[0].test_name, "test_vx_model_query");
+  suite.tests[0].test_func = &test_vx_model_query;
+  suite.tests[0].elapsed_time = 0.0;
+
+  strcpy(suite.tests[1].test_name, "test_vx_model_threads");
+  suite.tests[1].test_func = &test_vx_model_threads;
+  suite.tests[1].elapsed_time = 0.0;
+
+  strcpy(suite.tests[2].test_name, "test_vx_model_lookup");
+  suite.tests[2].test_func = &test_vx_model_lookup;
+  suite.tests[2].elapsed_time = 0.0;
+
+  strcpy(suite.tests[3].test_name, "test_vx_model_default");
+  suite.tests[3].test_func = &test_vx_model_default;
+  suite.tests[3].elapsed_time = 0.0;
+
+  strcpy(suite.tests[4].test_name, "test_vx_model_profile");
+  suite.tests[4].test_func = &test_vx_model_profile;
+  suite.tests[4].elapsed_time = 0.0;
+
+  strcpy(suite.tests[5].test_name, "test_vx_model_cache");
+  suite.tests[5].test_func = &test_vx_model_cache;
+  suite.tests[5].elapsed_time = 0.0;
+
+  strcpy(suite.tests[6].test_name, "test_vx_model_coverage");
+  suite.tests[6].test_func = &test_vx_model_coverage;
+  suite.tests[6].elapsed_time = 0.0;
+
+  strcpy(suite.tests[7].test_name, "test_vx_model_outputs");
+  suite.tests[7].test_func = &test_vx_model_outputs;
+  suite.tests[7].elapsed_time = 0.0;
+
+  strcpy(suite.tests[8].test_name, "test_vx_model_sorted");
+  suite.tests[8].test_func = &test_vx_model_sorted;
+  suite.tests[8].elapsed_time = 0.0;
+
+  strcpy(suite.tests[9].test_name, "test_vx_model_quantize");
+  suite.tests[9].test_func = &test_vx_model_quantize;
+  suite.tests[9].elapsed_time = 0.0;
+
+  strcpy(suite.tests[10].test_name, "test_vx_model_bricks");
+  suite.tests[10].test_func = &test_vx_model_bricks;
+  suite.tests[10].elapsed_time = 0.0;
+
+  strcpy(suite.tests[11].test_name, "test_vx_model_depth");
+  suite.tests[11].test_func = &test_vx_model_depth;
+  suite.tests[11].elapsed_time = 0.0;
+
+  if (test_run_suite(&suite) != 0) {
+    fprintf(stderr, "ERROR: Failed to execute tests\n");
+    return(1);
+  }
+
+  if (xmldir != NULL) {
+    sprintf(logfile, "%s/%s.xml", xmldir, suite.suite_name);
+    lf = init_log(logfile);
+    if (lf == NULL) {
+      fprintf(stderr, "ERROR: Failed to initialize logfile\n");
+      return(1);
+    }
+    
+    if (write_log(lf, &suite) != 0) {
+      fprintf(stderr, "ERROR: Failed to write test log\n");
+      return(1);
+    }
+    
+    close_log(lf);
+  }
+
+  free(suite.tests);
+
+  return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef TEST_VX_MODEL_EXEC_H
+#define TEST_VX_MODEL_EXEC_H
+
+int suite_vx_model_exec(const char *xmldir);
+
+#endif
@@ -0,0 +1,970 @@
+/**  
+   test_vx_query_exec.c
+
+   exercises the batched query path on small synthetic grids,
+     vx_query_setgrid, vx_query_index, vx_query_gather,
+       vx_query_rho, vx_query_batch, vx_query_profile,
+       vx_query_setcover, vx_query_morton, the index descriptor,
+       vx_query_quantize, vx_query_gather16, vx_query_setbricks,
+       vx_query_geo2utm, and the
+       zone 11 transforms of vx_utm.h against gctp, and the vector
+       zone 11 transforms and the lookup grid against the exact ones
+**/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include "params.h"
+#include "voxet.h"
+#include "vx_query.h"
+#include "vx_utm.h"
+#include "unittest_defs.h"
+#include "test_vx_query_exec.h"
+
+int VX_QUERY_TESTS=16;
+
+/* Coordinate transform, gctpc */
+void gctp();
+
+/* Model bounding box of the test grids, degrees */
+#define VX_QUERY_TEST_LON0 -120.5
+#define VX_QUERY_TEST_LON1 -113.5
+#define VX_QUERY_TEST_LAT0 31.0
+#define VX_QUERY_TEST_LAT1 36.5
+
+/* San Gabriel basin footprint, degrees */
+#define VX_QUERY_TEST_SGB_LON0 -118.6
+#define VX_QUERY_TEST_SGB_LON1 -117.5
+#define VX_QUERY_TEST_SGB_LAT0 33.8
+#define VX_QUERY_TEST_SGB_LAT1 34.3
+
+/* Meters per degree of latitude, to express lon/lat errors */
+#define VX_QUERY_TEST_DEG2M 111320.0
+
+/* Synthetic grid, 10 x 8 x 6 cells of 100 m from 1000,2000,-500 */
+#define VX_QUERY_TEST_NX 10
+#define VX_QUERY_TEST_NY 8
+#define VX_QUERY_TEST_NZ 6
+#define VX_QUERY_TEST_CELLS 480
+#define VX_QUERY_TEST_NODATA -99999.0
+
+
+void set_test_axis(struct axis *a, double ox, double oy, double oz,
+		   double step, int nx, int ny, int nz)
+{
+  memset(a, 0, sizeof(struct axis));
+  a->O[0] = ox;
+  a->O[1] = oy;
+  a->O[2] = oz;
+  a->U[0] = step * (nx - 1);
+  a->V[1] = step * (ny - 1);
+  a->W[2] = step * (nz - 1);
+  a->N[0] = nx;
+  a->N[1] = ny;
+  a->N[2] = nz;
+}
+
+
+int test_vx_query_index()
+{
+  struct axis a;
+  vx_query_grid_t g;
+  double x[5] = { 1000.0, 1949.0, 1040.0, 1000.0, 999.0 - 50.0 };
+  double y[5] = { 2000.0, 2700.0, 2160.0, 2000.0, 2000.0 };
+  double z[5] = { -500.0, 0.0, -380.0, 60.0, -500.0 };
+  int idx[5];
+
+  printf("Test: vx_query nearest cell index\n");
+
+  set_test_axis(&a, 1000.0, 2000.0, -500.0, 100.0, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  if (vx_query_setgrid(&g, &a, NULL, NULL, VX_QUERY_TEST_NODATA) != 0) {
+    return _failure("vx_query_setgrid failure");
+  }
+  vx_query_index(&g, x, y, z, idx, 5);
+  if ((test_assert_int(idx[0], 0) != 0) ||
+      (test_assert_int(idx[1], (5 * 8 + 7) * 10 + 9) != 0) ||
+      (test_assert_int(idx[2], (1 * 8 + 2) * 10 + 0) != 0) ||
+      (test_assert_int(idx[3], -1) != 0) ||
+      (test_assert_int(idx[4], -1) != 0)) {
+    return _failure("cell index");
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_descriptor()
+{
+  struct axis a;
+  vx_query_grid_t g;
+  double x[1000], y[1000], z[1000];
+  double gi, gj, gk;
+  int idx[1000];
+  int p, ref;
+
+  printf("Test: vx_query precomputed index descriptor\n");
+
+  set_test_axis(&a, 1000.0, 2000.0, -500.0, 37.5, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  vx_query_setgrid(&g, &a, NULL, NULL, VX_QUERY_TEST_NODATA);
+  if ((test_assert_double(g.rstep[0], 1.0 / 37.5) != 0) ||
+      (test_assert_double(g.lim[2], VX_QUERY_TEST_NZ) != 0) ||
+      (test_assert_int(g.stride[0], VX_QUERY_TEST_NX) != 0) ||
+      (test_assert_int(g.stride[1], VX_QUERY_TEST_NX * VX_QUERY_TEST_NY)
+       != 0)) {
+    return _failure("descriptor fields");
+  }
+
+  /* Same cells as dividing by the spacing, away from half cells */
+  for (p = 0; p < 1000; p++) {
+    x[p] = 1000.0 - 60.0 + (p * 7919 % 1000) * 0.45 + 0.01;
+    y[p] = 2000.0 - 60.0 + (p * 104729 % 1000) * 0.4 + 0.01;
+    z[p] = -500.0 - 60.0 + (p * 1299709 % 1000) * 0.35 + 0.01;
+  }
+  vx_query_index(&g, x, y, z, idx, 1000);
+  for (p = 0; p < 1000; p++) {
+    gi = round((x[p] - 1000.0) / 37.5);
+    gj = round((y[p] - 2000.0) / 37.5);
+    gk = round((z[p] + 500.0) / 37.5);
+    ref = ((gi >= 0.0) && (gi < VX_QUERY_TEST_NX) && (gj >= 0.0) &&
+	   (gj < VX_QUERY_TEST_NY) && (gk >= 0.0) && (gk < VX_QUERY_TEST_NZ)) ?
+      ((int)gk * VX_QUERY_TEST_NY + (int)gj) * VX_QUERY_TEST_NX + (int)gi : -1;
+    if (test_assert_int(idx[p], ref) != 0) {
+      return _failure("cell index");
+    }
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_gather()
+{
+  float vol[VX_QUERY_TEST_CELLS];
+  int idx[37];
+  double out[37];
+  int p;
+
+  printf("Test: vx_query gather\n");
+
+  for (p = 0; p < VX_QUERY_TEST_CELLS; p++) {
+    vol[p] = 1000.0 + p * 0.5;
+  }
+  for (p = 0; p < 37; p++) {
+    idx[p] = (p % 5 == 3) ? -1 : (p * 131) % VX_QUERY_TEST_CELLS;
+  }
+  vx_query_gather(vol, idx, out, 37, VX_QUERY_TEST_NODATA);
+  for (p = 0; p < 37; p++) {
+    if (test_assert_double(out[p], (idx[p] < 0) ? VX_QUERY_TEST_NODATA :
+			   1000.0 + idx[p] * 0.5) != 0) {
+      return _failure("gathered values differ");
+    }
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_quantize()
+{
+  float vol[VX_QUERY_TEST_CELLS];
+  vx_query_q16_t q;
+  double out[VX_QUERY_TEST_CELLS + 3];
+  int idx[VX_QUERY_TEST_CELLS + 3];
+  int p;
+
+  printf("Test: vx_query 16-bit volumes\n");
+
+  for (p = 0; p < VX_QUERY_TEST_CELLS; p++) {
+    vol[p] = (p % 9 == 4) ? VX_QUERY_TEST_NODATA : 300.0 + p * 17.731;
+  }
+  if (vx_query_quantize(vol, VX_QUERY_TEST_CELLS, VX_QUERY_TEST_NODATA,
+			&q) != 0) {
+    return _failure("vx_query_quantize failure");
+  }
+  /* Half a code step at most */
+  if ((q.maxerr <= 0.0) || (q.maxerr > 0.5 * q.scale * (1.0 + 1.0e-9))) {
+    vx_query_freeq16(&q);
+    return _failure("quantization error bound");
+  }
+
+  /* Every cell, the last one twice, and cells off the grid */
+  for (p = 0; p < VX_QUERY_TEST_CELLS; p++) {
+    idx[p] = VX_QUERY_TEST_CELLS - 1 - p;
+  }
+  idx[VX_QUERY_TEST_CELLS] = -1;
+  idx[VX_QUERY_TEST_CELLS + 1] = VX_QUERY_TEST_CELLS - 1;
+  idx[VX_QUERY_TEST_CELLS + 2] = -1;
+  vx_query_gather16(&q, idx, out, VX_QUERY_TEST_CELLS + 3, NIL);
+  vx_query_freeq16(&q);
+  for (p = 0; p < VX_QUERY_TEST_CELLS + 3; p++) {
+    if (idx[p] < 0) {
+      if (test_assert_double(out[p], NIL) != 0) {
+	return _failure("fill value");
+      }
+    } else if (vol[idx[p]] == VX_QUERY_TEST_NODATA) {
+      if (test_assert_double(out[p], VX_QUERY_TEST_NODATA) != 0) {
+	return _failure("no data code");
+      }
+    } else if (fabs(out[p] - vol[idx[p]]) > q.maxerr) {
+      return _failure("decoded value");
+    }
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_rho()
+{
+  double vp[3] = { 3966.294189, NIL, 3180.260498 };
+  double rho[3];
+
+  printf("Test: vx_query Nafe-Drake density\n");
+
+  vx_query_rho(vp, rho, 3, NIL);
+  if ((test_assert_double(rho[0], 2388.608443) != 0) ||
+      (test_assert_double(rho[1], NIL) != 0) ||
+      (test_assert_double(rho[2], 2261.115808) != 0)) {
+    return _failure("density values");
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_rho_vector()
+{
+  double vp[1003], rho[1003];
+  double v, ref;
+  int p;
+
+  printf("Test: vx_query density kernel against the power form\n");
+
+  /* 0 to 10 km/s with no data points in between, an odd count leaves
+     a remainder after the vector loop */
+  for (p = 0; p < 1003; p++) {
+    vp[p] = (p % 97 == 3) ? NIL : p * 9.97;
+  }
+  vx_query_rho(vp, rho, 1003, NIL);
+  for (p = 0; p < 1003; p++) {
+    if (vp[p] == NIL) {
+      if (test_assert_double(rho[p], NIL) != 0) {
+	return _failure("no data not passed through");
+      }
+      continue;
+    }
+    v = vp[p] / 1000.0;
+    ref = 1000.0 * (1.6612 * v - 0.4721 * pow(v, 2) + 0.0671 * pow(v, 3) -
+		    0.0043 * pow(v, 4) + 0.000106 * pow(v, 5));
+    if (fabs(rho[p] - ref) > VX_QUERY_RHO_MAXERR * fmax(fabs(ref), 1.0)) {
+      printf("vp %lf: %.15e vs %.15e\n", vp[p], rho[p], ref);
+      return _failure("density outside tolerance");
+    }
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_batch()
+{
+  struct axis a;
+  vx_query_grid_t g[2];
+  float basin_vp[VX_QUERY_TEST_CELLS], basin_vs[VX_QUERY_TEST_CELLS];
+  float cm_vp[VX_QUERY_TEST_CELLS];
+  double *x, *y, *z, *vp, *vs, *rho;
+  int *src;
+  int n = 1500;
+  int p, missing, expect_missing = 0;
+
+  printf("Test: vx_query batch over prioritized grids\n");
+
+  /* Basin grid with a no data hole, coarse grid underneath */
+  for (p = 0; p < VX_QUERY_TEST_CELLS; p++) {
+    basin_vp[p] = (p % 10 < 5) ? 2000.0 + p : VX_QUERY_TEST_NODATA;
+    basin_vs[p] = 1000.0 + p;
+    cm_vp[p] = 6000.0 + p;
+  }
+  set_test_axis(&a, 1000.0, 2000.0, -500.0, 100.0, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  vx_query_setgrid(&g[0], &a, basin_vp, basin_vs, VX_QUERY_TEST_NODATA);
+  set_test_axis(&a, 0.0, 0.0, -5000.0, 1000.0, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  vx_query_setgrid(&g[1], &a, cm_vp, NULL, VX_QUERY_TEST_NODATA);
+
+  x = malloc(n * sizeof(double));
+  y = malloc(n * sizeof(double));
+  z = malloc(n * sizeof(double));
+  vp = malloc(n * sizeof(double));
+  vs = malloc(n * sizeof(double));
+  rho = malloc(n * sizeof(double));
+  src = malloc(n * sizeof(int));
+  for (p = 0; p < n; p++) {
+    x[p] = 1000.0 + (p % 10) * 100.0;
+    y[p] = 2000.0 + ((p / 10) % 8) * 100.0;
+    z[p] = -500.0 + ((p / 80) % 6) * 100.0;
+    if (p % 7 == 0) {
+      /* Beyond both grids */
+      x[p] = 20000.0;
+      expect_missing++;
+    }
+  }
+
+  missing = vx_query_batch(g, 2, x, y, z, vp, vs, rho, src, n);
+  if (test_assert_int(missing, expect_missing) != 0) {
+    return _failure("missing point count");
+  }
+  for (p = 0; p < n; p++) {
+    if (p % 7 == 0) {
+      if ((test_assert_int(src[p], -1) != 0) ||
+	  (test_assert_double(vp[p], NIL) != 0) ||
+	  (test_assert_double(rho[p], NIL) != 0)) {
+	return _failure("point outside grids");
+      }
+    } else if (p % 10 < 5) {
+      if ((test_assert_int(src[p], 0) != 0) ||
+	  (test_assert_double(vp[p], 2000.0 + p % 480) != 0) ||
+	  (test_assert_double(vs[p], 1000.0 + p % 480) != 0)) {
+	return _failure("basin point");
+      }
+    } else {
+      if ((test_assert_int(src[p], 1) != 0) ||
+	  (test_assert_double(vs[p], NIL) != 0) ||
+	  (vp[p] < 6000.0)) {
+	return _failure("fallback point");
+      }
+    }
+  }
+
+  free(x);
+  free(y);
+  free(z);
+  free(vp);
+  free(vs);
+  free(rho);
+  free(src);
+
+  return _success();
+}
+
+
+int test_vx_query_profile()
+{
+  struct axis a;
+  vx_query_grid_t g[2];
+  float basin_vp[VX_QUERY_TEST_CELLS], basin_vs[VX_QUERY_TEST_CELLS];
+  float cm_vp[VX_QUERY_TEST_CELLS];
+  double x[3] = { 1300.0, 5000.0, 99000.0 };
+  double y[3] = { 2400.0, 3000.0, 2000.0 };
+  double px[1200], py[1200], z[1200];
+  double vp[2][1200], vs[2][1200], rho[2][1200];
+  int src[2][1200];
+  int c, p, n = 1200, missing[2];
+
+  printf("Test: vx_query profile against batch\n");
+
+  for (p = 0; p < VX_QUERY_TEST_CELLS; p++) {
+    basin_vp[p] = (p % 10 < 5) ? 2000.0 + p : VX_QUERY_TEST_NODATA;
+    basin_vs[p] = 1000.0 + p;
+    cm_vp[p] = 6000.0 + p;
+  }
+  set_test_axis(&a, 1000.0, 2000.0, -500.0, 100.0, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  vx_query_setgrid(&g[0], &a, basin_vp, basin_vs, VX_QUERY_TEST_NODATA);
+  set_test_axis(&a, 0.0, 0.0, -5000.0, 1000.0, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  vx_query_setgrid(&g[1], &a, cm_vp, NULL, VX_QUERY_TEST_NODATA);
+
+  /* Columns in the basin, in the coarse grid only, and in neither */
+  for (p = 0; p < n; p++) {
+    z[p] = 200.0 - 5.0 * p;
+  }
+  for (c = 0; c < 3; c++) {
+    for (p = 0; p < n; p++) {
+      px[p] = x[c];
+      py[p] = y[c];
+    }
+    missing[0] = vx_query_batch(g, 2, px, py, z, vp[0], vs[0], rho[0],
+				src[0], n);
+    missing[1] = vx_query_profile(g, 2, x[c], y[c], z, vp[1], vs[1],
+				  rho[1], src[1], n);
+    if ((test_assert_int(missing[1], missing[0]) != 0) ||
+	(memcmp(vp[0], vp[1], sizeof(vp[0])) != 0) ||
+	(memcmp(vs[0], vs[1], sizeof(vs[0])) != 0) ||
+	(memcmp(rho[0], rho[1], sizeof(rho[0])) != 0) ||
+	(memcmp(src[0], src[1], sizeof(src[0])) != 0)) {
+      return _failure("profile differs from batch");
+    }
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_cover()
+{
+  struct axis a;
+  vx_query_grid_t g;
+  float vol[VX_QUERY_TEST_CELLS];
+  double x[VX_QUERY_TEST_CELLS], y[VX_QUERY_TEST_CELLS];
+  double z[VX_QUERY_TEST_CELLS];
+  double vp[2][VX_QUERY_TEST_CELLS], vs[2][VX_QUERY_TEST_CELLS];
+  double rho[2][VX_QUERY_TEST_CELLS];
+  int idx[VX_QUERY_TEST_CELLS], src[2][VX_QUERY_TEST_CELLS];
+  int p, c;
+
+  printf("Test: vx_query column block cover\n");
+
+  /* Columns i >= 5 have no data at any depth */
+  for (p = 0; p < VX_QUERY_TEST_CELLS; p++) {
+    vol[p] = (p % 10 < 5) ? 2000.0 + p : VX_QUERY_TEST_NODATA;
+    x[p] = 1000.0 + (p % 10) * 100.0;
+    y[p] = 2000.0 + ((p / 10) % 8) * 100.0;
+    z[p] = -500.0 + (p / 80) * 100.0;
+  }
+  set_test_axis(&a, 1000.0, 2000.0, -500.0, 100.0, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  vx_query_setgrid(&g, &a, vol, NULL, VX_QUERY_TEST_NODATA);
+  vx_query_batch(&g, 1, x, y, z, vp[0], vs[0], rho[0], src[0],
+		 VX_QUERY_TEST_CELLS);
+
+  /* Blocks of 2 x 2 columns, i = 4,5 keeps its data */
+  if ((vx_query_setcover(&g, 1) != 0) || (test_assert_int(g.cover_n, 5) != 0)) {
+    vx_query_freecover(&g);
+    return _failure("vx_query_setcover failure");
+  }
+  for (c = 0; c < 5 * 4; c++) {
+    if (test_assert_int(g.cover[c], (c % 5 < 3) ? 1 : 0) != 0) {
+      vx_query_freecover(&g);
+      return _failure("cover flags");
+    }
+  }
+  vx_query_index(&g, x, y, z, idx, VX_QUERY_TEST_CELLS);
+  for (p = 0; p < VX_QUERY_TEST_CELLS; p++) {
+    if (test_assert_int(idx[p], (p % 10 < 6) ? p : -1) != 0) {
+      vx_query_freecover(&g);
+      return _failure("covered cell index");
+    }
+  }
+  if ((test_assert_int(vx_query_column(&g, 1500.0, 2000.0), 5) != 0) ||
+      (test_assert_int(vx_query_column(&g, 1600.0, 2000.0), -1) != 0)) {
+    vx_query_freecover(&g);
+    return _failure("covered column");
+  }
+  vx_query_batch(&g, 1, x, y, z, vp[1], vs[1], rho[1], src[1],
+		 VX_QUERY_TEST_CELLS);
+  vx_query_freecover(&g);
+  if ((memcmp(vp[0], vp[1], sizeof(vp[0])) != 0) ||
+      (memcmp(src[0], src[1], sizeof(src[0])) != 0)) {
+    return _failure("results differ with cover");
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_bricks()
+{
+  struct axis a;
+  vx_query_grid_t g[2][2];
+  vx_brick_layout_t bl;
+  float basin_vp[VX_QUERY_TEST_CELLS], basin_vs[VX_QUERY_TEST_CELLS];
+  float cm_vp[VX_QUERY_TEST_CELLS];
+  float *brk[3];
+  double x[VX_QUERY_TEST_CELLS], y[VX_QUERY_TEST_CELLS];
+  double z[VX_QUERY_TEST_CELLS];
+  double vp[2][VX_QUERY_TEST_CELLS], vs[2][VX_QUERY_TEST_CELLS];
+  double rho[2][VX_QUERY_TEST_CELLS];
+  int src[2][VX_QUERY_TEST_CELLS], missing[2];
+  int c, p, rc = 0;
+
+  printf("Test: vx_query brick order volumes\n");
+
+  for (p = 0; p < VX_QUERY_TEST_CELLS; p++) {
+    basin_vp[p] = (p % 10 < 5) ? 2000.0 + p : VX_QUERY_TEST_NODATA;
+    basin_vs[p] = 1000.0 + p;
+    cm_vp[p] = 6000.0 + p;
+    x[p] = 950.0 + (p % 12) * 90.0;
+    y[p] = 1950.0 + ((p / 12) % 10) * 90.0;
+    z[p] = -560.0 + (p / 120) * 160.0;
+  }
+
+  /* Bricks of 4 cells leave partial bricks on every axis */
+  set_test_axis(&a, 0.0, 0.0, 0.0, 1.0, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  vx_brick_setup(&bl, a.N, 4);
+  brk[0] = (float *)vx_brick_relayout((char *)basin_vp, 4, &bl);
+  brk[1] = (float *)vx_brick_relayout((char *)basin_vs, 4, &bl);
+  brk[2] = (float *)vx_brick_relayout((char *)cm_vp, 4, &bl);
+  set_test_axis(&a, 1000.0, 2000.0, -500.0, 100.0, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  vx_query_setgrid(&g[0][0], &a, basin_vp, basin_vs, VX_QUERY_TEST_NODATA);
+  vx_query_setgrid(&g[1][0], &a, brk[0], brk[1], VX_QUERY_TEST_NODATA);
+  set_test_axis(&a, 0.0, 0.0, -5000.0, 1000.0, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  vx_query_setgrid(&g[0][1], &a, cm_vp, NULL, VX_QUERY_TEST_NODATA);
+  vx_query_setgrid(&g[1][1], &a, brk[2], NULL, VX_QUERY_TEST_NODATA);
+  if ((vx_query_setbricks(&g[1][0], 4) != 0) ||
+      (vx_query_setbricks(&g[1][1], 4) != 0) ||
+      (test_assert_int((int)vx_query_ncells(&g[1][0]), 12 * 8 * 8) != 0)) {
+    rc = 1;
+  }
+
+  /* Linear and brick order agree in batches, with covers, and in
+     profiles */
+  for (c = 0; (c < 3) && (rc == 0); c++) {
+    if (c == 1) {
+      vx_query_setcover(&g[0][0], 1);
+      vx_query_setcover(&g[1][0], 1);
+      if (memcmp(g[0][0].cover, g[1][0].cover, 5 * 4) != 0) {
+	rc = 1;
+	break;
+      }
+    }
+    for (p = 0; p < 2; p++) {
+      if (c < 2) {
+	missing[p] = vx_query_batch(g[p], 2, x, y, z, vp[p], vs[p], rho[p],
+				    src[p], VX_QUERY_TEST_CELLS);
+      } else {
+	missing[p] = vx_query_profile(g[p], 2, 1300.0, 2400.0, z, vp[p],
+				      vs[p], rho[p], src[p],
+				      VX_QUERY_TEST_CELLS);
+      }
+    }
+    if ((test_assert_int(missing[1], missing[0]) != 0) ||
+	(memcmp(vp[0], vp[1], sizeof(vp[0])) != 0) ||
+	(memcmp(vs[0], vs[1], sizeof(vs[0])) != 0) ||
+	(memcmp(src[0], src[1], sizeof(src[0])) != 0)) {
+      rc = 1;
+    }
+  }
+  vx_query_freecover(&g[0][0]);
+  vx_query_freecover(&g[1][0]);
+  for (p = 0; p < 3; p++) {
+    free(brk[p]);
+  }
+  if (rc != 0) {
+    return _failure("brick order results differ");
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_morton()
+{
+  struct axis a;
+  vx_query_grid_t g;
+  double x[8] = { 1000.0, 1040.0, 1100.0, 1000.0, 1000.0, 1200.0, 1100.0,
+		  -1.0e12 };
+  double y[8] = { 2000.0, 2020.0, 2000.0, 2100.0, 2000.0, 2000.0, 2100.0,
+		  1.0e12 };
+  double z[8] = { -500.0, -530.0, -500.0, -500.0, -400.0, -500.0, -400.0,
+		  1.0e12 };
+  uint64_t key[8];
+
+  printf("Test: vx_query Morton keys\n");
+
+  set_test_axis(&a, 1000.0, 2000.0, -500.0, 100.0, VX_QUERY_TEST_NX,
+		VX_QUERY_TEST_NY, VX_QUERY_TEST_NZ);
+  vx_query_setgrid(&g, &a, NULL, NULL, VX_QUERY_TEST_NODATA);
+  vx_query_morton(&g, x, y, z, key, 8);
+
+  /* i, j and k take bits 0, 1 and 2 of each triple */
+  if ((key[1] != key[0]) || (key[2] != key[0] + 1) ||
+      (key[3] != key[0] + 2) || (key[4] != key[0] + 4) ||
+      (key[5] != key[0] + 8) || (key[6] != key[0] + 7)) {
+    return _failure("key bits");
+  }
+  /* Far points clamp without wrapping, i at 0, j and k at 2^21-1 */
+  if (key[7] != 0x7fffffffffffffffULL - 0x1249249249249249ULL) {
+    return _failure("clamped keys");
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_geo2utm()
+{
+  double lon[4] = { -118.1, -117.9, NAN, -118.0 };
+  double lat[4] = { 34.1, 34.2, 34.0, 95.0 };
+  double x[4], y[4];
+
+  printf("Test: vx_query lon/lat to UTM\n");
+
+  /* Points without a position and beyond the pole are counted */
+  if (test_assert_int(vx_query_geo2utm(VX_UTM_MODE_EXACT, lon, lat, x, y, 4),
+		      2) != 0) {
+    return _failure("vx_query_geo2utm failure");
+  }
+  if ((test_assert_double(x[0], 398531.949619) != 0) ||
+      (test_assert_double(y[0], 3773595.214065) != 0) ||
+      (test_assert_double(x[1], 417079.100166) != 0) ||
+      (test_assert_double(y[1], 3784502.932849) != 0) ||
+      !isnan(x[2]) || !isnan(y[2]) || !isnan(x[3]) || !isnan(y[3])) {
+    return _failure("UTM coordinates");
+  }
+
+  return _success();
+}
+
+
+/* One gctp conversion, geographic degrees <-> UTM zone 11 meters */
+int gctp_utm11(double *in, double *out, int inverse)
+{
+  long geo = 0, utm = 1, zone = 11, nozone = 0, datum = 0;
+  long degrees = 4, meters = 2, ipr = 5, jpr = 5, iflg;
+  double inparm[15], outparm[15];
+  char efile[CMLEN] = "errfile", pfile[CMLEN] = "pfile";
+  char file27[CMLEN] = "proj27", file83[CMLEN] = "file83";
+
+  memset(inparm, 0, sizeof(inparm));
+  memset(outparm, 0, sizeof(outparm));
+  if (inverse) {
+    gctp(in, &utm, &zone, inparm, &meters, &datum, &ipr, efile, &jpr, pfile,
+	 out, &geo, &nozone, outparm, &degrees, &datum, file27, file83, &iflg);
+  } else {
+    gctp(in, &geo, &nozone, inparm, &degrees, &datum, &ipr, efile, &jpr,
+	 pfile, out, &utm, &zone, outparm, &meters, &datum, file27, file83,
+	 &iflg);
+  }
+  return((int)iflg);
+}
+
+
+int test_vx_query_utm_fwd()
+{
+  char infile[1280];
+  char currentdir[1000];
+  char line[1000];
+  double in[2], ref[2], x, y;
+  FILE *fp;
+  int n = 0;
+
+  printf("Test: vx_utm11_fwd against gctp\n");
+
+  getcwd(currentdir, 1000);
+  sprintf(infile, "%s/%s", currentdir, "./inputs/test-grid-depth.in");
+  fp = fopen(infile, "r");
+  if (fp == NULL) {
+    return _failure("cannot open test-grid-depth.in");
+  }
+  while (fgets(line, 1000, fp) != NULL) {
+    if ((line[0] == '#') || (sscanf(line, "%lf %lf", &in[0], &in[1]) != 2)) {
+      continue;
+    }
+    if (gctp_utm11(in, ref, 0) != 0) {
+      fclose(fp);
+      return _failure("gctp failure");
+    }
+    vx_utm11_fwd(in[0], in[1], &x, &y);
+    if ((x != ref[0]) || (y != ref[1])) {
+      fprintf(stderr, "%lf %lf: %.17g %.17g, gctp %.17g %.17g\n", in[0],
+	      in[1], x, y, ref[0], ref[1]);
+      fclose(fp);
+      return _failure("UTM coordinates differ from gctp");
+    }
+    n++;
+  }
+  fclose(fp);
+  if (n == 0) {
+    return _failure("no test points");
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_utm_inv()
+{
+  char infile[1280];
+  char currentdir[1000];
+  char line[1000];
+  double in[2], ref[2], lon, lat;
+  FILE *fp;
+  int n = 0;
+
+  printf("Test: vx_utm11_inv against gctp\n");
+
+  getcwd(currentdir, 1000);
+  sprintf(infile, "%s/%s", currentdir, "./inputs/test-dat.in");
+  fp = fopen(infile, "r");
+  if (fp == NULL) {
+    return _failure("cannot open test-dat.in");
+  }
+  while (fgets(line, 1000, fp) != NULL) {
+    if (sscanf(line, "%lf,%lf", &in[0], &in[1]) != 2) {
+      continue;
+    }
+    if ((gctp_utm11(in, ref, 1) != 0) ||
+	(vx_utm11_inv(in[0], in[1], &lon, &lat) != 0)) {
+      fclose(fp);
+      return _failure("inverse failure");
+    }
+    if ((lon != ref[0]) || (lat != ref[1])) {
+      fprintf(stderr, "%lf %lf: %.17g %.17g, gctp %.17g %.17g\n", in[0],
+	      in[1], lon, lat, ref[0], ref[1]);
+      fclose(fp);
+      return _failure("lon/lat differ from gctp");
+    }
+    n++;
+  }
+  fclose(fp);
+  if (n == 0) {
+    return _failure("no test points");
+  }
+
+  return _success();
+}
+
+
+int test_vx_query_utm_vector()
+{
+  double *lon, *lat, *x, *y, *xv, *yv, *lonv, *latv;
+  double lone, late, err = 0.0;
+  int i, j, p, nx, ny, n;
+
+  printf("Test: vector UTM transforms over the model bounding box\n");
+
+  nx = (int)((VX_QUERY_TEST_LON1 - VX_QUERY_TEST_LON0) / 0.02) + 1;
+  ny = (int)((VX_QUERY_TEST_LAT1 - VX_QUERY_TEST_LAT0) / 0.02) + 1;
+  n = nx * ny;
+  lon = malloc(8 * n * sizeof(double));
+  lat = &lon[n];
+  x = &lon[2*n];
+  y = &lon[3*n];
+  xv = &lon[4*n];
+  yv = &lon[5*n];
+  lonv = &lon[6*n];
+  latv = &lon[7*n];
+  for (j = 0; j < ny; j++) {
+    for (i = 0; i < nx; i++) {
+      lon[j*nx+i] = VX_QUERY_TEST_LON0 + 0.02 * i;
+      lat[j*nx+i] = VX_QUERY_TEST_LAT0 + 0.02 * j;
+    }
+  }
+
+  /* Forward, vector path against the exact one */
+  for (p = 0; p < n; p++) {
+    vx_utm11_fwd(lon[p], lat[p], &x[p], &y[p]);
+  }
+  vx_utm11_fwd_vec(lon, lat, xv, yv, n);
+  for (p = 0; p < n; p++) {
+    err = fmax(err, fmax(fabs(xv[p] - x[p]), fabs(yv[p] - y[p])));
+  }
+  if (err > VX_UTM_VECTOR_MAXERR) {
+    fprintf(stderr, "forward error %g m\n", err);
+    free(lon);
+    return _failure("vector forward error too large");
+  }
+
+  /* Inverse of the exact UTM points, the errors in meters */
+  if (vx_utm11_inv_vec(x, y, lonv, latv, n) != 0) {
+    free(lon);
+    return _failure("vector inverse failure");
+  }
+  err = 0.0;
+  for (p = 0; p < n; p++) {
+    if (vx_utm11_inv(x[p], y[p], &lone, &late) != 0) {
+      free(lon);
+      return _failure("exact inverse failure");
+    }
+    err = fmax(err, fmax(fabs(lonv[p] - lone), fabs(latv[p] - late)));
+  }
+  if (err * VX_QUERY_TEST_DEG2M > VX_UTM_VECTOR_MAXERR) {
+    fprintf(stderr, "inverse error %g m\n", err * VX_QUERY_TEST_DEG2M);
+    free(lon);
+    return _failure("vector inverse error too large");
+  }
+
+  /* geo2utm follows the given path */
+  vx_query_geo2utm(VX_UTM_MODE_VECTOR, lon, lat, x, y, n);
+  if ((memcmp(x, xv, n * sizeof(double)) != 0) ||
+      (memcmp(y, yv, n * sizeof(double)) != 0)) {
+    free(lon);
+    return _failure("geo2utm ignores vector mode");
+  }
+  free(lon);
+
+  return _success();
+}
+
+
+int test_vx_query_utm_grid()
+{
+  vx_utm_grid_t *g;
+  double lon[1000], lat[1000], x[1000], y[1000], xe, ye;
+  double bound, err = 0.0;
+  int i, j, p, n = 1000;
+
+  printf("Test: UTM lookup grid error bound\n");
+
+  g = vx_utm_grid_new(VX_QUERY_TEST_SGB_LON0, VX_QUERY_TEST_SGB_LON1,
+		      VX_QUERY_TEST_SGB_LAT0, VX_QUERY_TEST_SGB_LAT1,
+		      VX_UTM_GRID_STEP);
+  if (g == NULL) {
+    return _failure("vx_utm_grid_new failure");
+  }
+  if ((g->maxerr <= 0.0) || (g->maxerr > 0.01)) {
+    fprintf(stderr, "error bound %g m\n", g->maxerr);
+    vx_utm_grid_free(g);
+    return _failure("unexpected error bound");
+  }
+
+  /* Pseudo random points in the footprint, the last 100 outside */
+  srand(7);
+  for (p = 0; p < n; p++) {
+    lon[p] = VX_QUERY_TEST_SGB_LON0 + (VX_QUERY_TEST_SGB_LON1 -
+	     VX_QUERY_TEST_SGB_LON0) * (rand() / (double)RAND_MAX);
+    lat[p] = VX_QUERY_TEST_SGB_LAT0 + (VX_QUERY_TEST_SGB_LAT1 -
+	     VX_QUERY_TEST_SGB_LAT0) * (rand() / (double)RAND_MAX);
+    if (p >= n - 100) {
+      lon[p] -= 2.0;
+    }
+  }
+  vx_utm_grid_fwd(g, lon, lat, x, y, n);
+  bound = g->maxerr;
+  for (p = 0; p < n; p++) {
+    vx_utm11_fwd(lon[p], lat[p], &xe, &ye);
+    if ((p >= n - 100) && ((x[p] != xe) || (y[p] != ye))) {
+      break;
+    }
+    err = fmax(err, hypot(x[p] - xe, y[p] - ye));
+  }
+  if (p < n) {
+    vx_utm_grid_free(g);
+    return _failure("points off the grid not exact");
+  }
+
+  /* Cell centres are as far from the nodes as points get */
+  for (j = 0; j < g->nlat - 1; j++) {
+    for (i = 0; i < g->nlon - 1; i++) {
+      lon[0] = g->lon0 + (i + 0.5) * g->dlon;
+      lat[0] = g->lat0 + (j + 0.5) * g->dlat;
+      vx_utm_grid_fwd(g, lon, lat, x, y, 1);
+      vx_utm11_fwd(lon[0], lat[0], &xe, &ye);
+      err = fmax(err, hypot(x[0] - xe, y[0] - ye));
+    }
+  }
+  vx_utm_grid_free(g);
+  if (err > bound) {
+    fprintf(stderr, "error %g m\n", err);
+    return _failure("error above the bound");
+  }
+
+  return _success();
+}
+
+
+int suite_vx_query_exec(const char *xmldir)
+{
+  suite_t suite;
+  char logfile[1280];
+  FILE *lf = NULL;
+
+  /* Setup test suite */
+  strcpy(suite.suite_name, "suite_vx_query_exec");
+
+  suite.num_tests = VX_QUERY_TESTS;
+  suite.tests = malloc(suite.num_tests * sizeof(test_t));
+  if (suite.tests == NULL) {
+    fprintf(stderr, "ERROR: Failed to alloc test structure\n");
+    return(1);
+  }
+  test_get_time(&suite.exec_time);
+
+  /* Setup test cases */
+  strcpy(suite.tests[0].test_name, "test_vx_query_index");
+  suite.tests[0].test_func = &test_vx_query_index;
+  suite.tests[0].elapsed_time = 0.0;
+
+  strcpy(suite.tests[1].test_name, "test_vx_query_gather");
+  suite.tests[1].test_func = &test_vx_query_gather;
+  suite.tests[1].elapsed_time = 0.0;
+
+  strcpy(suite.tests[2].test_name, "test_vx_query_rho");
+  suite.tests[2].test_func = &test_vx_query_rho;
+  suite.tests[2].elapsed_time = 0.0;
+
+  strcpy(suite.tests[3].test_name, "test_vx_query_batch");
+  suite.tests[3].test_func = &test_vx_query_batch;
+  suite.tests[3].elapsed_time = 0.0;
+
+  strcpy(suite.tests[4].test_name, "test_vx_query_geo2utm");
+  suite.tests[4].test_func = &test_vx_query_geo2utm;
+  suite.tests[4].elapsed_time = 0.0;
+
+  strcpy(suite.tests[5].test_name, "test_vx_query_utm_fwd");
+  suite.tests[5].test_func = &test_vx_query_utm_fwd;
+  suite.tests[5].elapsed_time = 0.0;
+
+  strcpy(suite.tests[6].test_name, "test_vx_query_utm_inv");
+  suite.tests[6].test_func = &test_vx_query_utm_inv;
+  suite.tests[6].elapsed_time = 0.0;
+
+  strcpy(suite.tests[7].test_name, "test_vx_query_utm_vector");
+  suite.tests[7].test_func = &test_vx_query_utm_vector;
+  suite.tests[7].elapsed_time = 0.0;
+
+  strcpy(suite.tests[8].test_name, "test_vx_query_utm_grid");
+  suite.tests[8].test_func = &test_vx_query_utm_grid;
+  suite.tests[8].elapsed_time = 0.0;
+
+  strcpy(suite.tests[9].test_name, "test_vx_query_profile");
+  suite.tests[9].test_func = &test_vx_query_profile;
+  suite.tests[9].elapsed_time = 0.0;
+
+  strcpy(suite.tests[10].test_name, "test_vx_query_cover");
+  suite.tests[10].test_func = &test_vx_query_cover;
+  suite.tests[10].elapsed_time = 0.0;
+
+  strcpy(suite.tests[11].test_name, "test_vx_query_rho_vector");
+  suite.tests[11].test_func = &test_vx_query_rho_vector;
+  suite.tests[11].elapsed_time = 0.0;
+
+  strcpy(suite.tests[12].test_name, "test_vx_query_morton");
+  suite.tests[12].test_func = &test_vx_query_morton;
+  suite.tests[12].elapsed_time = 0.0;
+
+  strcpy(suite.tests[13].test_name, "test_vx_query_descriptor");
+  suite.tests[13].test_func = &test_vx_query_descriptor;
+  suite.tests[13].elapsed_time = 0.0;
+
+  strcpy(suite.tests[14].test_name, "test_vx_query_quantize");
+  suite.tests[14].test_func = &test_vx_query_quantize;
+  suite.tests[14].elapsed_time = 0.0;
+
+  strcpy(suite.tests[15].test_name, "test_vx_query_bricks");
+  suite.tests[15].test_func = &test_vx_query_bricks;
+  suite.tests[15].elapsed_time = 0.0;
+
+  if (test_run_suite(&suite) != 0) {
+    fprintf(stderr, "ERROR: Failed to execute tests\n");
+    return(1);
+  }
+
+  if (xmldir != NULL) {
+    sprintf(logfile, "%s/%s.xml", xmldir, suite.suite_name);
+    lf = init_log(logfile);
+    if (lf == NULL) {
+      fprintf(stderr, "ERROR: Failed to initialize logfile\n");
+      return(1);
+    }
+    
+    if (write_log(lf, &suite) != 0) {
+      fprintf(stderr, "ERROR: Failed to write test log\n");
+      return(1);
+    }
+    
+    close_log(lf);
+  }
+
+  free(suite.tests);
+
+  return 0;
+}
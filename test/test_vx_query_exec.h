@@ -0,0 +1,6 @@
+#ifndef TEST_VX_QUERY_EXEC_H
+#define TEST_VX_QUERY_EXEC_H
+
+int suite_vx_query_exec(const char *xmldir);
+
+#endif
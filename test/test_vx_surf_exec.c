@@ -0,0 +1,329 @@
+/**  
+   test_vx_surf_exec.c
+
+   exercises the interleaved surface grids on synthetic surfaces,
+     vx_surf_new, vx_surf_query, vx_surf_load, vx_surf_free
+**/
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include "params.h"
+#include "voxet.h"
+#include "vx_surf.h"
+#include "unittest_defs.h"
+#include "test_vx_surf_exec.h"
+
+int VX_SURF_TESTS=3;
+
+/* Synthetic interfaces voxet */
+#define VX_SURF_TEST_VO "test-vx-surf.vo"
+#define VX_SURF_TEST_NX 12
+#define VX_SURF_TEST_NY 9
+#define VX_SURF_TEST_STEP 250.0
+#define VX_SURF_TEST_OX 400000.0
+#define VX_SURF_TEST_OY 3770000.0
+
+
+/* Plane of surface k at UTM x, y */
+double surf_test_plane(int k, double x, double y)
+{
+  return(100.0 * k + 0.5 * (x - VX_SURF_TEST_OX) -
+	 0.25 * (y - VX_SURF_TEST_OY));
+}
+
+
+void surf_test_axis(struct axis *a)
+{
+  memset(a, 0, sizeof(struct axis));
+  a->O[0] = VX_SURF_TEST_OX;
+  a->O[1] = VX_SURF_TEST_OY;
+  a->U[0] = VX_SURF_TEST_STEP * (VX_SURF_TEST_NX - 1);
+  a->V[1] = VX_SURF_TEST_STEP * (VX_SURF_TEST_NY - 1);
+  a->N[0] = VX_SURF_TEST_NX;
+  a->N[1] = VX_SURF_TEST_NY;
+  a->N[2] = 1;
+}
+
+
+/* Node values of the plane of surface k */
+void surf_test_nodes(int k, float *nodes)
+{
+  int i, j;
+
+  for (j = 0; j < VX_SURF_TEST_NY; j++) {
+    for (i = 0; i < VX_SURF_TEST_NX; i++) {
+      nodes[j * VX_SURF_TEST_NX + i] =
+	surf_test_plane(k, VX_SURF_TEST_OX + i * VX_SURF_TEST_STEP,
+			VX_SURF_TEST_OY + j * VX_SURF_TEST_STEP);
+    }
+  }
+}
+
+
+int test_vx_surf_bilinear()
+{
+  struct axis a;
+  float nodes[VX_SURF_NUM][VX_SURF_TEST_NX * VX_SURF_TEST_NY];
+  const float *surf[VX_SURF_NUM];
+  double x[4], y[4], out[4 * VX_SURF_NUM];
+  vx_surf_t *s;
+  int k, p;
+
+  printf("Test: vx_surf bilinear interpolation\n");
+
+  surf_test_axis(&a);
+  for (k = 0; k < VX_SURF_NUM; k++) {
+    surf_test_nodes(k, nodes[k]);
+    surf[k] = nodes[k];
+  }
+  s = vx_surf_new(&a, surf, NULL, NIL);
+  if (s == NULL) {
+    return _failure("vx_surf_new failed");
+  }
+
+  /* Inside a cell, on the far corner, and off the grid */
+  x[0] = VX_SURF_TEST_OX + 3.3 * VX_SURF_TEST_STEP;
+  y[0] = VX_SURF_TEST_OY + 5.8 * VX_SURF_TEST_STEP;
+  x[1] = VX_SURF_TEST_OX + 0.5 * VX_SURF_TEST_STEP;
+  y[1] = VX_SURF_TEST_OY + 0.1 * VX_SURF_TEST_STEP;
+  x[2] = VX_SURF_TEST_OX + (VX_SURF_TEST_NX - 1) * VX_SURF_TEST_STEP;
+  y[2] = VX_SURF_TEST_OY + (VX_SURF_TEST_NY - 1) * VX_SURF_TEST_STEP;
+  x[3] = VX_SURF_TEST_OX - 1.0;
+  y[3] = VX_SURF_TEST_OY;
+  vx_surf_query(s, x, y, out, 4);
+  for (p = 0; p < 3; p++) {
+    for (k = 0; k < VX_SURF_NUM; k++) {
+      if (fabs(out[p * VX_SURF_NUM + k] - surf_test_plane(k, x[p], y[p]))
+	  > 1.0e-3) {
+	vx_surf_free(s);
+	return _failure("plane not reproduced");
+      }
+    }
+  }
+  for (k = 0; k < VX_SURF_NUM; k++) {
+    if (out[3 * VX_SURF_NUM + k] != NIL) {
+      vx_surf_free(s);
+      return _failure("off grid value");
+    }
+  }
+
+  vx_surf_free(s);
+  return _success();
+}
+
+
+int test_vx_surf_nodata()
+{
+  struct axis a;
+  float nodes[VX_SURF_TEST_NX * VX_SURF_TEST_NY];
+  const float *surf[VX_SURF_NUM];
+  double x, y, out[VX_SURF_NUM];
+  vx_surf_t *s;
+
+  printf("Test: vx_surf nodes without data\n");
+
+  surf_test_axis(&a);
+  surf_test_nodes(VX_SURF_MOHO, nodes);
+  /* Node 2,1 has no data */
+  nodes[VX_SURF_TEST_NX + 2] = NIL;
+  surf[VX_SURF_TOPO] = NULL;
+  surf[VX_SURF_TOP] = nodes;
+  surf[VX_SURF_BASE] = NULL;
+  surf[VX_SURF_MOHO] = nodes;
+  s = vx_surf_new(&a, surf, NULL, NIL);
+  if (s == NULL) {
+    return _failure("vx_surf_new failed");
+  }
+
+  /* In cell 1,1 nearest node 1,1, in cell 2,0 nearest node 2,1 */
+  x = VX_SURF_TEST_OX + 1.2 * VX_SURF_TEST_STEP;
+  y = VX_SURF_TEST_OY + 1.4 * VX_SURF_TEST_STEP;
+  vx_surf_query(s, &x, &y, out, 1);
+  if ((out[VX_SURF_TOPO] != NIL) || (out[VX_SURF_BASE] != NIL) ||
+      (out[VX_SURF_MOHO] != nodes[VX_SURF_TEST_NX + 1]) ||
+      (out[VX_SURF_TOP] != out[VX_SURF_MOHO])) {
+    vx_surf_free(s);
+    return _failure("nearest node value");
+  }
+  x = VX_SURF_TEST_OX + 2.1 * VX_SURF_TEST_STEP;
+  y = VX_SURF_TEST_OY + 0.7 * VX_SURF_TEST_STEP;
+  vx_surf_query(s, &x, &y, out, 1);
+  if (out[VX_SURF_MOHO] != NIL) {
+    vx_surf_free(s);
+    return _failure("nearest node without data");
+  }
+
+  vx_surf_free(s);
+  return _success();
+}
+
+
+/* Big endian surface file */
+int write_surf_file(const char *filename, const float *nodes, int n)
+{
+  FILE *fp;
+  int i, one = 1;
+  unsigned char *c, be[4];
+
+  fp = fopen(filename, "w");
+  if (fp == NULL) {
+    fprintf(stderr,"ERROR: cannot open %s\n", filename);
+    return(1);
+  }
+  for (i = 0; i < n; i++) {
+    c = (unsigned char *)&nodes[i];
+    if (*(char *)&one == 1) {
+      be[0] = c[3]; be[1] = c[2]; be[2] = c[1]; be[3] = c[0];
+    } else {
+      memcpy(be, c, 4);
+    }
+    if (fwrite(be, 4, 1, fp) != 1) {
+      fclose(fp);
+      return(1);
+    }
+  }
+  fclose(fp);
+  return(0);
+}
+
+
+int test_vx_surf_load()
+{
+  const char *names[3] = { "topo_dem", "model_top", "moho" };
+  const int order[3] = { VX_SURF_TOPO, VX_SURF_TOP, VX_SURF_MOHO };
+  const float nodata[3] = { -99999.0, -88888.0, -77777.0 };
+  float nodes[VX_SURF_TEST_NX * VX_SURF_TEST_NY];
+  char currentdir[1000], fn[CMLEN];
+  double x, y, out[VX_SURF_NUM];
+  vx_surf_t *s;
+  FILE *fp;
+  int k;
+
+  printf("Test: vx_surf_load on a synthetic interfaces voxet\n");
+
+  /* base is not listed, each surface has its own no data value */
+  fp = fopen(VX_SURF_TEST_VO, "w");
+  if (fp == NULL) {
+    return _failure("cannot write voxet");
+  }
+  fprintf(fp, "GOCAD Voxet 1\n");
+  fprintf(fp, "AXIS_O %lf %lf 0\n", VX_SURF_TEST_OX, VX_SURF_TEST_OY);
+  fprintf(fp, "AXIS_U %lf 0 0\n", VX_SURF_TEST_STEP * (VX_SURF_TEST_NX - 1));
+  fprintf(fp, "AXIS_V 0 %lf 0\n", VX_SURF_TEST_STEP * (VX_SURF_TEST_NY - 1));
+  fprintf(fp, "AXIS_W 0 0 1\n");
+  fprintf(fp, "AXIS_N %d %d 1\n", VX_SURF_TEST_NX, VX_SURF_TEST_NY);
+  for (k = 0; k < 3; k++) {
+    fprintf(fp, "PROPERTY %d %s\n", k + 1, names[k]);
+    fprintf(fp, "PROP_ESIZE %d 4\n", k + 1);
+    fprintf(fp, "PROP_NO_DATA_VALUE %d %f\n", k + 1, nodata[k]);
+    fprintf(fp, "PROP_FILE %d test-vx-surf_%s@@\n", k + 1, names[k]);
+  }
+  fclose(fp);
+  for (k = 0; k < 3; k++) {
+    surf_test_nodes(order[k], nodes);
+    nodes[0] = nodata[k];
+    sprintf(fn, "test-vx-surf_%s@@", names[k]);
+    if (write_surf_file(fn, nodes, VX_SURF_TEST_NX * VX_SURF_TEST_NY) != 0) {
+      return _failure("cannot write surface");
+    }
+  }
+
+  getcwd(currentdir, 1000);
+  s = vx_surf_load(currentdir, VX_SURF_TEST_VO);
+  for (k = 0; k < 3; k++) {
+    sprintf(fn, "test-vx-surf_%s@@", names[k]);
+    unlink(fn);
+  }
+  unlink(VX_SURF_TEST_VO);
+  if (s == NULL) {
+    return _failure("vx_surf_load failed");
+  }
+
+  x = VX_SURF_TEST_OX + 7.6 * VX_SURF_TEST_STEP;
+  y = VX_SURF_TEST_OY + 2.25 * VX_SURF_TEST_STEP;
+  vx_surf_query(s, &x, &y, out, 1);
+  for (k = 0; k < 3; k++) {
+    if (fabs(out[order[k]] - surf_test_plane(order[k], x, y)) > 1.0e-3) {
+      vx_surf_free(s);
+      return _failure("loaded surface value");
+    }
+  }
+  if (out[VX_SURF_BASE] != s->nodata) {
+    vx_surf_free(s);
+    return _failure("unlisted surface has data");
+  }
+
+  /* Node 0 holds each surface's own no data value */
+  x = VX_SURF_TEST_OX;
+  y = VX_SURF_TEST_OY;
+  vx_surf_query(s, &x, &y, out, 1);
+  for (k = 0; k < VX_SURF_NUM; k++) {
+    if (out[k] != s->nodata) {
+      vx_surf_free(s);
+      return _failure("surface no data not held as nodata");
+    }
+  }
+
+  vx_surf_free(s);
+  return _success();
+}
+
+
+int suite_vx_surf_exec(const char *xmldir)
+{
+  suite_t suite;
+  char logfile[1280];
+  FILE *lf = NULL;
+
+  /* Setup test suite */
+  strcpy(suite.suite_name, "suite_vx_surf_exec");
+
+  suite.num_tests = VX_SURF_TESTS;
+  suite.tests = malloc(suite.num_tests * sizeof(test_t));
+  if (suite.tests == NULL) {
+    fprintf(stderr, "ERROR: Failed to alloc test structure\n");
+    return(1);
+  }
+  test_get_time(&suite.exec_time);
+
+  /* Setup test cases */
+  strcpy(suite.tests[0].test_name, "test_vx_surf_bilinear");
+  suite.tests[0].test_func = &test_vx_surf_bilinear;
+  suite.tests[0].elapsed_time = 0.0;
+
+  strcpy(suite.tests[1].test_name, "test_vx_surf_nodata");
+  suite.tests[1].test_func = &test_vx_surf_nodata;
+  suite.tests[1].elapsed_time = 0.0;
+
+  strcpy(suite.tests[2].test_name, "test_vx_surf_load");
+  suite.tests[2].test_func = &test_vx_surf_load;
+  suite.tests[2].elapsed_time = 0.0;
+
+  if (test_run_suite(&suite) != 0) {
+    fprintf(stderr, "ERROR: Failed to execute tests\n");
+    return(1);
+  }
+
+  if (xmldir != NULL) {
+    sprintf(logfile, "%s/%s.xml", xmldir, suite.suite_name);
+    lf = init_log(logfile);
+    if (lf == NULL) {
+      fprintf(stderr, "ERROR: Failed to initialize logfile\n");
+      return(1);
+    }
+    
+    if (write_log(lf, &suite) != 0) {
+      fprintf(stderr, "ERROR: Failed to write test log\n");
+      return(1);
+    }
+    
+    close_log(lf);
+  }
+
+  free(suite.tests);
+
+  return 0;
+}
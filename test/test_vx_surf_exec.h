@@ -0,0 +1,6 @@
+#ifndef TEST_VX_SURF_EXEC_H
+#define TEST_VX_SURF_EXEC_H
+
+int suite_vx_surf_exec(const char *xmldir);
+
+#endif
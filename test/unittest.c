@@ -6,6 +6,11 @@
 #include "test_vx_lite_cvmhsgbn_exec.h"
 #include "test_vx_cvmhsgbn_exec.h"
 #include "test_cvmhsgbn_exec.h"
+#include "test_vx_io_exec.h"
+#include "test_vx_query_exec.h"
+#include "test_vx_model_exec.h"
+#include "test_vx_surf_exec.h"
+#include "test_gctpc_exec.h"
 
 
 int main (int argc, char *argv[])
@@ -24,6 +29,11 @@ int main (int argc, char *argv[])
   suite_cvmhsgbn_exec(xmldir);
   suite_vx_cvmhsgbn_exec(xmldir);
   suite_vx_lite_cvmhsgbn_exec(xmldir);
+  suite_vx_io_exec(xmldir);
+  suite_vx_query_exec(xmldir);
+  suite_vx_model_exec(xmldir);
+  suite_vx_surf_exec(xmldir);
+  suite_gctpc_exec(xmldir);
 
   if(_has_failure()) {
     return 1;